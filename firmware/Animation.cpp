@@ -15,6 +15,8 @@
 #include <assert.h>
 #include <mbed.h>
 #include "Animation.h"
+#include "FixedTrig.h"
+#include "PixelMath.h"
 
 
 // powf(255.0f, (float)x / 255.0);
@@ -38,6 +40,28 @@ static uint8_t g_powerTable[256] =
     184, 188, 192, 196, 200, 205, 209, 214, 219, 223, 228, 233, 238, 244, 249, 255
 };
 
+// powf(255.0f, (float)x / 255.0) * 256.0f;
+// Same curve as above with 8 fractional bits for interpolating into RGB16Data.
+static uint16_t g_powerTable16[256] =
+{
+      256,   262,   267,   273,   279,   285,   292,   298,   305,   311,   318,   325,   332,   340,   347,   355,
+      362,   370,   379,   387,   395,   404,   413,   422,   431,   441,   450,   460,   470,   481,   491,   502,
+      513,   524,   536,   548,   560,   572,   585,   597,   611,   624,   638,   652,   666,   681,   696,   711,
+      727,   742,   759,   775,   792,   810,   828,   846,   864,   883,   903,   923,   943,   964,   985,  1006,
+     1029,  1051,  1074,  1098,  1122,  1147,  1172,  1198,  1224,  1251,  1278,  1306,  1335,  1364,  1394,  1425,
+     1456,  1488,  1521,  1554,  1588,  1623,  1659,  1695,  1733,  1771,  1810,  1849,  1890,  1932,  1974,  2017,
+     2062,  2107,  2153,  2201,  2249,  2298,  2349,  2400,  2453,  2507,  2562,  2618,  2676,  2735,  2795,  2856,
+     2919,  2983,  3049,  3116,  3184,  3254,  3325,  3399,  3473,  3549,  3627,  3707,  3789,  3872,  3957,  4044,
+     4133,  4223,  4316,  4411,  4508,  4607,  4708,  4812,  4917,  5025,  5136,  5249,  5364,  5482,  5602,  5725,
+     5851,  5979,  6111,  6245,  6382,  6523,  6666,  6812,  6962,  7115,  7271,  7431,  7594,  7761,  7931,  8106,
+     8284,  8466,  8652,  8842,  9036,  9234,  9437,  9645,  9857, 10073, 10294, 10521, 10752, 10988, 11229, 11476,
+    11728, 11986, 12249, 12518, 12793, 13074, 13361, 13655, 13955, 14261, 14575, 14895, 15222, 15556, 15898, 16247,
+    16604, 16969, 17342, 17723, 18112, 18510, 18917, 19332, 19757, 20191, 20635, 21088, 21551, 22025, 22509, 23003,
+    23508, 24025, 24553, 25092, 25643, 26206, 26782, 27371, 27972, 28586, 29214, 29856, 30512, 31182, 31867, 32567,
+    33283, 34014, 34761, 35525, 36305, 37103, 37918, 38751, 39602, 40472, 41361, 42270, 43199, 44148, 45117, 46109,
+    47121, 48157, 49215, 50296, 51401, 52530, 53684, 54863, 56068, 57300, 58559, 59845, 61160, 62504, 63877, 65280
+};
+
 // log2f((float)x)/log2f(255.0f)*255.0f
 static uint8_t g_logTable[256] =
 {
@@ -60,7 +84,9 @@ static uint8_t g_logTable[256] =
 };
 
 
-static unsigned int posRand();
+static uint64_t     nextUpdateTime(uint64_t lastDeadline, uint64_t currTime, uint32_t delay);
+static void         interpolateHsvToRgb16(RGB16Data* pRgbDest, const HSVData* pHsvStart, const HSVData* pHsvStop,
+                                          int32_t fraction);
 
 
 AnimationBase::AnimationBase()
@@ -72,10 +98,17 @@ AnimationBase::AnimationBase()
     m_pRgbPixels = NULL;
     m_pHsvPrev = NULL;
     m_pHsvNext = NULL;
+    m_pOklabPrev = NULL;
+    m_pOklabNext = NULL;
     m_pixelCount = 0;
+    m_interpolateCount = 0;
+    m_frameStartTime = 0;
+    m_lastFrameTime = 0;
+    m_nextFrameTime = 0;
     m_lastRenderTime = 0xFFFFFFFF;
     m_dirty = false;
-    m_timer.start();
+    m_canPlaylist = false;
+    m_isPlaylistRunning = false;
 }
 
 void AnimationBase::setKeyFrames(const AnimationKeyFrame* pFrames, size_t frameCount)
@@ -84,27 +117,105 @@ void AnimationBase::setKeyFrames(const AnimationKeyFrame* pFrames, size_t frameC
     m_pEnd = pFrames + frameCount;
     m_pCurr = pFrames;
     m_pInterpolating = NULL;
-    m_timer.reset();
+    m_frameStartTime = tickMilliseconds();
     m_lastRenderTime = 0xFFFFFFFF;
     m_dirty = true;
+
+    // A single frame is only sent once anyway so there is nothing to gain from a playlist.
+    m_isPlaylistRunning = false;
+    m_canPlaylist = frameCount > 1;
+    for (size_t i = 0 ; i < frameCount ; i++)
+    {
+        if (pFrames[i].interpolateBetweenFrames)
+        {
+            m_canPlaylist = false;
+        }
+    }
+}
+
+void AnimationBase::updatePixels(IPixelSink& ledControl)
+{
+    // Static frames never change once encoded so let the sink play them back on its own if it can.
+    if (m_isPlaylistRunning)
+    {
+        return;
+    }
+    if (m_canPlaylist && ledControl.setPlaylist(m_pStart, m_pEnd - m_pStart, m_pixelCount))
+    {
+        m_isPlaylistRunning = true;
+        return;
+    }
+
+    renderFrame(ledControl, tickMilliseconds());
 }
 
-void AnimationBase::updatePixels(NeoPixel& ledControl)
+bool AnimationBase::getNextFrameTime(uint32_t frameMilliseconds, uint64_t* pFrameTime)
 {
-    if (m_timer.read_ms() > m_pCurr->millisecondsBeforeNextFrame)
+    // Static keyframes are better off being played back by the sink itself and a single static frame never changes.
+    if (!m_pCurr || m_canPlaylist || (m_pEnd - m_pStart == 1 && !m_pCurr->interpolateBetweenFrames))
     {
+        return false;
+    }
+
+    uint64_t frameEndTime = m_frameStartTime + m_pCurr->millisecondsBeforeNextFrame;
+    uint64_t nextFrameTime;
+    if (m_pCurr->interpolateBetweenFrames)
+    {
+        // Step through the interpolation frameMilliseconds at a time, starting at the beginning of the keyframe and
+        // stopping at its end where the next keyframe takes over.
+        nextFrameTime = m_lastFrameTime + frameMilliseconds;
+        if (m_pInterpolating != m_pCurr || nextFrameTime < m_frameStartTime)
+        {
+            nextFrameTime = m_frameStartTime;
+        }
+        if (nextFrameTime > frameEndTime)
+        {
+            nextFrameTime = frameEndTime;
+        }
+    }
+    else
+    {
+        // Nothing changes until the next keyframe once the current one has been sent.
+        nextFrameTime = m_dirty ? m_frameStartTime : frameEndTime;
+    }
+
+    m_nextFrameTime = nextFrameTime;
+    *pFrameTime = nextFrameTime;
+    return true;
+}
+
+void AnimationBase::renderNextFrame(IPixelSink& ledControl)
+{
+    m_lastFrameTime = m_nextFrameTime;
+    renderFrame(ledControl, m_nextFrameTime);
+}
+
+void AnimationBase::renderFrame(IPixelSink& ledControl, uint64_t frameTime)
+{
+    uint64_t elapsedTime = frameTime - m_frameStartTime;
+    if (elapsedTime >= (uint64_t)m_pCurr->millisecondsBeforeNextFrame)
+    {
+        // Advance the start time by the exact length of the frame, rather than restarting it from the current time,
+        // so that any overshoot is carried into the next frame and the keyframe timing doesn't drift.
+        m_frameStartTime += m_pCurr->millisecondsBeforeNextFrame;
+        elapsedTime -= m_pCurr->millisecondsBeforeNextFrame;
         m_pCurr++;
         if (m_pCurr >= m_pEnd)
         {
             m_pCurr = m_pStart;
         }
-        m_timer.reset();
         m_dirty = true;
     }
 
     if (m_pCurr->interpolateBetweenFrames)
     {
-        updatePixelsInterpolated(ledControl);
+        // Clamp in case the main loop stalled for longer than a whole keyframe. The next call will catch up.
+        int32_t currTime = m_pCurr->millisecondsBeforeNextFrame;
+        if (elapsedTime < (uint64_t)currTime)
+        {
+            currTime = (int32_t)elapsedTime;
+        }
+        updatePixelsInterpolated(ledControl, currTime);
     }
     else
     {
@@ -112,52 +223,107 @@ void AnimationBase::updatePixels(NeoPixel& ledControl)
     }
 }
 
-void AnimationBase::updatePixelsNonInterpolated(NeoPixel& ledControl)
+void AnimationBase::updatePixelsNonInterpolated(IPixelSink& ledControl)
 {
     if (m_dirty)
     {
-        ledControl.set(m_pCurr->pPixels, m_pixelCount);
+        if (m_pCurr->pPixels)
+        {
+            ledControl.set(m_pCurr->pPixels, m_pixelCount);
+        }
+        else
+        {
+            ledControl.setPattern(m_pCurr->pPattern, m_pCurr->patternLength, m_pCurr->patternOffset, m_pixelCount);
+        }
         m_dirty = false;
     }
 }
 
-void AnimationBase::updatePixelsInterpolated(NeoPixel& ledControl)
+void AnimationBase::updatePixelsInterpolated(IPixelSink& ledControl, int32_t currTime)
 {
     if (m_pCurr != m_pInterpolating)
     {
-        // Want to interpolate between HSV values so convert the two frames to that colour space at the beginning of
-        // an interpolation sequence.
-        convertRgbPixelsToHsv(m_pHsvPrev, m_pCurr->pPixels, m_pixelCount);
-
         const AnimationKeyFrame* pNextFrame = m_pCurr + 1;
         if (pNextFrame >= m_pEnd)
         {
             pNextFrame = m_pStart;
         }
-        convertRgbPixelsToHsv(m_pHsvNext, pNextFrame->pPixels, m_pixelCount);
+
+        // When going from one pattern to another of the same length, every repetition along the strand interpolates
+        // the same way so only the first one needs to be calculated.
+        m_interpolateCount = m_pixelCount;
+        if (!m_pCurr->pPixels && !pNextFrame->pPixels &&
+            m_pCurr->patternLength == pNextFrame->patternLength && m_pCurr->patternLength < m_pixelCount)
+        {
+            m_interpolateCount = m_pCurr->patternLength;
+        }
+
+        // Want to interpolate between HSV or Oklab values so convert the two frames to that colour space at the
+        // beginning of an interpolation sequence.
+        if (m_pCurr->interpolationSpace == Interpolate_Oklab)
+        {
+            convertKeyFrameToOklab(m_pOklabPrev, m_pCurr, m_interpolateCount);
+            convertKeyFrameToOklab(m_pOklabNext, pNextFrame, m_interpolateCount);
+        }
+        else
+        {
+            convertKeyFrameToHsv(m_pHsvPrev, m_pCurr, m_interpolateCount);
+            convertKeyFrameToHsv(m_pHsvNext, pNextFrame, m_interpolateCount);
+        }
 
         m_lastRenderTime = 0xFFFFFFFF;
         m_pInterpolating = m_pCurr;
     }
 
     // Don't render the interpolation more than once per millisecond.
-    int32_t currTime = m_timer.read_ms();
     if (currTime != m_lastRenderTime)
     {
-        interpolateBetweenKeyFrames(currTime, m_pCurr->millisecondsBeforeNextFrame);
+        if (m_pCurr->interpolationSpace == Interpolate_Oklab)
+        {
+            interpolateOklabBetweenKeyFrames(currTime, m_pCurr->millisecondsBeforeNextFrame);
+        }
+        else
+        {
+            interpolateBetweenKeyFrames(currTime, m_pCurr->millisecondsBeforeNextFrame);
+        }
+        // The interpolated frame is sent with set() rather than as a pattern so fill in the rest of the repetitions
+        // here.
+        for (size_t i = m_interpolateCount ; i < m_pixelCount ; i++)
+        {
+            m_pRgbPixels[i] = m_pRgbPixels[i - m_interpolateCount];
+        }
         ledControl.set(m_pRgbPixels, m_pixelCount);
         m_lastRenderTime = currTime;
     }
 }
 
-void AnimationBase::convertRgbPixelsToHsv(HSVData* pHsvDest, const RGBData* pRgbSrc, size_t pixelCount)
+void AnimationBase::convertKeyFrameToHsv(HSVData* pHsvDest, const AnimationKeyFrame* pFrame, size_t pixelCount)
+{
+    for (size_t i = 0 ; i < pixelCount ; i++)
+    {
+        rgbToInterpolatableHsv(pHsvDest++, keyFramePixel(pFrame, i));
+    }
+}
+
+void AnimationBase::convertKeyFrameToOklab(OklabData* pOklabDest, const AnimationKeyFrame* pFrame, size_t pixelCount)
 {
-    while (pixelCount--)
+    for (size_t i = 0 ; i < pixelCount ; i++)
     {
-        rgbToInterpolatableHsv(pHsvDest++, pRgbSrc++);
+        rgbToOklab(pOklabDest++, keyFramePixel(pFrame, i));
     }
 }
 
+const PixelData* AnimationBase::keyFramePixel(const AnimationKeyFrame* pFrame, size_t pixel)
+{
+    if (pFrame->pPixels)
+    {
+        return &pFrame->pPixels[pixel];
+    }
+
+    size_t length = pFrame->patternLength;
+    return &pFrame->pPattern[(pixel + length - pFrame->patternOffset % length) % length];
+}
+
 void AnimationBase::rgbToInterpolatableHsv(HSVData* pHsvDest, const RGBData* pRgbSrc)
 {
     rgbToHsv(pHsvDest, pRgbSrc);
@@ -167,15 +333,41 @@ void AnimationBase::rgbToInterpolatableHsv(HSVData* pHsvDest, const RGBData* pRg
     pHsvDest->value = g_logTable[pHsvDest->value];
 }
 
+void AnimationBase::rgbToInterpolatableHsv(HSVData* pHsvDest, const XRGBData* pRgbSrc)
+{
+    RGBData rgb(pRgbSrc->red, pRgbSrc->green, pRgbSrc->blue);
+    rgbToInterpolatableHsv(pHsvDest, &rgb);
+}
+
 void AnimationBase::interpolateBetweenKeyFrames(int32_t currTime, int32_t totalTime)
 {
-    const HSVData* pPrev = m_pHsvPrev;
-    const HSVData* pNext = m_pHsvNext;
-    RGBData* pRgb = m_pRgbPixels;
+    const HSVData*  pPrev = m_pHsvPrev;
+    const HSVData*  pNext = m_pHsvNext;
+    FramePixelData* pRgb = m_pRgbPixels;
 
-    for (size_t i = 0 ; i < m_pixelCount ; i++)
+    // Only one divide per frame rather than one for each channel of each pixel.
+    int32_t fraction = (int32_t)(((int64_t)currTime << 12) / totalTime);
+    for (size_t i = 0 ; i < m_interpolateCount ; i++)
+    {
+        RGB16Data rgb16;
+        interpolateHsvToRgb16(&rgb16, pPrev++, pNext++, fraction);
+        convertPixel(pRgb++, &rgb16);
+    }
+}
+
+void AnimationBase::interpolateOklabBetweenKeyFrames(int32_t currTime, int32_t totalTime)
+{
+    const OklabData* pPrev = m_pOklabPrev;
+    const OklabData* pNext = m_pOklabNext;
+    FramePixelData*  pRgb = m_pRgbPixels;
+
+    // Only one divide per frame rather than one for each channel of each pixel.
+    int32_t fraction = (int32_t)(((int64_t)currTime << 12) / totalTime);
+    for (size_t i = 0 ; i < m_interpolateCount ; i++)
     {
-        interpolateHsvToRgb(pRgb++, pPrev++, pNext++, currTime, totalTime);
+        RGB16Data rgb16;
+        oklabLerpToRgb16(&rgb16, pPrev++, pNext++, fraction);
+        convertPixel(pRgb++, &rgb16);
     }
 }
 
@@ -201,6 +393,41 @@ void AnimationBase::interpolateHsvToRgb(RGBData* pRgbDest, const HSVData* pHsvSt
     hsvToRgb(pRgbDest, &interpolated);
 }
 
+void AnimationBase::interpolateHsvToRgb(XRGBData* pRgbDest, const HSVData* pHsvStart, const HSVData* pHsvStop,
+                                        int32_t curr, int32_t total)
+{
+    RGBData rgb;
+    interpolateHsvToRgb(&rgb, pHsvStart, pHsvStop, curr, total);
+    *pRgbDest = XRGBData(rgb);
+}
+
+// Same as AnimationBase::interpolateHsvToRgb() but fraction is in the range 0 (all pHsvStart) to 4096 (all pHsvStop)
+// and the hue and value are interpolated with 8 fractional bits rather than being rounded to the nearest level.
+static void interpolateHsvToRgb16(RGB16Data* pRgbDest, const HSVData* pHsvStart, const HSVData* pHsvStop,
+                                  int32_t fraction)
+{
+    HSV16Data interpolated;
+
+    int32_t huePrev = pHsvStart->hue << 8;
+    int32_t hueNext = pHsvStop->hue << 8;
+    interpolated.hue = huePrev + (((hueNext - huePrev) * fraction) >> 12);
+
+    int32_t saturationPrev = pHsvStart->saturation;
+    int32_t saturationNext = pHsvStop->saturation;
+    interpolated.saturation = saturationPrev + (((saturationNext - saturationPrev) * fraction + 2048) >> 12);
+
+    // Use an exponential curve for brightness to make the interpolation perception smoother to the human eye.
+    int32_t valuePrev = pHsvStart->value << 8;
+    int32_t valueNext = pHsvStop->value << 8;
+    int32_t newValue = valuePrev + (((valueNext - valuePrev) * fraction) >> 12);
+    uint32_t index = newValue >> 8;
+    uint32_t curr = g_powerTable16[index];
+    uint32_t next = index < 255 ? g_powerTable16[index + 1] : curr;
+    interpolated.value = curr + (((next - curr) * (newValue & 0xFF)) >> 8);
+
+    hsvToRgb(pRgbDest, &interpolated);
+}
+
 
 
 
@@ -210,15 +437,17 @@ TwinkleAnimationBase::TwinkleAnimationBase()
     m_pRgbPixels = NULL;
     m_pHsvPixels = NULL;
     m_pTwinkleInfo = NULL;
+    m_pTwinkleOrder = NULL;
+    m_activeCount = 0;
     m_pixelCount = 0;
-    m_lastUpdate = -1;
-    m_timer.start();
+    m_lastUpdate = ~0ULL;
+    m_dirty = false;
 }
 
 void TwinkleAnimationBase::setProperties(const TwinkleProperties* pProperties)
 {
     m_pProperties = pProperties;
-    RGBData rgb;
+    PixelData rgb;
     hsvToRgb(&rgb, &pProperties->hsvBackground);
     for (size_t i = 0 ; i < m_pixelCount ; i++)
     {
@@ -227,62 +456,124 @@ void TwinkleAnimationBase::setProperties(const TwinkleProperties* pProperties)
     memset(m_pHsvPixels, 0, sizeof(*m_pHsvPixels) * m_pixelCount);
     memset(m_pTwinkleInfo, 0, sizeof(*m_pTwinkleInfo) * m_pixelCount);
 
-    m_lastUpdate = -1;
-    m_timer.reset();
+    // No pixels are twinkling yet.
+    assert ( m_pixelCount <= 0xFFFF );
+    for (size_t i = 0 ; i < m_pixelCount ; i++)
+    {
+        m_pTwinkleOrder[i] = i;
+        m_pTwinkleInfo[i].orderIndex = i;
+    }
+    m_activeCount = 0;
+    calculateSpawnDistribution();
+
+    m_lastUpdate = ~0ULL;
+    m_dirty = true;
 }
 
-void TwinkleAnimationBase::updatePixels(NeoPixel& ledControl)
+void TwinkleAnimationBase::updatePixels(IPixelSink& ledControl)
 {
-    int32_t currTime = m_timer.read_ms();
+    uint64_t currTime = tickMilliseconds();
     if (m_lastUpdate == currTime)
     {
         // Only do any work once each millisecond.
         return;
     }
+    // Keep the spawn rate constant even if the main loop takes longer than a millisecond to come back around.
+    uint64_t elapsedTicks = (m_lastUpdate == ~0ULL) ? 1 : currTime - m_lastUpdate;
+    if (elapsedTicks > MAX_CATCHUP_TICKS)
+    {
+        elapsedTicks = MAX_CATCHUP_TICKS;
+    }
     m_lastUpdate = currTime;
 
-    // Animate twinkles already in progress.
-    HSVData* pHsvPixel = m_pHsvPixels;
-    HSVData* pEnd = m_pHsvPixels + m_pixelCount;
-    RGBData* pRgbPixel = m_pRgbPixels;
-    PixelTwinkleInfo* pInfo = m_pTwinkleInfo;
-    while (pHsvPixel < pEnd)
+    // Animate twinkles already in progress. Only the active pixels at the front of m_pTwinkleOrder need to be
+    // visited since the rest are already sitting at the background colour.
+    if (m_activeCount > 0)
+    {
+        m_dirty = true;
+    }
+    size_t i = 0;
+    while (i < m_activeCount)
     {
-        twinklePixel(pRgbPixel++, pHsvPixel++, pInfo++, currTime);
+        size_t pixel = m_pTwinkleOrder[i];
+        if (twinklePixel(&m_pRgbPixels[pixel], &m_pHsvPixels[pixel], &m_pTwinkleInfo[pixel], (uint32_t)currTime))
+        {
+            i++;
+        }
+        else
+        {
+            // The last active pixel is swapped into this slot so don't advance.
+            deactivateTwinkle(i);
+        }
     }
 
     // Randomly start twinkling pixels.
-    if (posRand() % m_pProperties->probability != 0)
+    while (elapsedTicks--)
     {
-        // Don't need to start another twinkle at this time.
-        ledControl.set(m_pRgbPixels, m_pixelCount);
-        return;
+        spawnTwinkles((uint32_t)currTime);
     }
 
-    // Pick the pixel to twinkle.
-    int pixelToTwinkle = posRand() % m_pixelCount;
-    pInfo = &m_pTwinkleInfo[pixelToTwinkle];
-    if (pInfo->lifetime != 0)
+    flushPixels(ledControl);
+}
+
+void TwinkleAnimationBase::calculateSpawnDistribution()
+{
+    // The average number of twinkles to be started in each 1 millisecond tick across the whole strand.
+    float lambda = (float)m_pProperties->twinkleRate * (float)m_pixelCount / 1000000.0f;
+
+    // Build the cumulative Poisson distribution once here so that each tick only needs a single random number to
+    // determine how many twinkles it should start. Any probability of starting more than MAX_SPAWNS_PER_TICK in a
+    // single tick is lumped into the last entry.
+    const float randRange = 4294967296.0f;
+    float       probability = expf(-lambda);
+    float       cumulative = 0.0f;
+    for (size_t k = 0 ; k < MAX_SPAWNS_PER_TICK ; k++)
+    {
+        cumulative += probability;
+        float threshold = cumulative * randRange;
+        m_spawnThresholds[k] = threshold >= randRange ? 0xFFFFFFFF : (uint32_t)threshold;
+        probability *= lambda / (float)(k + 1);
+    }
+    m_spawnThresholds[MAX_SPAWNS_PER_TICK - 1] = 0xFFFFFFFF;
+}
+
+void TwinkleAnimationBase::spawnTwinkles(uint32_t currTime)
+{
+    // Determine how many twinkles to start this tick.
+    uint32_t randValue = m_random.next();
+    size_t   spawnCount = 0;
+    while (spawnCount < MAX_SPAWNS_PER_TICK - 1 && randValue >= m_spawnThresholds[spawnCount])
     {
-        // Don't bother since it is already in the process of twinkling.
-        ledControl.set(m_pRgbPixels, m_pixelCount);
-        return;
+        spawnCount++;
     }
 
+    // Pick each of them directly from the pixels which aren't already twinkling.
+    while (spawnCount-- > 0 && m_activeCount < m_pixelCount)
+    {
+        size_t freeCount = m_pixelCount - m_activeCount;
+        startTwinkle(m_pTwinkleOrder[m_activeCount + m_random.nextBounded(freeCount)], currTime);
+    }
+}
+
+void TwinkleAnimationBase::startTwinkle(size_t pixelToTwinkle, uint32_t currTime)
+{
+    PixelTwinkleInfo* pInfo = &m_pTwinkleInfo[pixelToTwinkle];
+    assert ( pInfo->lifetime == 0 );
+
     // Configure this pixel for twinkling.
-    uint32_t lifetimeDelta = m_pProperties->lifetimeMax - m_pProperties->lifetimeMin;
-    pInfo->lifetime = m_pProperties->lifetimeMin + (lifetimeDelta ? posRand() % lifetimeDelta : 0);
+    pInfo->lifetime = m_random.nextInRange(m_pProperties->lifetimeMin, m_pProperties->lifetimeMax);
+    if (pInfo->lifetime == 0)
+    {
+        // A lifetime of 0 is used to flag pixels which aren't twinkling.
+        pInfo->lifetime = 1;
+    }
     pInfo->startTime = currTime;
     pInfo->isGettingBrighter = true;
 
-    pHsvPixel = &m_pHsvPixels[pixelToTwinkle];
-    uint8_t hueDelta = m_pProperties->hueMax - m_pProperties->hueMin;
-    uint8_t saturationDelta = m_pProperties->saturationMax - m_pProperties->saturationMin;
-    uint8_t valueDelta = m_pProperties->valueMax - m_pProperties->valueMin;
-
-    pHsvPixel->hue = m_pProperties->hueMin + (hueDelta ? posRand() % hueDelta : 0);
-    pHsvPixel->saturation = m_pProperties->saturationMin + (saturationDelta ? posRand() % saturationDelta : 0);
-    pHsvPixel->value = g_logTable[m_pProperties->valueMin + (valueDelta ? posRand() % valueDelta : 0)];
+    HSVData* pHsvPixel = &m_pHsvPixels[pixelToTwinkle];
+    pHsvPixel->hue = m_random.nextInRange(m_pProperties->hueMin, m_pProperties->hueMax);
+    pHsvPixel->saturation = m_random.nextInRange(m_pProperties->saturationMin, m_pProperties->saturationMax);
+    pHsvPixel->value = g_logTable[m_random.nextInRange(m_pProperties->valueMin, m_pProperties->valueMax)];
 
     // Set RGB pixel value to match starting colour.
     if (m_pProperties->hsvBackground.hue == 0 &&
@@ -297,27 +588,67 @@ void TwinkleAnimationBase::updatePixels(NeoPixel& ledControl)
     {
         pInfo->hsvStart = m_pProperties->hsvBackground;
     }
-    hsvToRgb(pRgbPixel, &pInfo->hsvStart);
+    hsvToRgb(&m_pRgbPixels[pixelToTwinkle], &pInfo->hsvStart);
     pInfo->hsvStart.value = g_logTable[pInfo->hsvStart.value];
+    activateTwinkle(pixelToTwinkle);
+    m_dirty = true;
+}
 
-    ledControl.set(m_pRgbPixels, m_pixelCount);
+void TwinkleAnimationBase::flushPixels(IPixelSink& ledControl)
+{
+    // Only send the pixels to the LEDs when at least one of them has actually changed.
+    if (m_dirty)
+    {
+        ledControl.set(m_pRgbPixels, m_pixelCount);
+        m_dirty = false;
+    }
 }
 
-static unsigned int posRand()
+void TwinkleAnimationBase::activateTwinkle(size_t pixel)
 {
-    return (unsigned int)rand();
+    // Move this pixel from the free region of m_pTwinkleOrder to the end of the active region.
+    assert ( m_pTwinkleInfo[pixel].orderIndex >= m_activeCount );
+    swapTwinkleOrder(m_pTwinkleInfo[pixel].orderIndex, m_activeCount);
+    m_activeCount++;
 }
 
-void TwinkleAnimationBase::twinklePixel(RGBData* pRgbDest,
-                                    const HSVData* pHsv,
-                                    PixelTwinkleInfo* pInfo,
-                                    uint32_t currTime)
+void TwinkleAnimationBase::deactivateTwinkle(size_t orderIndex)
 {
-    if (pInfo->lifetime == 0)
+    // Swap the last active pixel into this slot and shrink the active region to drop this pixel off the end.
+    assert ( orderIndex < m_activeCount );
+    m_activeCount--;
+    swapTwinkleOrder(orderIndex, m_activeCount);
+}
+
+void TwinkleAnimationBase::swapTwinkleOrder(size_t orderIndex1, size_t orderIndex2)
+{
+    uint16_t pixel1 = m_pTwinkleOrder[orderIndex1];
+    uint16_t pixel2 = m_pTwinkleOrder[orderIndex2];
+
+    m_pTwinkleOrder[orderIndex1] = pixel2;
+    m_pTwinkleInfo[pixel2].orderIndex = orderIndex1;
+    m_pTwinkleOrder[orderIndex2] = pixel1;
+    m_pTwinkleInfo[pixel1].orderIndex = orderIndex2;
+}
+
+static uint64_t nextUpdateTime(uint64_t lastDeadline, uint64_t currTime, uint32_t delay)
+{
+    // Schedule relative to the previous deadline so that time spent in the main loop doesn't accumulate as drift.
+    // If the loop stalled for more than a whole period then resynchronize rather than bursting to catch up.
+    uint64_t nextDeadline = lastDeadline + delay;
+    if (nextDeadline <= currTime)
     {
-        // This pixel isn't twinkling so just return.
-        return;
+        nextDeadline = currTime + delay;
     }
+    return nextDeadline;
+}
+
+bool TwinkleAnimationBase::twinklePixel(PixelData* pRgbDest,
+                                        const HSVData* pHsv,
+                                        PixelTwinkleInfo* pInfo,
+                                        uint32_t currTime)
+{
+    assert ( pInfo->lifetime != 0 );
 
     uint32_t deltaTime = currTime - pInfo->startTime;
     if (pInfo->isGettingBrighter)
@@ -346,12 +677,14 @@ void TwinkleAnimationBase::twinklePixel(RGBData* pRgbDest,
             // The twinkle is complete so flag it as being so and set LED back to background colour.
             pInfo->lifetime = 0;
             hsvToRgb(pRgbDest, &m_pProperties->hsvBackground);
-            return;
+            return false;
         }
         HSVData hsvStart = *pHsv;
         HSVData hsvStop = pInfo->hsvStart;
         AnimationBase::interpolateHsvToRgb(pRgbDest, &hsvStart, &hsvStop, deltaTime, pInfo->lifetime);
     }
+
+    return true;
 }
 
 
@@ -364,8 +697,7 @@ FlickerAnimationBase::FlickerAnimationBase()
     m_pHsvPixels = NULL;
     m_pFlickerInfo = NULL;
     m_pixelCount = 0;
-    m_lastUpdate = -1;
-    m_timer.start();
+    m_lastUpdate = ~0ULL;
 }
 
 void FlickerAnimationBase::setProperties(const FlickerProperties* pProperties)
@@ -376,18 +708,20 @@ void FlickerAnimationBase::setProperties(const FlickerProperties* pProperties)
     // Fill in starting HSV colour for all LEDs to be desired RGB colour but with brightness modified to maximum value.
     rgbToHsv(&hsvColour, &pProperties->baseRGBColour);
     hsvColour.value = pProperties->brightnessMax;
-    createRepeatingPixelPattern((RGBData*)m_pHsvPixels, m_pixelCount, (const RGBData*)&hsvColour, 1);
+    for (size_t i = 0 ; i < m_pixelCount ; i++)
+    {
+        m_pHsvPixels[i] = hsvColour;
+    }
 
     memset(m_pRgbPixels, 0, sizeof(*m_pRgbPixels) * m_pixelCount);
     memset(m_pFlickerInfo, 0, sizeof(*m_pFlickerInfo) * m_pixelCount);
 
-    m_lastUpdate = -1;
-    m_timer.reset();
+    m_lastUpdate = ~0ULL;
 }
 
-void FlickerAnimationBase::updatePixels(NeoPixel& ledControl)
+void FlickerAnimationBase::updatePixels(IPixelSink& ledControl)
 {
-    int32_t currTime = m_timer.read_ms();
+    uint64_t currTime = tickMilliseconds();
     if (m_lastUpdate == currTime)
     {
         // Only do any work once each millisecond.
@@ -398,17 +732,17 @@ void FlickerAnimationBase::updatePixels(NeoPixel& ledControl)
     // Run through all LEDs and flicker them.
     HSVData* pHsvPixel = m_pHsvPixels;
     HSVData* pEnd = m_pHsvPixels + m_pixelCount;
-    RGBData* pRgbPixel = m_pRgbPixels;
+    PixelData* pRgbPixel = m_pRgbPixels;
     PixelFlickerInfo* pInfo = m_pFlickerInfo;
     while (pHsvPixel < pEnd)
     {
-        updatePixel(pRgbPixel++, pHsvPixel++, pInfo++, currTime);
+        updatePixel(pRgbPixel++, pHsvPixel++, pInfo++, (uint32_t)currTime);
     }
 
     ledControl.set(m_pRgbPixels, m_pixelCount);
 }
 
-void FlickerAnimationBase::updatePixel(RGBData* pRgbDest,
+void FlickerAnimationBase::updatePixel(PixelData* pRgbDest,
                                        const HSVData* pHsv,
                                        PixelFlickerInfo* pInfo,
                                        uint32_t currTime)
@@ -427,8 +761,7 @@ void FlickerAnimationBase::updatePixel(RGBData* pRgbDest,
     if (pInfo->time == 0)
     {
         // Pick a new brightnes level to interpolate towards.
-        uint32_t timeDelta = m_pProperties->timeMax - m_pProperties->timeMin;
-        pInfo->time = m_pProperties->timeMin + (timeDelta ? posRand() % timeDelta : 0);
+        pInfo->time = m_random.nextInRange(m_pProperties->timeMin, m_pProperties->timeMax);
         pInfo->startTime = currTime;
 
         pInfo->hsvStart = *pHsv;
@@ -436,7 +769,7 @@ void FlickerAnimationBase::updatePixel(RGBData* pRgbDest,
 
         // The brightness level should have a greater chance of being brightest setting compared to other values.
         uint32_t brightnessDelta = m_pProperties->brightnessMax - m_pProperties->brightnessMin;
-        uint32_t randValue = posRand() % (m_pProperties->stayBrightFactor * brightnessDelta);
+        uint32_t randValue = m_random.nextBounded(m_pProperties->stayBrightFactor * brightnessDelta);
         pInfo->hsvStop.value = (randValue > brightnessDelta) ? m_pProperties->brightnessMax :
                                                                m_pProperties->brightnessMin + randValue;
 
@@ -454,9 +787,9 @@ RunningLightsAnimationBase::RunningLightsAnimationBase()
     m_pRgbPixels = NULL;
     m_pixelCount = 0;
     m_position = 0;
+    m_nextUpdate = 0;
     m_delay = 0;
     memset(&m_hsv, 0, sizeof(m_hsv));
-    m_timer.start();
 }
 
 void RunningLightsAnimationBase::setProperties(const HSVData* pHSV, int32_t delayMilliseconds)
@@ -465,22 +798,42 @@ void RunningLightsAnimationBase::setProperties(const HSVData* pHSV, int32_t dela
     m_delay = delayMilliseconds;
     m_position = 0;
     memset(m_pRgbPixels, 0, sizeof(*m_pRgbPixels) * m_pixelCount);
-    m_timer.reset();
+    m_nextUpdate = tickMilliseconds() + m_delay;
 }
 
-void RunningLightsAnimationBase::updatePixels(NeoPixel& ledControl)
+void RunningLightsAnimationBase::updatePixels(IPixelSink& ledControl)
 {
-    int32_t currTime = m_timer.read_ms();
-    if (currTime < m_delay)
+    uint64_t currTime = tickMilliseconds();
+    if (currTime < m_nextUpdate)
     {
         // Nothing to do at this time.
         return;
     }
 
-    HSVData hsv = m_hsv;
+    renderFrame(ledControl);
+    m_nextUpdate = nextUpdateTime(m_nextUpdate, currTime, m_delay);
+}
+
+bool RunningLightsAnimationBase::getNextFrameTime(uint32_t frameMilliseconds, uint64_t* pFrameTime)
+{
+    *pFrameTime = m_nextUpdate;
+    return true;
+}
+
+void RunningLightsAnimationBase::renderNextFrame(IPixelSink& ledControl)
+{
+    renderFrame(ledControl);
+    m_nextUpdate += m_delay;
+}
+
+void RunningLightsAnimationBase::renderFrame(IPixelSink& ledControl)
+{
+    // The brightness of each LED follows a sine wave which advances by 1 radian per LED and per iteration.
+    HSVData          hsv = m_hsv;
+    PhaseAccumulator phase(m_position * PHASE_PER_RADIAN, PHASE_PER_RADIAN);
     for (size_t i = 0 ; i < m_pixelCount ; i++)
     {
-        uint8_t brightnessScale = 128 + (uint8_t)(sinf(m_position + i) * 127.0f);
+        uint8_t brightnessScale = 128 + (phase.nextSinQ15() * 127) / 32767;
         hsv.value = ((uint16_t)m_hsv.value * brightnessScale) / 255;
         hsvToRgb(&m_pRgbPixels[i], &hsv);
     }
@@ -491,7 +844,6 @@ void RunningLightsAnimationBase::updatePixels(NeoPixel& ledControl)
     {
         m_position = 0;
     }
-    m_timer.reset();
 }
 
 
@@ -504,42 +856,67 @@ MeteorAnimationBase::MeteorAnimationBase()
 {
     m_pProperties = NULL;
     m_pRgbPixels = NULL;
+    m_pPixelOrder = NULL;
     m_pixelCount = 0;
     m_iteration = 0;
-    m_timer.start();
+    m_nextUpdate = 0;
 }
 
 void MeteorAnimationBase::setProperties(const MeteorProperties* pProperties)
 {
     m_pProperties = pProperties;
-    m_timer.reset();
+    m_nextUpdate = tickMilliseconds() + pProperties->delay;
 }
 
-void MeteorAnimationBase::updatePixels(NeoPixel& ledControl)
+void MeteorAnimationBase::updatePixels(IPixelSink& ledControl)
 {
-    uint32_t currTime = m_timer.read_ms();
-    if (currTime < m_pProperties->delay)
+    uint64_t currTime = tickMilliseconds();
+    if (currTime < m_nextUpdate)
     {
         // Need to delay more before updating animation pixel state.
         return;
     }
-    m_timer.reset();
+    m_nextUpdate = nextUpdateTime(m_nextUpdate, currTime, m_pProperties->delay);
+    renderFrame(ledControl);
+}
+
+bool MeteorAnimationBase::getNextFrameTime(uint32_t frameMilliseconds, uint64_t* pFrameTime)
+{
+    *pFrameTime = m_nextUpdate;
+    return true;
+}
 
-    // Fade brightness of each trail pixel.
-    for (size_t j = 0 ; j < m_pixelCount ; j++)
+void MeteorAnimationBase::renderNextFrame(IPixelSink& ledControl)
+{
+    m_nextUpdate += m_pProperties->delay;
+    renderFrame(ledControl);
+}
+
+void MeteorAnimationBase::renderFrame(IPixelSink& ledControl)
+{
+    // Fade brightness of each trail pixel. When the decay is random, 32 pixels worth of decisions are taken from
+    // each random bitmask. Every pixel fades on its own so the fade doesn't care which order the trail was drawn in.
+    if (m_pProperties->isDecayRandom)
     {
-        if (!m_pProperties->isDecayRandom || rand()%10 > 5)
+        for (size_t j = 0 ; j < m_pixelCount ; j += 32)
         {
-            fadeToBlack(j, m_pProperties->trailDecay);
+            uint32_t decayMask = m_random.nextMask(RANDOM_DECAY_PROBABILITY);
+            size_t   count = m_pixelCount - j < 32 ? m_pixelCount - j : 32;
+            pixelsFadeToBlackMasked(&m_pRgbPixels[j], count, &decayMask, m_pProperties->trailDecay, FADE_THRESHOLD);
         }
     }
+    else
+    {
+        pixelsFadeToBlack(m_pRgbPixels, m_pixelCount, m_pProperties->trailDecay, FADE_THRESHOLD);
+    }
 
-    // Draw the meteor.
+    // Draw the meteor. It moves in a straight line so scatter it out to the LEDs if following a physical ordering.
     for (size_t j = 0; j < m_pProperties->size; j++)
     {
-        if (m_iteration - j < m_pixelCount)
+        size_t pixel = m_iteration - j;
+        if (pixel < m_pixelCount)
         {
-            m_pRgbPixels[m_iteration - j] = m_pProperties->brightColor;
+            m_pRgbPixels[m_pPixelOrder ? m_pPixelOrder[pixel] : pixel] = m_pProperties->brightColor;
         }
     }
 
@@ -557,17 +934,6 @@ void MeteorAnimationBase::updatePixels(NeoPixel& ledControl)
     ledControl.set(m_pRgbPixels, m_pixelCount);
 }
 
-void MeteorAnimationBase::fadeToBlack(size_t led, uint8_t trailDecay)
-{
-    RGBData rgb = m_pRgbPixels[led];
-
-    rgb.red   = rgb.red   <= 10 ? 0 : rgb.red   - (rgb.red   * trailDecay/256);
-    rgb.green = rgb.green <= 10 ? 0 : rgb.green - (rgb.green * trailDecay/256);
-    rgb.blue  = rgb.blue  <= 10 ? 0 : rgb.blue  - (rgb.blue  * trailDecay/256);
-
-    m_pRgbPixels[led] = rgb;
-}
-
 
 
 
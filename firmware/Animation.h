@@ -17,20 +17,29 @@
 
 #include <assert.h>
 #include <mbed.h>
-#include "NeoPixel.h"
+#include "Oklab.h"
+#include "PixelSink.h"
+#include "Random.h"
+#include "TickSource.h"
 
 
-struct AnimationKeyFrame
-{
-    RGBData* pPixels;
-    int32_t  millisecondsBeforeNextFrame;
-    bool     interpolateBetweenFrames;
-};
-
 class IPixelUpdate
 {
 public:
-    virtual void updatePixels(NeoPixel& ledControl) = 0;
+    virtual void updatePixels(IPixelSink& ledControl) = 0;
+
+    // Animations whose frames are fully determined by the time can render them ahead of when they are due. Fills in
+    // the tickMilliseconds() time at which the next frame after the last one rendered should be shown or returns
+    // false if this animation can't render ahead, in which case updatePixels() should be used instead.
+    // frameMilliseconds is the spacing to use between the frames of animations that change continuously.
+    virtual bool getNextFrameTime(uint32_t frameMilliseconds, uint64_t* pFrameTime)
+    {
+        return false;
+    }
+    // Sends the frame for the time last returned from getNextFrameTime() to ledControl.
+    virtual void renderNextFrame(IPixelSink& ledControl)
+    {
+    }
 };
 
 class AnimationBase : public IPixelUpdate
@@ -40,31 +49,52 @@ public:
     void setKeyFrames(const AnimationKeyFrame* pFrames, size_t frameCount);
 
     // IPixelUpdate methods.
-    virtual void updatePixels(NeoPixel& ledControl);
+    virtual void updatePixels(IPixelSink& ledControl);
+    virtual bool getNextFrameTime(uint32_t frameMilliseconds, uint64_t* pFrameTime);
+    virtual void renderNextFrame(IPixelSink& ledControl);
 
     // Static methods used together to interpolate colour values.
     static void rgbToInterpolatableHsv(HSVData* pHsvDest, const RGBData* pRgbSrc);
+    static void rgbToInterpolatableHsv(HSVData* pHsvDest, const XRGBData* pRgbSrc);
     static void interpolateHsvToRgb(RGBData* pRgbDest, const HSVData* pHsvStart, const HSVData* pHsvStop,
                                     int32_t curr, int32_t total);
+    static void interpolateHsvToRgb(XRGBData* pRgbDest, const HSVData* pHsvStart, const HSVData* pHsvStop,
+                                    int32_t curr, int32_t total);
 protected:
     AnimationBase();
 
-    void updatePixelsNonInterpolated(NeoPixel& ledControl);
-    void updatePixelsInterpolated(NeoPixel& ledControl);
-    void convertRgbPixelsToHsv(HSVData* pHsvDest, const RGBData* pRgbSrc, size_t pixelCount);
+    void renderFrame(IPixelSink& ledControl, uint64_t frameTime);
+    void updatePixelsNonInterpolated(IPixelSink& ledControl);
+    void updatePixelsInterpolated(IPixelSink& ledControl, int32_t currTime);
+    void convertKeyFrameToHsv(HSVData* pHsvDest, const AnimationKeyFrame* pFrame, size_t pixelCount);
+    void convertKeyFrameToOklab(OklabData* pOklabDest, const AnimationKeyFrame* pFrame, size_t pixelCount);
     void interpolateBetweenKeyFrames(int32_t currTime, int32_t totalTime);
+    void interpolateOklabBetweenKeyFrames(int32_t currTime, int32_t totalTime);
+    static const PixelData* keyFramePixel(const AnimationKeyFrame* pFrame, size_t pixel);
 
     const AnimationKeyFrame* m_pStart;
     const AnimationKeyFrame* m_pEnd;
     const AnimationKeyFrame* m_pCurr;
     const AnimationKeyFrame* m_pInterpolating;
-    RGBData*                 m_pRgbPixels;
+    // Interpolated frames keep 8 extra bits per channel when built with TEMPORAL_DITHER for the driver to dither.
+    FramePixelData*          m_pRgbPixels;
     HSVData*                 m_pHsvPrev;
     HSVData*                 m_pHsvNext;
+    OklabData*               m_pOklabPrev;
+    OklabData*               m_pOklabNext;
     size_t                   m_pixelCount;
-    Timer                    m_timer;
+    // Number of pixels being interpolated. Only a single repetition of the pattern is interpolated when both ends of
+    // the interpolation are patterns of the same length.
+    size_t                   m_interpolateCount;
+    uint64_t                 m_frameStartTime;
+    // Times of the last frame rendered ahead and of the next one to be rendered ahead.
+    uint64_t                 m_lastFrameTime;
+    uint64_t                 m_nextFrameTime;
     int32_t                  m_lastRenderTime;
     bool                     m_dirty;
+    // None of the keyframes are interpolated so they can be handed to the sink as a playlist.
+    bool                     m_canPlaylist;
+    bool                     m_isPlaylistRunning;
 };
 
 template <size_t PIXEL_COUNT>
@@ -74,15 +104,18 @@ public:
     Animation()
     {
         m_pRgbPixels = m_rgbPixels;
-        m_pHsvPrev = m_hsvPrevPixels;
-        m_pHsvNext = m_hsvNextPixels;
+        m_pHsvPrev = (HSVData*)m_interpolationPixels[0];
+        m_pHsvNext = (HSVData*)m_interpolationPixels[1];
+        m_pOklabPrev = m_interpolationPixels[0];
+        m_pOklabNext = m_interpolationPixels[1];
         m_pixelCount = PIXEL_COUNT;
     }
 
 protected:
-    RGBData m_rgbPixels[PIXEL_COUNT];
-    HSVData m_hsvPrevPixels[PIXEL_COUNT];
-    HSVData m_hsvNextPixels[PIXEL_COUNT];
+    FramePixelData m_rgbPixels[PIXEL_COUNT];
+    // Keyframes are only ever interpolated in one colour space at a time so the HSV conversions of the two keyframes
+    // share the storage of their larger Oklab conversions.
+    OklabData      m_interpolationPixels[2][PIXEL_COUNT];
 };
 
 
@@ -92,8 +125,9 @@ struct TwinkleProperties
     // The twinkle should fade in and out in this number of milliseconds.
     uint32_t lifetimeMin;
     uint32_t lifetimeMax;
-    // There should be a 1 in probability milliseconds chance of a twinkle starting.
-    int      probability;
+    // Average number of twinkles started each second for every 1000 LEDs in the strand. Expressed per LED so that
+    // the twinkle density stays the same no matter how long the strand is.
+    uint32_t twinkleRate;
     // Background colour of the LEDs when not actively twinkling.
     HSVData  hsvBackground;
     // The colour of the twinkling LED should be constrained to these HSV limits.
@@ -110,9 +144,13 @@ class TwinkleAnimationBase : public IPixelUpdate
 public:
 
     void setProperties(const TwinkleProperties* pProperties);
+    void setRandomSeed(uint32_t seed)
+    {
+        m_random.setSeed(seed);
+    }
 
     // IPixelUpdate methods.
-    virtual void updatePixels(NeoPixel& ledControl);
+    virtual void updatePixels(IPixelSink& ledControl);
 
 protected:
     TwinkleAnimationBase();
@@ -121,18 +159,40 @@ protected:
     {
         uint32_t startTime;
         uint32_t lifetime;
+        // Position of this pixel within m_pTwinkleOrder.
+        uint16_t orderIndex;
         bool     isGettingBrighter;
         HSVData  hsvStart;
     };
-    void twinklePixel(RGBData* pRgbDest, const HSVData* pHsv, PixelTwinkleInfo* pInfo, uint32_t currTime);
+    // Upper limit on the number of twinkles that can be started in one millisecond tick.
+    enum { MAX_SPAWNS_PER_TICK = 8 };
+    // Upper limit on the number of missed millisecond ticks to catch up on when the main loop has been delayed.
+    enum { MAX_CATCHUP_TICKS = 10 };
+
+    void calculateSpawnDistribution();
+    void spawnTwinkles(uint32_t currTime);
+    void startTwinkle(size_t pixel, uint32_t currTime);
+    bool twinklePixel(PixelData* pRgbDest, const HSVData* pHsv, PixelTwinkleInfo* pInfo, uint32_t currTime);
+    void flushPixels(IPixelSink& ledControl);
+    void activateTwinkle(size_t pixel);
+    void deactivateTwinkle(size_t orderIndex);
+    void swapTwinkleOrder(size_t orderIndex1, size_t orderIndex2);
 
     const TwinkleProperties* m_pProperties;
-    RGBData*                 m_pRgbPixels;
+    PixelData*               m_pRgbPixels;
     HSVData*                 m_pHsvPixels;
     PixelTwinkleInfo*        m_pTwinkleInfo;
+    // Permutation of all pixel indices. The first m_activeCount entries are the pixels currently twinkling and the
+    // rest are free to start a new twinkle.
+    uint16_t*                m_pTwinkleOrder;
+    size_t                   m_activeCount;
     size_t                   m_pixelCount;
-    Timer                    m_timer;
-    int32_t                  m_lastUpdate;
+    uint64_t                 m_lastUpdate;
+    // Cumulative Poisson distribution for the number of twinkles to start in each millisecond, scaled to the 32-bit
+    // range returned by Random::next(). Entry k is the threshold below which k twinkles should be started.
+    uint32_t                 m_spawnThresholds[MAX_SPAWNS_PER_TICK];
+    Random                   m_random;
+    bool                     m_dirty;
 };
 
 template <size_t PIXEL_COUNT>
@@ -145,12 +205,14 @@ public:
         m_pRgbPixels = m_rgbPixels;
         m_pHsvPixels = m_hsvPixels;
         m_pTwinkleInfo = m_twinkleInfo;
+        m_pTwinkleOrder = m_twinkleOrder;
     }
 
 protected:
-    RGBData          m_rgbPixels[PIXEL_COUNT];
+    PixelData        m_rgbPixels[PIXEL_COUNT];
     HSVData          m_hsvPixels[PIXEL_COUNT];
     PixelTwinkleInfo m_twinkleInfo[PIXEL_COUNT];
+    uint16_t         m_twinkleOrder[PIXEL_COUNT];
 };
 
 
@@ -172,9 +234,13 @@ class FlickerAnimationBase : public IPixelUpdate
 public:
 
     void setProperties(const FlickerProperties* pProperties);
+    void setRandomSeed(uint32_t seed)
+    {
+        m_random.setSeed(seed);
+    }
 
     // IPixelUpdate methods.
-    virtual void updatePixels(NeoPixel& ledControl);
+    virtual void updatePixels(IPixelSink& ledControl);
 
 protected:
     FlickerAnimationBase();
@@ -186,15 +252,15 @@ protected:
         HSVData  hsvStart;
         HSVData  hsvStop;
     };
-    void updatePixel(RGBData* pRgbDest, const HSVData* pHsv, PixelFlickerInfo* pInfo, uint32_t currTime);
+    void updatePixel(PixelData* pRgbDest, const HSVData* pHsv, PixelFlickerInfo* pInfo, uint32_t currTime);
 
     const FlickerProperties* m_pProperties;
-    RGBData*                 m_pRgbPixels;
+    PixelData*               m_pRgbPixels;
     HSVData*                 m_pHsvPixels;
     PixelFlickerInfo*        m_pFlickerInfo;
     size_t                   m_pixelCount;
-    Timer                    m_timer;
-    int32_t                  m_lastUpdate;
+    uint64_t                 m_lastUpdate;
+    Random                   m_random;
 };
 
 template <size_t PIXEL_COUNT>
@@ -210,7 +276,7 @@ public:
     }
 
 protected:
-    RGBData          m_rgbPixels[PIXEL_COUNT];
+    PixelData        m_rgbPixels[PIXEL_COUNT];
     HSVData          m_hsvPixels[PIXEL_COUNT];
     PixelFlickerInfo m_flickerInfo[PIXEL_COUNT];
 };
@@ -225,15 +291,19 @@ public:
     void setProperties(const HSVData* pHSV, int32_t delayMilliseconds);
 
     // IPixelUpdate methods.
-    virtual void updatePixels(NeoPixel& ledControl);
+    virtual void updatePixels(IPixelSink& ledControl);
+    virtual bool getNextFrameTime(uint32_t frameMilliseconds, uint64_t* pFrameTime);
+    virtual void renderNextFrame(IPixelSink& ledControl);
 
 protected:
     RunningLightsAnimationBase();
 
-    RGBData*                 m_pRgbPixels;
+    void renderFrame(IPixelSink& ledControl);
+
+    PixelData*               m_pRgbPixels;
     size_t                   m_pixelCount;
     size_t                   m_position;
-    Timer                    m_timer;
+    uint64_t                 m_nextUpdate;
     int32_t                  m_delay;
     HSVData                  m_hsv;
 };
@@ -249,7 +319,7 @@ public:
     }
 
 protected:
-    RGBData          m_rgbPixels[PIXEL_COUNT];
+    PixelData        m_rgbPixels[PIXEL_COUNT];
 };
 
 
@@ -273,20 +343,40 @@ class MeteorAnimationBase : public IPixelUpdate
 public:
 
     void setProperties(const MeteorProperties* pProperties);
+    void setRandomSeed(uint32_t seed)
+    {
+        m_random.setSeed(seed);
+    }
+    // The meteor falls from the last entry of pOrder to the first rather than along the strand. Pass one of the
+    // sorted lists from TreeGeometry.h to have it sweep across the tree in physical space. NULL restores strand order.
+    void setPixelOrder(const uint16_t* pOrder)
+    {
+        m_pPixelOrder = pOrder;
+    }
 
     // IPixelUpdate methods.
-    virtual void updatePixels(NeoPixel& ledControl);
+    virtual void updatePixels(IPixelSink& ledControl);
+    virtual bool getNextFrameTime(uint32_t frameMilliseconds, uint64_t* pFrameTime);
+    virtual void renderNextFrame(IPixelSink& ledControl);
 
 protected:
     MeteorAnimationBase();
 
-    void fadeToBlack(size_t led, uint8_t trailDecay);
+    void renderFrame(IPixelSink& ledControl);
+
+    // Each trail pixel has a 102/256 (~4 in 10) chance of decaying on each iteration when isDecayRandom is set.
+    enum { RANDOM_DECAY_PROBABILITY = 102 };
+    // Trail channels at or below this level are turned off rather than decayed further.
+    enum { FADE_THRESHOLD = 10 };
 
     const MeteorProperties*  m_pProperties;
-    RGBData*                 m_pRgbPixels;
+    // The trail is drawn straight into the frame in strand order, following m_pPixelOrder, and faded in place.
+    PixelData*               m_pRgbPixels;
+    const uint16_t*          m_pPixelOrder;
     size_t                   m_pixelCount;
     uint32_t                 m_iteration;
-    Timer                    m_timer;
+    uint64_t                 m_nextUpdate;
+    Random                   m_random;
 };
 
 template <size_t PIXEL_COUNT>
@@ -301,13 +391,13 @@ public:
     }
 
 protected:
-    RGBData          m_rgbPixels[PIXEL_COUNT];
+    PixelData        m_rgbPixels[PIXEL_COUNT];
 };
 
 
 
 
-static inline void createRepeatingPixelPattern(RGBData* pDest, size_t destPixelCount,
+static inline void createRepeatingPixelPattern(PixelData* pDest, size_t destPixelCount,
                                                const RGBData* pPattern, size_t srcPixelCount)
 {
     assert ( srcPixelCount > 0 );
@@ -325,7 +415,7 @@ static inline void createRepeatingPixelPattern(RGBData* pDest, size_t destPixelC
     }
 }
 
-static inline void createInterpolatedPixelPattern(RGBData* pDest, size_t destPixelCount,
+static inline void createInterpolatedPixelPattern(PixelData* pDest, size_t destPixelCount,
                                                   const RGBData* pRgbStart, const RGBData* pRgbStop)
 {
     int32_t totalPixels = (int32_t)destPixelCount;
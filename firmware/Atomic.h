@@ -0,0 +1,90 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Typed C++ wrapper around the word sized operations from Interlock.h. Loads are acquires and stores are releases so
+   an Atomic<T> can be used to publish data written before the store to the other side of an interrupt or DMA transfer
+   without needing to disable interrupts. */
+#ifndef ATOMIC_H_
+#define ATOMIC_H_
+
+#include <mbed.h>
+#include "Interlock.h"
+
+
+// T can be any 32-bit integer or enum type.
+template <class T>
+class Atomic
+{
+public:
+    static_assert(sizeof(T) == sizeof(uint32_t), "Atomic<T> only supports 32-bit types.");
+
+    Atomic()
+    {
+        m_value = 0;
+    }
+    Atomic(T value)
+    {
+        m_value = (uint32_t)value;
+    }
+
+    T load() const
+    {
+        return (T)interlockedLoadAcquire(&m_value);
+    }
+    void store(T value)
+    {
+        interlockedStoreRelease(&m_value, (uint32_t)value);
+    }
+    T exchange(T value)
+    {
+        return (T)interlockedExchange((volatile int32_t*)&m_value, (int32_t)value);
+    }
+    // Stores desired only if the current value still matches *pExpected. Otherwise *pExpected is updated to the
+    // current value so that the caller can retry from there.
+    bool compareExchange(T* pExpected, T desired)
+    {
+        uint32_t expected = (uint32_t)*pExpected;
+        uint32_t actual = interlockedCompareExchange(&m_value, expected, (uint32_t)desired);
+
+        *pExpected = (T)actual;
+        return actual == expected;
+    }
+
+    // Each of these returns the value from before the operation.
+    T fetchAdd(T value)
+    {
+        return (T)(interlockedAdd((volatile int32_t*)&m_value, (int32_t)value) - (int32_t)value);
+    }
+    T fetchSubtract(T value)
+    {
+        return (T)(interlockedSubtract((volatile int32_t*)&m_value, (int32_t)value) + (int32_t)value);
+    }
+    T fetchOr(T mask)
+    {
+        return (T)interlockedFetchOr(&m_value, (uint32_t)mask);
+    }
+    T fetchAnd(T mask)
+    {
+        return (T)interlockedFetchAnd(&m_value, (uint32_t)mask);
+    }
+
+protected:
+    // Copying would just be a plain unsynchronized read.
+    Atomic(const Atomic& other);
+    Atomic& operator=(const Atomic& other);
+
+    volatile uint32_t m_value;
+};
+
+#endif // ATOMIC_H_
@@ -0,0 +1,115 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <mbed.h>
+#include <us_ticker_api.h>
+#include "Animation.h"
+#include "Benchmark.h"
+
+
+// Number of times to repeat each of the encoder benchmarks.
+#define BENCHMARK_REPEATS   100
+
+
+static void* allocateBenchmarkBuffer(const char* pName, size_t ledCount, size_t size);
+static void  benchmarkEncoder(NeoPixel& ledControl, size_t ledCount);
+static void  fillTestPixels(PixelData* pPixels, size_t pixelCount);
+static void  printResult(const char* pName, size_t ledCount, uint32_t frames, uint32_t sets, uint32_t microseconds);
+
+
+void runBenchmarks(NeoPixel& ledControl)
+{
+    printf("benchmark,leds,frames,sets,ns/frame,ns/pixel\n");
+    benchmarkEncoder(ledControl, ledControl.getLedCount());
+}
+
+static void* allocateBenchmarkBuffer(const char* pName, size_t ledCount, size_t size)
+{
+    void* pMemory = malloc(size);
+    if (!pMemory)
+    {
+        printf("# %s,%u skipped: %u bytes don't fit in memory\n", pName, ledCount, size);
+    }
+    return pMemory;
+}
+
+static void benchmarkEncoder(NeoPixel& ledControl, size_t ledCount)
+{
+    static const RGBData pattern[] = { RED, DARK_ORANGE, YELLOW, GREEN, BLUE };
+    const size_t         patternLength = sizeof(pattern) / sizeof(pattern[0]);
+
+    PixelData* pPixels = (PixelData*)allocateBenchmarkBuffer("encode_set", ledCount, ledCount * sizeof(*pPixels));
+    if (!pPixels)
+    {
+        return;
+    }
+    fillTestPixels(pPixels, ledCount);
+
+    uint32_t startTime = us_ticker_read();
+    for (uint32_t i = 0 ; i < BENCHMARK_REPEATS ; i++)
+    {
+        ledControl.set(pPixels, ledCount);
+    }
+    printResult("encode_set", ledCount, BENCHMARK_REPEATS, BENCHMARK_REPEATS, us_ticker_read() - startTime);
+
+    createRepeatingPixelPattern(pPixels, patternLength, pattern, patternLength);
+    startTime = us_ticker_read();
+    for (uint32_t i = 0 ; i < BENCHMARK_REPEATS ; i++)
+    {
+        ledControl.setPattern(pPixels, patternLength, i, ledCount);
+    }
+    printResult("encode_pattern", ledCount, BENCHMARK_REPEATS, BENCHMARK_REPEATS, us_ticker_read() - startTime);
+
+    free(pPixels);
+
+    // Encodes both roundings of every LED when the driver was created with temporal dithering enabled.
+    RGB16Data* pPixels16 = (RGB16Data*)allocateBenchmarkBuffer("encode_set16", ledCount, ledCount * sizeof(*pPixels16));
+    if (!pPixels16)
+    {
+        return;
+    }
+    for (size_t i = 0 ; i < ledCount ; i++)
+    {
+        pPixels16[i].red = i * 0x0101;
+        pPixels16[i].green = i * 0x0203;
+        pPixels16[i].blue = i * 0x0305;
+    }
+
+    startTime = us_ticker_read();
+    for (uint32_t i = 0 ; i < BENCHMARK_REPEATS ; i++)
+    {
+        ledControl.set(pPixels16, ledCount);
+    }
+    printResult("encode_set16", ledCount, BENCHMARK_REPEATS, BENCHMARK_REPEATS, us_ticker_read() - startTime);
+
+    free(pPixels16);
+}
+
+static void fillTestPixels(PixelData* pPixels, size_t pixelCount)
+{
+    // Spread the pixels around the colour wheel so that the encoder sees a mix of bit patterns.
+    for (size_t i = 0 ; i < pixelCount ; i++)
+    {
+        HSVData hsv(i * 37, 128 + (i & 0x7F), 64 + (i & 0xBF));
+        hsvToRgb(&pPixels[i], &hsv);
+    }
+}
+
+static void printResult(const char* pName, size_t ledCount, uint32_t frames, uint32_t sets, uint32_t microseconds)
+{
+    uint32_t nanosecondsPerFrame = (uint32_t)(((uint64_t)microseconds * 1000) / frames);
+    uint32_t nanosecondsPerPixel = nanosecondsPerFrame / ledCount;
+
+    printf("%s,%u,%lu,%lu,%lu,%lu\n", pName, ledCount, frames, sets, nanosecondsPerFrame, nanosecondsPerPixel);
+}
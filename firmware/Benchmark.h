@@ -0,0 +1,32 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Times the NeoPixel encoder on the target at the driver's LED count. Results are printed as CSV lines so that they
+   can be captured and compared between builds:
+       benchmark,leds,frames,sets,ns/frame,ns/pixel
+   Lines starting with # are comments, like the notes for buffers that don't fit in memory. The animation engines and
+   the Pixel.h colour conversions don't need the hardware so they are timed on the desktop instead, by running
+   "make bench" in tests/. */
+#ifndef BENCHMARK_H_
+#define BENCHMARK_H_
+
+#include <mbed.h>
+#include "NeoPixel.h"
+
+
+// Must be called before ledControl.start() so that the encoder timings don't include waiting on the DMA.
+// ledControl is only used to time the encoder at its own LED count.
+void runBenchmarks(NeoPixel& ledControl);
+
+#endif // BENCHMARK_H_
@@ -0,0 +1,196 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <assert.h>
+#include <mbed.h>
+#include "Compositor.h"
+#include "PixelMath.h"
+#include "TickSource.h"
+
+
+CompositorBase::CompositorBase()
+{
+    m_pLayers = NULL;
+    m_pOutputPixels = NULL;
+    m_pLayerPixels = NULL;
+    m_pixelCount = 0;
+    m_maxLayers = 0;
+    m_layerCount = 0;
+    m_activeLayerCount = 0;
+    m_frameBudget = 0;
+    m_budgetOverruns = 0;
+}
+
+bool CompositorBase::addLayer(IPixelUpdate* pSource, BlendMode blendMode, uint8_t alpha)
+{
+    if (m_layerCount >= m_maxLayers)
+    {
+        return false;
+    }
+
+    Layer* pLayer = &m_pLayers[m_layerCount];
+    pLayer->pSource = pSource;
+    pLayer->pPixels = m_pLayerPixels + m_layerCount * m_pixelCount;
+    pLayer->pixelCount = m_pixelCount;
+    pLayer->blendMode = blendMode;
+    // Scale alpha to 0 - 256 so that 255 is fully opaque.
+    pLayer->alpha = alpha + (alpha >> 7);
+    pLayer->isChanged = false;
+    memset(pLayer->pPixels, 0, sizeof(*pLayer->pPixels) * m_pixelCount);
+
+    m_layerCount++;
+    m_activeLayerCount = m_layerCount;
+    m_budgetOverruns = 0;
+    return true;
+}
+
+void CompositorBase::clearLayers()
+{
+    m_layerCount = 0;
+    m_activeLayerCount = 0;
+    m_budgetOverruns = 0;
+}
+
+void CompositorBase::updatePixels(IPixelSink& ledControl)
+{
+    uint64_t startTime = tickMicroseconds();
+
+    // Let each layer render into its own scratch buffer.
+    bool isChanged = false;
+    for (size_t i = 0 ; i < m_activeLayerCount ; i++)
+    {
+        Layer* pLayer = &m_pLayers[i];
+        pLayer->isChanged = false;
+        pLayer->pSource->updatePixels(*pLayer);
+        isChanged |= pLayer->isChanged;
+    }
+
+    // Skip the blend and the encode into the LED buffers when none of the layers produced a new frame this time.
+    if (!isChanged)
+    {
+        return;
+    }
+    compositeLayers();
+    checkFrameBudget((uint32_t)(tickMicroseconds() - startTime));
+
+    ledControl.set(m_pOutputPixels, m_pixelCount);
+}
+
+void CompositorBase::compositeLayers()
+{
+    // Blend all of the layers for a pixel before moving onto the next one so that each output pixel is only written
+    // once and the layer pixels are only read once.
+    const Layer* pLayersEnd = &m_pLayers[m_activeLayerCount];
+    for (size_t i = 0 ; i < m_pixelCount ; i++)
+    {
+        uint32_t pixel = 0;
+        for (const Layer* pLayer = m_pLayers ; pLayer < pLayersEnd ; pLayer++)
+        {
+            uint32_t layerPixel = pLayer->pPixels[i];
+            switch (pLayer->blendMode)
+            {
+            case Blend_Normal:
+                if (layerPixel)
+                {
+                    pixel = layerPixel;
+                }
+                break;
+            case Blend_Add:
+                pixel = pixelAddSaturate(pixel, layerPixel);
+                break;
+            case Blend_Max:
+                pixel = pixelMax(pixel, layerPixel);
+                break;
+            case Blend_Multiply:
+                pixel = pixelMultiply(pixel, layerPixel);
+                break;
+            case Blend_Alpha:
+                pixel = pixelLerp(pixel, layerPixel, pLayer->alpha);
+                break;
+            }
+        }
+        m_pOutputPixels[i].xrgb = pixel;
+    }
+}
+
+void CompositorBase::checkFrameBudget(uint32_t elapsedTime)
+{
+    if (m_frameBudget == 0 || elapsedTime <= m_frameBudget)
+    {
+        m_budgetOverruns = 0;
+        return;
+    }
+
+    // Don't react to the odd slow frame but once the layers consistently miss the budget, drop the top layer. The
+    // bottom layer is always kept.
+    if (++m_budgetOverruns >= MAX_BUDGET_OVERRUNS && m_activeLayerCount > 1)
+    {
+        m_activeLayerCount--;
+        m_budgetOverruns = 0;
+    }
+}
+
+
+
+void CompositorBase::Layer::set(const RGBData* pSrc, size_t srcPixelCount)
+{
+    assert ( srcPixelCount == pixelCount );
+    pixelsPack(pPixels, pSrc, pixelCount);
+    isChanged = true;
+}
+
+void CompositorBase::Layer::set(const XRGBData* pSrc, size_t srcPixelCount)
+{
+    assert ( srcPixelCount == pixelCount );
+    pixelsPack(pPixels, pSrc, pixelCount);
+    isChanged = true;
+}
+
+void CompositorBase::Layer::set(const RGB16Data* pSrc, size_t srcPixelCount)
+{
+    assert ( srcPixelCount == pixelCount );
+    pixelsPack(pPixels, pSrc, pixelCount);
+    isChanged = true;
+}
+
+void CompositorBase::Layer::setRange(const XRGBData* pSrc, size_t firstPixel, size_t srcPixelCount)
+{
+    assert ( firstPixel + srcPixelCount <= pixelCount );
+    pixelsPack(pPixels + firstPixel, pSrc, srcPixelCount);
+    isChanged = true;
+}
+
+void CompositorBase::Layer::setPattern(const PixelData* pPattern, size_t patternLength, size_t patternOffset,
+                                       size_t srcPixelCount)
+{
+    assert ( srcPixelCount == pixelCount );
+    assert ( patternLength > 0 );
+
+    size_t entry = (patternLength - patternOffset % patternLength) % patternLength;
+    for (size_t i = 0 ; i < pixelCount ; i++)
+    {
+        pPixels[i] = packRgb(&pPattern[entry]);
+        if (++entry >= patternLength)
+        {
+            entry = 0;
+        }
+    }
+    isChanged = true;
+}
+
+bool CompositorBase::Layer::setPlaylist(const AnimationKeyFrame* pFrames, size_t frameCount, size_t srcPixelCount)
+{
+    // Every frame needs to be blended on the CPU so the source must keep sending its frames one at a time.
+    return false;
+}
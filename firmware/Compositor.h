@@ -0,0 +1,122 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Blends the output of several IPixelUpdate animations, stacked in layers, into a single frame for the LED strip. */
+#ifndef COMPOSITOR_H_
+#define COMPOSITOR_H_
+
+#include <mbed.h>
+#include "Animation.h"
+#include "PixelSink.h"
+
+
+enum BlendMode
+{
+    // Non-black layer pixels replace the pixels below them. Black is treated as transparent.
+    Blend_Normal,
+    // Per channel saturating add.
+    Blend_Add,
+    // Per channel maximum.
+    Blend_Max,
+    // Per channel multiply where white leaves the pixels below unchanged.
+    Blend_Multiply,
+    // Fade between the pixels below and this layer by the layer's alpha.
+    Blend_Alpha
+};
+
+class CompositorBase : public IPixelUpdate
+{
+public:
+    // Layers are stacked bottom to top in the order they are added. Returns false if all of the layers are in use.
+    bool addLayer(IPixelUpdate* pSource, BlendMode blendMode, uint8_t alpha = 255);
+    void clearLayers();
+
+    // Layers are shed from the top down if updating and blending them keeps taking longer than this many
+    // microseconds. Pass in NeoPixel::getFrameMicroseconds() so that layering never slows the strip below the rate
+    // it would run at with a single animation. 0 disables the check.
+    void setFrameBudget(uint32_t microseconds)
+    {
+        m_frameBudget = microseconds;
+    }
+    // Number of layers which have been shed because they didn't fit in the frame budget.
+    size_t getShedLayerCount()
+    {
+        return m_layerCount - m_activeLayerCount;
+    }
+
+    // IPixelUpdate methods.
+    virtual void updatePixels(IPixelSink& ledControl);
+
+protected:
+    CompositorBase();
+
+    // Captures the frames sent by a layer's animation into that layer's scratch buffer as packed 0x00RRGGBB pixels.
+    class Layer : public IPixelSink
+    {
+    public:
+        // IPixelSink methods.
+        virtual void set(const RGBData* pPixels, size_t pixelCount);
+        virtual void set(const XRGBData* pPixels, size_t pixelCount);
+        virtual void set(const RGB16Data* pPixels, size_t pixelCount);
+        virtual void setRange(const XRGBData* pPixels, size_t firstPixel, size_t pixelCount);
+        virtual void setPattern(const PixelData* pPattern, size_t patternLength, size_t patternOffset,
+                                size_t pixelCount);
+        virtual bool setPlaylist(const AnimationKeyFrame* pFrames, size_t frameCount, size_t pixelCount);
+
+        IPixelUpdate* pSource;
+        uint32_t*     pPixels;
+        size_t        pixelCount;
+        BlendMode     blendMode;
+        uint32_t      alpha;
+        bool          isChanged;
+    };
+    // Number of consecutive frames which must overrun the budget before a layer is shed.
+    enum { MAX_BUDGET_OVERRUNS = 8 };
+
+    void compositeLayers();
+    void checkFrameBudget(uint32_t elapsedTime);
+
+    Layer*         m_pLayers;
+    XRGBData*      m_pOutputPixels;
+    // Scratch buffers for each of the layers, one after the other.
+    uint32_t*      m_pLayerPixels;
+    size_t         m_pixelCount;
+    size_t         m_maxLayers;
+    size_t         m_layerCount;
+    size_t         m_activeLayerCount;
+    uint32_t       m_frameBudget;
+    uint32_t       m_budgetOverruns;
+};
+
+// Each layer costs a PIXEL_COUNT scratch buffer so LAYER_COUNT should be no more than the scene actually stacks.
+template <size_t PIXEL_COUNT, size_t LAYER_COUNT>
+class Compositor : public CompositorBase
+{
+public:
+    Compositor()
+    {
+        m_pixelCount = PIXEL_COUNT;
+        m_maxLayers = LAYER_COUNT;
+        m_pLayers = m_layers;
+        m_pOutputPixels = m_outputPixels;
+        m_pLayerPixels = &m_layerPixels[0][0];
+    }
+
+protected:
+    Layer    m_layers[LAYER_COUNT];
+    XRGBData m_outputPixels[PIXEL_COUNT];
+    uint32_t m_layerPixels[LAYER_COUNT][PIXEL_COUNT];
+};
+
+#endif // COMPOSITOR_H_
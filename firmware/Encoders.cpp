@@ -14,6 +14,7 @@
 */
 /* Class used to interface with Adafruit's Rotary Encoder (https://www.adafruit.com/product/377). */
 #include "Encoders.h"
+#include "TickSource.h"
 
 
 // The signal must be in the HIGH state for this many microseconds before it will be considered a HIGH pulse.
@@ -39,13 +40,10 @@
 #define DETECTED_CCW_TRANSITIONS    (STATE_TRANSITION_CCW_FIRST | STATE_TRANSITION_CCW_LAST | STATE_TRANSITION_MIDDLE)
 
 
-static Timer g_timer;
-
 
 Encoder::EncoderSignal::EncoderSignal(PinName pin) : m_pin(pin, PullUp)
 {
-    g_timer.start();
-    uint32_t currTime = g_timer.read_us();
+    uint64_t currTime = tickMicroseconds();
 
     m_lastHighPulse.startTime = currTime;
     m_lastHighPulse.endTime = currTime;
@@ -61,8 +59,8 @@ Encoder::EncoderSignal::EncoderSignal(PinName pin) : m_pin(pin, PullUp)
 bool Encoder::EncoderSignal::sample(SignalStateQueue* pStateQueue)
 {
     int      currValue = m_pin.read();
-    uint32_t currTime = g_timer.read_us();
-    uint32_t elapsedTime = currTime - m_currPulse.startTime;
+    uint64_t currTime = tickMicroseconds();
+    uint64_t elapsedTime = currTime - m_currPulse.startTime;
 
     // Populate the state queue when we have detected the end of a clean HIGH pulse.
     // This will happen when we see the next trailing edge or the signal has been HIGH for a long time (as would
@@ -84,7 +82,7 @@ bool Encoder::EncoderSignal::sample(SignalStateQueue* pStateQueue)
     return false;
 }
 
-bool Encoder::EncoderSignal::populateStateQueue(uint32_t currTime, int currValue, SignalStateQueue* pStateQueue)
+bool Encoder::EncoderSignal::populateStateQueue(uint64_t currTime, int currValue, SignalStateQueue* pStateQueue)
 {
     bool ret = false;
 
@@ -119,13 +117,11 @@ bool Encoder::EncoderSignal::populateStateQueue(uint32_t currTime, int currValue
 Encoder::Encoder(PinName pinA, PinName pinB, PinName pinPress)
     : m_signalA(pinA), m_signalB(pinB), m_pin(pinPress, PullUp)
 {
-    g_timer.start();
-
     populateTransitionsToIncrementTable();
 
     m_lastEncoderValue = (m_signalB.read() << 1) | m_signalA.read();
     m_isPressed = !m_pin.read();
-    m_pressStartTime = g_timer.read_us();
+    m_pressStartTime = tickMicroseconds();
 
     memset(&m_queueA, 0, sizeof(m_queueA));
     memset(&m_queueB, 0, sizeof(m_queueB));
@@ -226,10 +222,10 @@ bool Encoder::sample(EncoderState* pState)
 
 bool Encoder::samplePress()
 {
-    uint32_t currTime = g_timer.read_us();
+    uint64_t currTime = tickMicroseconds();
     if (m_isPressed)
     {
-        uint32_t elapsedTime = currTime - m_pressStartTime;
+        uint64_t elapsedTime = currTime - m_pressStartTime;
         if (elapsedTime < DEBOUNCE_PRESS_TIME)
         {
             return false;
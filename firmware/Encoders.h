@@ -42,8 +42,8 @@ protected:
     public:
         struct SignalState
         {
-            uint32_t    startTime;
-            uint32_t    endTime;
+            uint64_t    startTime;
+            uint64_t    endTime;
             uint32_t    encoderValue;
             int         value;
             bool        needsProcessing;
@@ -65,7 +65,7 @@ protected:
         bool sample(SignalStateQueue* pStateQueue);
     
     protected:
-        bool populateStateQueue(uint32_t currTime, int currValue, SignalStateQueue* pStateQueue);
+        bool populateStateQueue(uint64_t currTime, int currValue, SignalStateQueue* pStateQueue);
         
         SignalState m_lastHighPulse;
         SignalState m_currPulse;
@@ -75,7 +75,7 @@ protected:
 
     int32_t                         m_transitionsToIncrementTable[32];
     uint32_t                        m_lastEncoderValue;
-    uint32_t                        m_pressStartTime;
+    uint64_t                        m_pressStartTime;
     EncoderSignal::SignalStateQueue m_queueA;
     EncoderSignal::SignalStateQueue m_queueB;
     EncoderSignal                   m_signalA;
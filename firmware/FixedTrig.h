@@ -0,0 +1,94 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Fixed point sine/cosine for wave effects since the Cortex-M3 has no FPU to make sinf() cheap.
+   Angles are 32-bit phases where 2^32 is one full revolution so that a phase accumulator wraps for free. */
+#ifndef FIXED_TRIG_H_
+#define FIXED_TRIG_H_
+
+#include <mbed.h>
+
+
+// 2^32 / (2 * PI) rounded to nearest. Multiplying an integer number of radians by this (modulo 2^32) gives its phase.
+#define PHASE_PER_RADIAN    683565276U
+#define PHASE_QUARTER_TURN  0x40000000U
+
+// Q15 samples of the first quarter of a sine wave. Entry 256 is sin(PI/2).
+extern const int16_t g_sineQuarterTable[257];
+
+
+// Returns sin(phase) in Q15 format (-32767 to 32767), linearly interpolated between table entries.
+static inline int32_t sinQ15(uint32_t phase)
+{
+    uint32_t quadrant = phase >> 30;
+    uint32_t offset = phase & (PHASE_QUARTER_TURN - 1);
+
+    // The second and fourth quadrants run back down the quarter wave table.
+    if (quadrant & 1)
+    {
+        offset = PHASE_QUARTER_TURN - offset;
+    }
+
+    uint32_t index = offset >> 22;
+    int32_t  value;
+    if (index >= 256)
+    {
+        value = g_sineQuarterTable[256];
+    }
+    else
+    {
+        int32_t  start = g_sineQuarterTable[index];
+        int32_t  stop = g_sineQuarterTable[index + 1];
+        int32_t  fraction = (offset >> 6) & 0xFFFF;
+        value = start + (((stop - start) * fraction) >> 16);
+    }
+
+    // The last two quadrants are the negative half of the wave.
+    return (quadrant & 2) ? -value : value;
+}
+
+static inline int32_t cosQ15(uint32_t phase)
+{
+    return sinQ15(phase + PHASE_QUARTER_TURN);
+}
+
+
+// Steps a phase by a fixed increment each time it is sampled.
+class PhaseAccumulator
+{
+public:
+    PhaseAccumulator(uint32_t phase = 0, uint32_t step = 0)
+    {
+        m_phase = phase;
+        m_step = step;
+    }
+
+    uint32_t next()
+    {
+        uint32_t phase = m_phase;
+        m_phase += m_step;
+        return phase;
+    }
+
+    int32_t nextSinQ15()
+    {
+        return sinQ15(next());
+    }
+
+protected:
+    uint32_t m_phase;
+    uint32_t m_step;
+};
+
+#endif // FIXED_TRIG_H_
@@ -0,0 +1,269 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <assert.h>
+#include <mbed.h>
+#include "FrameInterpolator.h"
+#include "PixelMath.h"
+#include "TickSource.h"
+
+
+FrameInterpolatorBase::FrameInterpolatorBase()
+{
+    m_pSource = NULL;
+    m_capture.pPixels = NULL;
+    m_capture.pixelCount = 0;
+    m_capture.isChanged = false;
+    m_pPrevPixels = NULL;
+    m_pNextPixels = NULL;
+    m_pOutputPixels = NULL;
+    m_pixelCount = 0;
+    m_prevTime = 0;
+    m_nextTime = 0;
+    m_outputTime = 0;
+    m_nextOutputTime = 0;
+    m_nextSourceTime = 0;
+    m_frameMilliseconds = 0;
+    m_isBlendNeeded = false;
+    m_isSendNeeded = false;
+    m_hasSourceFrame = false;
+    m_isRenderingAhead = false;
+}
+
+void FrameInterpolatorBase::setSource(IPixelUpdate* pSource, uint32_t frameMilliseconds)
+{
+    assert ( frameMilliseconds > 0 );
+
+    m_pSource = pSource;
+    m_frameMilliseconds = frameMilliseconds;
+    m_prevTime = 0;
+    m_nextTime = 0;
+    m_outputTime = 0;
+    m_isBlendNeeded = false;
+    m_isSendNeeded = false;
+    m_hasSourceFrame = false;
+    m_isRenderingAhead = false;
+    memset(m_pNextPixels, 0, sizeof(*m_pNextPixels) * m_pixelCount);
+}
+
+void FrameInterpolatorBase::updatePixels(IPixelSink& ledControl)
+{
+    uint64_t currTime = tickMilliseconds();
+
+    // The times used while rendering ahead are for frames still to come so start over from now.
+    if (m_isRenderingAhead)
+    {
+        m_nextTime = 0;
+        m_isRenderingAhead = false;
+    }
+
+    if (currTime >= m_nextTime)
+    {
+        startSourceFrame();
+        m_pSource->updatePixels(m_capture);
+        endSourceFrame();
+
+        // Schedule relative to the previous deadline so that time spent in the main loop doesn't accumulate as drift.
+        // If the loop stalled for more than a whole period then resynchronize rather than bursting to catch up.
+        uint64_t nextTime = m_nextTime + m_frameMilliseconds;
+        if (nextTime <= currTime)
+        {
+            nextTime = currTime + m_frameMilliseconds;
+        }
+        m_prevTime = currTime;
+        m_nextTime = nextTime;
+    }
+
+    sendBlend(ledControl, currTime);
+}
+
+bool FrameInterpolatorBase::getNextFrameTime(uint32_t frameMilliseconds, uint64_t* pFrameTime)
+{
+    if (!m_pSource->getNextFrameTime(m_frameMilliseconds, &m_nextSourceTime))
+    {
+        return false;
+    }
+    if (!m_isRenderingAhead)
+    {
+        m_nextOutputTime = m_nextSourceTime;
+        *pFrameTime = m_nextOutputTime;
+        return true;
+    }
+
+    // Step through the current blend at the rate given by the caller and then on into the blend towards the source's
+    // next frame. Nothing changes in between the blends so no frames are needed there.
+    uint64_t prevTime = m_prevTime;
+    uint64_t nextTime = m_nextTime;
+    if (m_outputTime >= m_nextTime)
+    {
+        prevTime = m_nextTime;
+        nextTime = m_nextSourceTime;
+    }
+    uint64_t blendStart = prevTime;
+    if (nextTime - prevTime > m_frameMilliseconds)
+    {
+        blendStart = nextTime - m_frameMilliseconds;
+    }
+    uint64_t outputTime = (m_outputTime > blendStart ? m_outputTime : blendStart) + frameMilliseconds;
+    m_nextOutputTime = outputTime < nextTime ? outputTime : nextTime;
+    *pFrameTime = m_nextOutputTime;
+    return true;
+}
+
+void FrameInterpolatorBase::renderNextFrame(IPixelSink& ledControl)
+{
+    if (!m_isRenderingAhead || m_nextOutputTime > m_nextTime)
+    {
+        // Have the source render the frame that the blend heads towards next.
+        startSourceFrame();
+        m_pSource->renderNextFrame(m_capture);
+        endSourceFrame();
+        m_prevTime = m_nextTime;
+        m_nextTime = m_nextSourceTime;
+        if (!m_isRenderingAhead)
+        {
+            // Nothing to blend from until the frame after this one.
+            memcpy(m_pPrevPixels, m_pNextPixels, sizeof(*m_pPrevPixels) * m_pixelCount);
+            m_prevTime = m_nextTime;
+            m_isBlendNeeded = false;
+            m_isRenderingAhead = true;
+        }
+    }
+
+    m_outputTime = m_nextOutputTime;
+    sendBlend(ledControl, m_outputTime);
+}
+
+void FrameInterpolatorBase::startSourceFrame()
+{
+    // The frame that the blend was heading for becomes the start of the next one. Sources which only update part of
+    // their frame with setRange() are left to update a copy of their last frame.
+    memcpy(m_pPrevPixels, m_pNextPixels, sizeof(*m_pPrevPixels) * m_pixelCount);
+    m_capture.isChanged = false;
+}
+
+void FrameInterpolatorBase::endSourceFrame()
+{
+    if (!m_hasSourceFrame)
+    {
+        // Don't fade in from black on the very first frame.
+        memcpy(m_pPrevPixels, m_pNextPixels, sizeof(*m_pPrevPixels) * m_pixelCount);
+        m_hasSourceFrame = m_capture.isChanged;
+        m_isBlendNeeded = false;
+    }
+    else
+    {
+        m_isBlendNeeded = m_capture.isChanged;
+    }
+    m_isSendNeeded |= m_capture.isChanged;
+}
+
+uint32_t FrameInterpolatorBase::blendFraction(uint64_t time)
+{
+    // Source frames further apart than m_frameMilliseconds, like the hold on a keyframe which isn't interpolated, are
+    // only blended over the last m_frameMilliseconds before the next frame.
+    uint64_t blendStart = m_prevTime;
+    if (m_nextTime - m_prevTime > m_frameMilliseconds)
+    {
+        blendStart = m_nextTime - m_frameMilliseconds;
+    }
+
+    if (time <= blendStart)
+    {
+        return 0;
+    }
+    if (time >= m_nextTime)
+    {
+        return 256;
+    }
+    return (uint32_t)(((time - blendStart) << 8) / (m_nextTime - blendStart));
+}
+
+void FrameInterpolatorBase::sendBlend(IPixelSink& ledControl, uint64_t time)
+{
+    if (!m_isSendNeeded)
+    {
+        return;
+    }
+
+    uint32_t fraction = m_isBlendNeeded ? blendFraction(time) : 256;
+    pixelsLerp(m_pOutputPixels, m_pPrevPixels, m_pNextPixels, m_pixelCount, fraction);
+    ledControl.set(m_pOutputPixels, m_pixelCount);
+
+    // Once the blend reaches the newest frame there is nothing more to send until the source changes again.
+    m_isSendNeeded = fraction < 256;
+}
+
+
+
+void FrameInterpolatorBase::Capture::set(const RGBData* pSrc, size_t srcPixelCount)
+{
+    assert ( srcPixelCount == pixelCount );
+    for (size_t i = 0 ; i < pixelCount ; i++)
+    {
+        convertPixel(&pPixels[i], &pSrc[i]);
+    }
+    isChanged = true;
+}
+
+void FrameInterpolatorBase::Capture::set(const XRGBData* pSrc, size_t srcPixelCount)
+{
+    assert ( srcPixelCount == pixelCount );
+    setRange(pSrc, 0, srcPixelCount);
+}
+
+void FrameInterpolatorBase::Capture::set(const RGB16Data* pSrc, size_t srcPixelCount)
+{
+    assert ( srcPixelCount == pixelCount );
+    for (size_t i = 0 ; i < pixelCount ; i++)
+    {
+        convertPixel(&pPixels[i], &pSrc[i]);
+    }
+    isChanged = true;
+}
+
+void FrameInterpolatorBase::Capture::setRange(const XRGBData* pSrc, size_t firstPixel, size_t srcPixelCount)
+{
+    assert ( firstPixel + srcPixelCount <= pixelCount );
+    for (size_t i = 0 ; i < srcPixelCount ; i++)
+    {
+        convertPixel(&pPixels[firstPixel + i], &pSrc[i]);
+    }
+    isChanged = true;
+}
+
+void FrameInterpolatorBase::Capture::setPattern(const PixelData* pPattern, size_t patternLength, size_t patternOffset,
+                                                size_t srcPixelCount)
+{
+    assert ( srcPixelCount == pixelCount );
+    assert ( patternLength > 0 );
+
+    size_t entry = (patternLength - patternOffset % patternLength) % patternLength;
+    for (size_t i = 0 ; i < pixelCount ; i++)
+    {
+        convertPixel(&pPixels[i], &pPattern[entry]);
+        if (++entry >= patternLength)
+        {
+            entry = 0;
+        }
+    }
+    isChanged = true;
+}
+
+bool FrameInterpolatorBase::Capture::setPlaylist(const AnimationKeyFrame* pFrames, size_t frameCount,
+                                                 size_t srcPixelCount)
+{
+    // Every frame needs to be blended on the CPU so the source must keep sending its frames one at a time.
+    return false;
+}
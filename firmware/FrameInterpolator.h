@@ -0,0 +1,109 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Runs an animation at a lower frame rate and blends linearly between its last two frames on the way out to the LEDs
+   so that fades stay smooth while the animation itself only recomputes its pixels every few frames. */
+#ifndef FRAME_INTERPOLATOR_H_
+#define FRAME_INTERPOLATOR_H_
+
+#include <mbed.h>
+#include "Animation.h"
+#include "PixelSink.h"
+
+
+class FrameInterpolatorBase : public IPixelUpdate
+{
+public:
+    // pSource is only run once every frameMilliseconds. The frames of animations which can render ahead are blended
+    // from each one to the next so the LEDs still match the animation at the time of each of its frames. Other
+    // animations are blended from their previous frame to their latest one which delays them by frameMilliseconds.
+    void setSource(IPixelUpdate* pSource, uint32_t frameMilliseconds);
+
+    // IPixelUpdate methods.
+    virtual void updatePixels(IPixelSink& ledControl);
+    virtual bool getNextFrameTime(uint32_t frameMilliseconds, uint64_t* pFrameTime);
+    virtual void renderNextFrame(IPixelSink& ledControl);
+
+protected:
+    FrameInterpolatorBase();
+
+    // Captures the frames sent by the source animation into m_pNextPixels.
+    class Capture : public IPixelSink
+    {
+    public:
+        // IPixelSink methods.
+        virtual void set(const RGBData* pPixels, size_t pixelCount);
+        virtual void set(const XRGBData* pPixels, size_t pixelCount);
+        virtual void set(const RGB16Data* pPixels, size_t pixelCount);
+        virtual void setRange(const XRGBData* pPixels, size_t firstPixel, size_t pixelCount);
+        virtual void setPattern(const PixelData* pPattern, size_t patternLength, size_t patternOffset,
+                                size_t pixelCount);
+        virtual bool setPlaylist(const AnimationKeyFrame* pFrames, size_t frameCount, size_t pixelCount);
+
+        FramePixelData* pPixels;
+        size_t          pixelCount;
+        bool            isChanged;
+    };
+
+    void     startSourceFrame();
+    void     endSourceFrame();
+    uint32_t blendFraction(uint64_t time);
+    void     sendBlend(IPixelSink& ledControl, uint64_t time);
+
+    IPixelUpdate*   m_pSource;
+    Capture         m_capture;
+    // The blend goes from m_pPrevPixels at m_prevTime to m_pNextPixels at m_nextTime. When built with
+    // TEMPORAL_DITHER the pixels are kept as RGB16Data so that the fraction of a level from both the source and the
+    // blend can be dithered by the driver.
+    FramePixelData* m_pPrevPixels;
+    FramePixelData* m_pNextPixels;
+    FramePixelData* m_pOutputPixels;
+    size_t          m_pixelCount;
+    uint64_t        m_prevTime;
+    uint64_t        m_nextTime;
+    // Times of the last blended frame rendered ahead, the next one to be rendered ahead and the source frame which
+    // follows m_pNextPixels.
+    uint64_t        m_outputTime;
+    uint64_t        m_nextOutputTime;
+    uint64_t        m_nextSourceTime;
+    uint32_t        m_frameMilliseconds;
+    // m_pPrevPixels and m_pNextPixels hold different frames.
+    bool            m_isBlendNeeded;
+    // The last frame sent out hasn't reached m_pNextPixels yet.
+    bool            m_isSendNeeded;
+    bool            m_hasSourceFrame;
+    bool            m_isRenderingAhead;
+};
+
+template <size_t PIXEL_COUNT>
+class FrameInterpolator : public FrameInterpolatorBase
+{
+public:
+    FrameInterpolator()
+    {
+        m_pixelCount = PIXEL_COUNT;
+        m_pPrevPixels = m_prevPixels;
+        m_pNextPixels = m_nextPixels;
+        m_pOutputPixels = m_outputPixels;
+        m_capture.pPixels = m_nextPixels;
+        m_capture.pixelCount = PIXEL_COUNT;
+    }
+
+protected:
+    FramePixelData m_prevPixels[PIXEL_COUNT];
+    FramePixelData m_nextPixels[PIXEL_COUNT];
+    FramePixelData m_outputPixels[PIXEL_COUNT];
+};
+
+#endif // FRAME_INTERPOLATOR_H_
@@ -17,8 +17,19 @@
 #include <stdio.h>
 #include <string.h>
 #include "GPDMA.h"
+#include "Interlock.h"
+#include "Profiler.h"
+#include "Trace.h"
 
-static uint32_t g_dmaChannelsInUse;
+// Channels are claimed and released with interlocked operations so that drivers can allocate them from interrupt
+// handlers as well as the main loop.
+static volatile uint32_t g_dmaChannelsInUse;
+
+static int claimDmaChannel(int channel)
+{
+    uint32_t mask = (1 << channel);
+    return (interlockedFetchOr(&g_dmaChannelsInUse, mask) & mask) == 0;
+}
 
 int allocateDmaChannel(DmaDesiredChannel desiredChannel)
 {
@@ -27,10 +38,8 @@ int allocateDmaChannel(DmaDesiredChannel desiredChannel)
     case GPDMA_CHANNEL_HIGH:
         for (int i = GPDMA_CHANNEL_HIGHEST ; i <= GPDMA_CHANNEL_LOWEST ; i++)
         {
-            uint32_t mask = (1 << i);
-            if ((mask & g_dmaChannelsInUse) == 0)
+            if (claimDmaChannel(i))
             {
-                g_dmaChannelsInUse |= mask;
                 return i;
             }
         }
@@ -39,16 +48,14 @@ int allocateDmaChannel(DmaDesiredChannel desiredChannel)
         // Reserve GPDMA_CHANNEL_LOWEST for memory to memory operations.
         for (int i = GPDMA_CHANNEL_LOWEST - 1; i >= GPDMA_CHANNEL_HIGHEST ; i--)
         {
-            uint32_t mask = (1 << i);
-            if ((mask & g_dmaChannelsInUse) == 0)
+            if (claimDmaChannel(i))
             {
-                g_dmaChannelsInUse |= mask;
                 return i;
             }
         }
         return -1;
     default:
-        if (((1 << desiredChannel) & g_dmaChannelsInUse) == 0)
+        if (claimDmaChannel(desiredChannel))
         {
             return desiredChannel;
         }
@@ -61,7 +68,7 @@ void freeDmaChannel(int channel)
 {
     if (channel >= GPDMA_CHANNEL_HIGHEST && channel <= GPDMA_CHANNEL_LOWEST)
     {
-        g_dmaChannelsInUse &= ~(1 << channel);
+        interlockedFetchAnd(&g_dmaChannelsInUse, ~(1 << channel));
     }
 }
 
@@ -96,6 +103,7 @@ static DmaInterruptHandler* g_pDmaHandlers = NULL;
 
 void DMA_IRQHandler(void)
 {
+    PROFILE_BEGIN(DMA_IRQHandler);
     uint32_t dmaInterruptStatus = LPC_GPDMA->DMACIntStat;
     DmaInterruptHandler* pCurr = g_pDmaHandlers;
     DmaInterruptHandler* pNext = NULL;
@@ -109,6 +117,7 @@ void DMA_IRQHandler(void)
 
         pCurr = pNext;
     }
+    PROFILE_END(DMA_IRQHandler);
 }
 
 int addDmaInterruptHandler(DmaInterruptHandler* pHandler)
@@ -173,14 +182,15 @@ int dmaMemCopy(void* pDest, const void* pSrc, size_t size, const DmaMemCopyCallb
     if (!g_pMemCopyCallback)
     {
         // Kick off the DMA transfer to perform the copy since the DMA channel is free.
+        TRACE(TRACE_MEMCOPY_START, size);
         g_pMemCopyCallback = pCallback;
         uint32_t memcopyChannelMask = 1 << g_channelMemCopy;
 
         LPC_GPDMA->DMACIntTCClear = memcopyChannelMask;
         LPC_GPDMA->DMACIntErrClr  = memcopyChannelMask;
 
-        g_pChannelMemCopy->DMACCSrcAddr  = (uint32_t)pSrc;
-        g_pChannelMemCopy->DMACCDestAddr = (uint32_t)pDest;
+        g_pChannelMemCopy->DMACCSrcAddr  = dmaAddress(pSrc);
+        g_pChannelMemCopy->DMACCDestAddr = dmaAddress(pDest);
         g_pChannelMemCopy->DMACCLLI      = 0;
         g_pChannelMemCopy->DMACCControl  = DMACCxCONTROL_I | DMACCxCONTROL_SI | DMACCxCONTROL_DI |
                          (DMACCxCONTROL_WIDTH_WORD << DMACCxCONTROL_SWIDTH_SHIFT) |
@@ -200,6 +210,7 @@ int dmaMemCopy(void* pDest, const void* pSrc, size_t size, const DmaMemCopyCallb
     else
     {
         // DMA channel wasn't free so use CPU to perform the copy.
+        TRACE(TRACE_MEMCOPY_FALLBACK, size);
         memcpy(pDest, pSrc, size);
         pCallback->handler(pCallback->pContext);
         return 0;
@@ -233,6 +244,7 @@ uint32_t dmaMemCopyInterruptHandler(void* pContext, uint32_t dmaInterruptStatus)
     }
 
     // Callback into the client application to let them know that the memcpy has completed.
+    TRACE(TRACE_MEMCOPY_DONE, 0);
     assert ( g_pMemCopyCallback );
     g_pMemCopyCallback->handler(g_pMemCopyCallback->pContext);
     g_pMemCopyCallback = NULL;
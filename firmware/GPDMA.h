@@ -103,6 +103,13 @@ typedef struct DmaMemCopyCallback
 } DmaMemCopyCallback;
 
 
+// The DMA registers hold 32-bit addresses. Going through uintptr_t lets the same code build for a 64-bit desktop
+// machine, where the tests only ever compare the truncated addresses.
+static __INLINE uint32_t dmaAddress(const volatile void* p)
+{
+    return (uint32_t)(uintptr_t)p;
+}
+
 static __INLINE void enableGpdmaPower(void)
 {
     LPC_SC->PCONP |= (1 << 29);
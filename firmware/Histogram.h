@@ -0,0 +1,98 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Fixed size histogram with power of 2 bucket boundaries. Recording a value is just a count leading zeros and a few
+   adds so it is cheap enough to use from interrupt handlers. Bucket 0 counts values of 0 and bucket i counts the values
+   from 2^(i-1) to 2^i - 1. The last bucket also counts everything larger. */
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+#include <mbed.h>
+
+
+class Histogram
+{
+public:
+    enum { BUCKET_COUNT = 16 };
+
+    Histogram()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        memset(m_buckets, 0, sizeof(m_buckets));
+        m_count = 0;
+        m_min = 0xFFFFFFFF;
+        m_max = 0;
+        m_total = 0;
+    }
+
+    void record(uint32_t value)
+    {
+        uint32_t bucket = 32 - __CLZ(value);
+        if (bucket >= BUCKET_COUNT)
+        {
+            bucket = BUCKET_COUNT - 1;
+        }
+        m_buckets[bucket]++;
+
+        m_count++;
+        m_total += value;
+        if (value < m_min)
+        {
+            m_min = value;
+        }
+        if (value > m_max)
+        {
+            m_max = value;
+        }
+    }
+
+    uint32_t getBucket(uint32_t bucket) const
+    {
+        return m_buckets[bucket];
+    }
+    // Smallest value that is counted in the given bucket.
+    static uint32_t getBucketStart(uint32_t bucket)
+    {
+        return bucket ? 1 << (bucket - 1) : 0;
+    }
+    uint32_t getCount() const
+    {
+        return m_count;
+    }
+    uint32_t getMin() const
+    {
+        return m_count ? m_min : 0;
+    }
+    uint32_t getMax() const
+    {
+        return m_max;
+    }
+    uint32_t getMean() const
+    {
+        return m_count ? (uint32_t)(m_total / m_count) : 0;
+    }
+
+protected:
+    uint32_t m_buckets[BUCKET_COUNT];
+    uint32_t m_count;
+    uint32_t m_min;
+    uint32_t m_max;
+    uint64_t m_total;
+};
+
+#endif // HISTOGRAM_H_
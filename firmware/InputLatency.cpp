@@ -0,0 +1,82 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <assert.h>
+#include "InputLatency.h"
+
+
+InputLatency::InputLatency()
+{
+    for (uint32_t i = 0 ; i < MAX_INPUTS ; i++)
+    {
+        m_pending[i].ticker = 0;
+        m_pending[i].frameId = 0;
+    }
+    m_pendingMask = 0;
+}
+
+void InputLatency::inputSeen(uint32_t input, uint32_t ticker, uint32_t nextFrameId)
+{
+    assert ( input < MAX_INPUTS );
+
+    uint32_t inputMask = 1 << input;
+    if (m_pendingMask & inputMask)
+    {
+        return;
+    }
+
+    // Fill in the entry before marking the input as pending so that the interrupt handler never sees a partial one.
+    m_pending[input].ticker = ticker;
+    m_pending[input].frameId = nextFrameId;
+    __disable_irq();
+    {
+        m_pendingMask |= inputMask;
+    }
+    __enable_irq();
+}
+
+void InputLatency::frameSent(uint32_t frameId, uint32_t ticker)
+{
+    // Nothing to do on most flips.
+    uint32_t pendingMask = m_pendingMask;
+    while (pendingMask)
+    {
+        uint32_t      input = __CLZ(__RBIT(pendingMask));
+        PendingInput* pPending = &m_pending[input];
+
+        // Frames can be dropped so any frame at least as new as the one rendered after the input will do. Compare
+        // the difference so that the ids can wrap around.
+        if ((int32_t)(frameId - pPending->frameId) >= 0)
+        {
+            m_latency[input].record(ticker - pPending->ticker);
+            m_pendingMask &= ~(1 << input);
+        }
+        pendingMask &= pendingMask - 1;
+    }
+}
+
+void InputLatency::getLatency(uint32_t input, Histogram* pLatency, bool clearLatency)
+{
+    assert ( input < MAX_INPUTS );
+
+    __disable_irq();
+    {
+        *pLatency = m_latency[input];
+        if (clearLatency)
+        {
+            m_latency[input].clear();
+        }
+    }
+    __enable_irq();
+}
@@ -0,0 +1,57 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Measures input to photon latency: the time from an input, like an encoder being turned, until the first frame that
+   was rendered after that input has been completely sent out to the LEDs. A histogram of the latencies is kept for
+   each input. Register it with NeoPixel::setFrameObserver() to have the driver report when frames are sent. */
+#ifndef INPUT_LATENCY_H_
+#define INPUT_LATENCY_H_
+
+#include <mbed.h>
+#include "Histogram.h"
+#include "NeoPixel.h"
+
+
+class InputLatency : public IFrameObserver
+{
+public:
+    enum { MAX_INPUTS = 4 };
+
+    InputLatency();
+
+    // Call when input has been seen, before acting on it. ticker is the us_ticker time of the input and nextFrameId
+    // is the value returned from NeoPixel::getNextFrameId(). Further input seen before that frame has been sent is
+    // ignored so that the latency is always measured from the oldest input still waiting to be shown.
+    void inputSeen(uint32_t input, uint32_t ticker, uint32_t nextFrameId);
+    // Takes a consistent copy of the latency histogram for an input, optionally clearing it to start a new
+    // measurement interval.
+    void getLatency(uint32_t input, Histogram* pLatency, bool clearLatency = false);
+
+    // IFrameObserver methods.
+    virtual void frameSent(uint32_t frameId, uint32_t ticker);
+
+protected:
+    struct PendingInput
+    {
+        uint32_t ticker;
+        uint32_t frameId;
+    };
+
+    PendingInput      m_pending[MAX_INPUTS];
+    Histogram         m_latency[MAX_INPUTS];
+    // Bit i is set while input i is waiting for its frame to be sent.
+    volatile uint32_t m_pendingMask;
+};
+
+#endif // INPUT_LATENCY_H_
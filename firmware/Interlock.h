@@ -23,11 +23,24 @@ extern "C"
 {
 #endif
 
+/* Increment, decrement, add and subtract return the new value. The rest return the value from before the operation. */
 uint32_t interlockedIncrement(volatile uint32_t* pValue);
 uint32_t interlockedDecrement(volatile uint32_t* pValue);
 int32_t  interlockedAdd(volatile int32_t* pVal1, int32_t val2);
 int32_t  interlockedSubtract(volatile int32_t* pVal1, int32_t val2);
 int32_t  interlockedExchange(volatile int32_t* pValue, int32_t newValue);
+/* Only stores newValue if *pValue still equals compareValue. Check the returned value against compareValue to tell if
+   the store happened. */
+uint32_t interlockedCompareExchange(volatile uint32_t* pValue, uint32_t compareValue, uint32_t newValue);
+uint32_t interlockedFetchOr(volatile uint32_t* pValue, uint32_t mask);
+uint32_t interlockedFetchAnd(volatile uint32_t* pValue, uint32_t mask);
+
+/* Plain loads and stores of aligned words are already atomic. These add the barriers needed so that memory accesses
+   made before a release store are seen by any other thread, interrupt handler or DMA channel which then sees the
+   stored value through an acquire load. */
+uint32_t interlockedLoadAcquire(const volatile uint32_t* pValue);
+void     interlockedStoreRelease(volatile uint32_t* pValue, uint32_t newValue);
+void     interlockedMemoryBarrier(void);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,79 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Implementation of the interlocked operations from Interlock.h for building the lock-free code on a desktop machine,
+   using the GCC __atomic builtins. Firmware builds use Interlock_armv7m.S instead. */
+#ifndef __arm__
+
+#include "Interlock.h"
+
+
+uint32_t interlockedIncrement(volatile uint32_t* pValue)
+{
+    return __atomic_add_fetch(pValue, 1, __ATOMIC_SEQ_CST);
+}
+
+uint32_t interlockedDecrement(volatile uint32_t* pValue)
+{
+    return __atomic_sub_fetch(pValue, 1, __ATOMIC_SEQ_CST);
+}
+
+int32_t interlockedAdd(volatile int32_t* pVal1, int32_t val2)
+{
+    return __atomic_add_fetch(pVal1, val2, __ATOMIC_SEQ_CST);
+}
+
+int32_t interlockedSubtract(volatile int32_t* pVal1, int32_t val2)
+{
+    return __atomic_sub_fetch(pVal1, val2, __ATOMIC_SEQ_CST);
+}
+
+int32_t interlockedExchange(volatile int32_t* pValue, int32_t newValue)
+{
+    return __atomic_exchange_n(pValue, newValue, __ATOMIC_SEQ_CST);
+}
+
+uint32_t interlockedCompareExchange(volatile uint32_t* pValue, uint32_t compareValue, uint32_t newValue)
+{
+    // Leaves the current value in compareValue when the exchange fails.
+    __atomic_compare_exchange_n(pValue, &compareValue, newValue, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return compareValue;
+}
+
+uint32_t interlockedFetchOr(volatile uint32_t* pValue, uint32_t mask)
+{
+    return __atomic_fetch_or(pValue, mask, __ATOMIC_SEQ_CST);
+}
+
+uint32_t interlockedFetchAnd(volatile uint32_t* pValue, uint32_t mask)
+{
+    return __atomic_fetch_and(pValue, mask, __ATOMIC_SEQ_CST);
+}
+
+uint32_t interlockedLoadAcquire(const volatile uint32_t* pValue)
+{
+    return __atomic_load_n(pValue, __ATOMIC_ACQUIRE);
+}
+
+void interlockedStoreRelease(volatile uint32_t* pValue, uint32_t newValue)
+{
+    __atomic_store_n(pValue, newValue, __ATOMIC_RELEASE);
+}
+
+void interlockedMemoryBarrier(void)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+#endif // __arm__
@@ -0,0 +1,49 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Keyframes describe the frames of an animation. They live in their own header so that pixel sinks, like NeoPixel,
+   can be handed a whole sequence of keyframes to play back without depending on the animation classes. */
+#ifndef KEY_FRAME_H_
+#define KEY_FRAME_H_
+
+#include <mbed.h>
+#include "Pixel.h"
+
+
+// Colour space that interpolateBetweenFrames blends through.
+enum InterpolationSpace
+{
+    // Hue, saturation and an exponential brightness curve. Blends between different hues sweep through the colour
+    // wheel, always in the same direction.
+    Interpolate_Hsv = 0,
+    // Perceptually even steps along the straight line between the two colours.
+    Interpolate_Oklab
+};
+
+struct AnimationKeyFrame
+{
+    // Set pPixels to a full frame with a colour for every LED or set it to NULL and use the pattern fields below.
+    PixelData*       pPixels;
+    int32_t          millisecondsBeforeNextFrame;
+    bool             interpolateBetweenFrames;
+    // Short pattern which is repeated along the whole strand, shifted along it by patternOffset pixels. Chases only
+    // need to change the offset from frame to frame so no frame takes more memory than its pattern.
+    const PixelData* pPattern;
+    uint16_t         patternLength;
+    uint16_t         patternOffset;
+    // InterpolationSpace to blend from this frame to the next. Left as 0 (Interpolate_Hsv) when not given.
+    uint8_t          interpolationSpace;
+};
+
+#endif // KEY_FRAME_H_
@@ -14,8 +14,11 @@
 */
 #include <assert.h>
 #include <mbed.h>
+#include <us_ticker_api.h>
 #include "GPDMA.h"
 #include "NeoPixel.h"
+#include "Profiler.h"
+#include "Trace.h"
 
 
 // This class utilizes DMA based SPI hardware to send data to NeoPixel LEDs.
@@ -25,8 +28,12 @@
 #endif
 
 
+static inline uint8_t ditherChannel(uint32_t channel, uint32_t threshold);
 
-NeoPixel::NeoPixel(uint32_t ledCount, PinName outputPin) : SPI(outputPin, NC, NC)
+
+NeoPixel::NeoPixel(uint32_t ledCount, PinName outputPin, uint32_t maxPlaylistFrames, uint32_t frameQueueDepth,
+                   bool temporalDither) :
+    SPI(outputPin, NC, NC), m_frameQueue(frameQueueDepth)
 {
     // Each NeoPixel data-bit should be 1.2 usec so use 12 SPI bits when running SPI at 10MHz.
     const uint32_t spiBitsPerNeoPixelBit = 12;
@@ -39,24 +46,90 @@ NeoPixel::NeoPixel(uint32_t ledCount, PinName outputPin) : SPI(outputPin, NC, NC
     frequency(10000000);
 
     m_flipCount = 0;
+    m_setCount = 0;
     m_isStarted = false;
+    m_isPlaylistActive = false;
+    m_isQueueingFrame = false;
+    m_isTemporalDither = temporalDither;
+    m_isEncodeDithered = false;
+    m_isLastFrameDithered = false;
+    m_pDitherSource = NULL;
     m_ledCount = ledCount;
-    m_backBufferState = BackBufferFree;
+    m_isFrontBufferCopyActive = false;
     m_backBufferId = 0;
     m_frontBufferIds[0] = 0;
-    m_frontBufferIds[0] = 0;
+    m_frontBufferIds[1] = 0;
+    m_shownBufferId = 0;
+    m_frontBufferTickers[0] = 0;
+    m_frontBufferTickers[1] = 0;
+    m_lastFlipTicker = 0;
+    m_frameStats.droppedFrames = 0;
 
     // Round up byte count.
     uint32_t ledBits = ledCount * bitsPerPixel * spiBitsPerNeoPixelBit;
     // The byte count dedicated to LED output data should be an even multiple of 3 bytes.
     assert ( (ledBits % 8) == 0 );
     m_ledBytes = ledBits / 8;
+    m_bytesPerLed = bitsPerPixel * spiBitsPerNeoPixelBit / 8;
+    m_pRemap = NULL;
+    m_pFrameObserver = NULL;
     m_packetSize = m_ledBytes + (resetBits + 7) / 8;
+    // The second encoding of a dithered frame directly follows the first in the same buffer.
+    m_encodeBufferSize = temporalDither ? 2 * m_packetSize : m_packetSize;
 
     // Place buffers used by DMA code in separate RAM bank to optimize performance.
     m_pFrontBuffers[0] = (uint8_t*)dmaHeap0Alloc(m_packetSize);
     m_pFrontBuffers[1] = (uint8_t*)dmaHeap1Alloc(m_packetSize);
-    m_pBackBuffer = (uint8_t*)malloc(m_packetSize);
+    for (uint32_t i = 0 ; i < TripleBuffer::BUFFER_COUNT ; i++)
+    {
+        m_pBackBuffers[i] = (uint8_t*)malloc(m_encodeBufferSize);
+        m_backBufferIds[i] = 0;
+        m_backBufferDitherOffsets[i] = 0;
+        m_backBufferTickers[i] = 0;
+    }
+    m_pEncodeBuffer = m_pBackBuffers[m_backBuffers.getWriteIndex()];
+    m_pLastFrame = m_pEncodeBuffer;
+
+    // Spread the playlist frames across both DMA RAM banks as well.
+    m_maxPlaylistFrames = maxPlaylistFrames;
+    m_playlistFrameCount = 0;
+    m_playlistIndex = 0;
+    m_ppPlaylistBuffers = (uint8_t**)malloc(maxPlaylistFrames * sizeof(*m_ppPlaylistBuffers));
+    m_pPlaylistMilliseconds = (uint32_t*)malloc(maxPlaylistFrames * sizeof(*m_pPlaylistMilliseconds));
+    for (uint32_t i = 0 ; i < maxPlaylistFrames ; i++)
+    {
+        if (i & 1)
+        {
+            m_ppPlaylistBuffers[i] = (uint8_t*)dmaHeap1Alloc(m_packetSize);
+        }
+        else
+        {
+            m_ppPlaylistBuffers[i] = (uint8_t*)dmaHeap0Alloc(m_packetSize);
+        }
+    }
+
+    // The queued frames are only ever copied from, like the back buffers, but there is more room left in the DMA heaps.
+    m_queueReadCount = 0;
+    m_queueHeldCount = 0;
+    m_queuePresentTicker = 0;
+    m_ppQueueBuffers = (uint8_t**)malloc(frameQueueDepth * sizeof(*m_ppQueueBuffers));
+    m_pQueueTickers = (uint32_t*)malloc(frameQueueDepth * sizeof(*m_pQueueTickers));
+    m_pQueueIds = (uint32_t*)malloc(frameQueueDepth * sizeof(*m_pQueueIds));
+    m_pQueueDitherOffsets = (uint32_t*)malloc(frameQueueDepth * sizeof(*m_pQueueDitherOffsets));
+    for (uint32_t i = 0 ; i < frameQueueDepth ; i++)
+    {
+        if (i & 1)
+        {
+            m_ppQueueBuffers[i] = (uint8_t*)dmaHeap1Alloc(m_encodeBufferSize);
+        }
+        else
+        {
+            m_ppQueueBuffers[i] = (uint8_t*)dmaHeap0Alloc(m_encodeBufferSize);
+        }
+        m_pQueueTickers[i] = 0;
+        m_pQueueIds[i] = 0;
+        m_pQueueDitherOffsets[i] = 0;
+    }
 
     setConstantBitsInBuffers();
 
@@ -76,9 +149,23 @@ NeoPixel::NeoPixel(uint32_t ledCount, PinName outputPin) : SPI(outputPin, NC, NC
 
 void NeoPixel::setConstantBitsInBuffers()
 {
-    setConstantBitsInBuffer(m_pBackBuffer);
-    memcpy(m_pFrontBuffers[0], m_pBackBuffer, m_packetSize);
-    memcpy(m_pFrontBuffers[1], m_pBackBuffer, m_packetSize);
+    setConstantBitsInBuffer(m_pBackBuffers[0]);
+    if (m_isTemporalDither)
+    {
+        setConstantBitsInBuffer(m_pBackBuffers[0] + m_packetSize);
+    }
+    memcpy(m_pBackBuffers[1], m_pBackBuffers[0], m_encodeBufferSize);
+    memcpy(m_pBackBuffers[2], m_pBackBuffers[0], m_encodeBufferSize);
+    memcpy(m_pFrontBuffers[0], m_pBackBuffers[0], m_packetSize);
+    memcpy(m_pFrontBuffers[1], m_pBackBuffers[0], m_packetSize);
+    for (uint32_t i = 0 ; i < m_maxPlaylistFrames ; i++)
+    {
+        memcpy(m_ppPlaylistBuffers[i], m_pBackBuffers[0], m_packetSize);
+    }
+    for (uint32_t i = 0 ; i < m_frameQueue.getCapacity() ; i++)
+    {
+        memcpy(m_ppQueueBuffers[i], m_pBackBuffers[0], m_encodeBufferSize);
+    }
 }
 
 void NeoPixel::setConstantBitsInBuffer(uint8_t* pBuffer)
@@ -107,6 +194,7 @@ void NeoPixel::setConstantBitsInBuffer(uint8_t* pBuffer)
 
 NeoPixel::~NeoPixel()
 {
+    m_playlistTimeout.detach();
     if (m_isStarted)
     {
         freeDmaChannel(m_channelTx);
@@ -133,17 +221,17 @@ void NeoPixel::start()
     LPC_GPDMA->DMACIntErrClr  = channelMask;
 
     // Prepare transmit channel DMA circular linked list to use 2 front buffers.
-    m_dmaListItems[0].DMACCxSrcAddr  = (uint32_t)m_pFrontBuffers[0];
-    m_dmaListItems[0].DMACCxDestAddr = (uint32_t)&_spi.spi->DR;
-    m_dmaListItems[0].DMACCxLLI      = (uint32_t)&m_dmaListItems[1];
+    m_dmaListItems[0].DMACCxSrcAddr  = dmaAddress(m_pFrontBuffers[0]);
+    m_dmaListItems[0].DMACCxDestAddr = dmaAddress(&_spi.spi->DR);
+    m_dmaListItems[0].DMACCxLLI      = dmaAddress(&m_dmaListItems[1]);
     m_dmaListItems[0].DMACCxControl  = DMACCxCONTROL_I | DMACCxCONTROL_SI |
                      (DMACCxCONTROL_BURSTSIZE_4 << DMACCxCONTROL_SBSIZE_SHIFT) |
                      (DMACCxCONTROL_BURSTSIZE_4 << DMACCxCONTROL_DBSIZE_SHIFT) |
                      (m_packetSize & DMACCxCONTROL_TRANSFER_SIZE_MASK);
 
-    m_dmaListItems[1].DMACCxSrcAddr  = (uint32_t)m_pFrontBuffers[1];
-    m_dmaListItems[1].DMACCxDestAddr = (uint32_t)&_spi.spi->DR;
-    m_dmaListItems[1].DMACCxLLI      = (uint32_t)&m_dmaListItems[0];
+    m_dmaListItems[1].DMACCxSrcAddr  = dmaAddress(m_pFrontBuffers[1]);
+    m_dmaListItems[1].DMACCxDestAddr = dmaAddress(&_spi.spi->DR);
+    m_dmaListItems[1].DMACCxLLI      = dmaAddress(&m_dmaListItems[0]);
     m_dmaListItems[1].DMACCxControl  = DMACCxCONTROL_I | DMACCxCONTROL_SI |
                      (DMACCxCONTROL_BURSTSIZE_4 << DMACCxCONTROL_SBSIZE_SHIFT) |
                      (DMACCxCONTROL_BURSTSIZE_4 << DMACCxCONTROL_DBSIZE_SHIFT) |
@@ -169,39 +257,413 @@ void NeoPixel::start()
 
 void NeoPixel::set(const RGBData* pPixels, size_t pixelCount)
 {
+    PROFILE_SCOPE(NeoPixel_setRGB);
+    assert ( pixelCount == m_ledCount );
+
+    startBackBufferUpdate(0);
+    emitPixels(pPixels, 0, m_ledCount);
+    commitBackBuffer();
+}
+
+void NeoPixel::set(const XRGBData* pPixels, size_t pixelCount)
+{
+    PROFILE_SCOPE(NeoPixel_setXRGB);
     assert ( pixelCount == m_ledCount );
 
-    waitForFreeBackBuffer();
+    startBackBufferUpdate(0);
+    emitPixels(pPixels, 0, m_ledCount);
+    commitBackBuffer();
+}
 
-    // Emit bits into the now free back buffer.
-    m_pEmitBuffer = m_pBackBuffer;
-    for (uint32_t i = 0 ; i < m_ledCount ; i++)
+void NeoPixel::set(const RGB16Data* pPixels, size_t pixelCount)
+{
+    PROFILE_SCOPE(NeoPixel_setRGB16);
+    assert ( pixelCount == m_ledCount );
+
+    startBackBufferUpdate(0);
+    if (m_isTemporalDither)
+    {
+        emitDitheredPixels(pPixels);
+        m_isEncodeDithered = true;
+    }
+    else
+    {
+        emitPixels(pPixels, 0, m_ledCount);
+    }
+    commitBackBuffer();
+}
+
+void NeoPixel::setRange(const XRGBData* pPixels, size_t firstPixel, size_t pixelCount)
+{
+    PROFILE_SCOPE(NeoPixel_setRange);
+    assert ( firstPixel + pixelCount <= m_ledCount );
+
+    // The back buffer handed out by m_backBuffers, or the next slot in the frame queue, normally holds an older frame
+    // so bring it up to date with the last one committed and then just the LEDs in this range need to be encoded again.
+    // Both encodings are carried over from a dithered frame and the LEDs in the range are the same in each.
+    startBackBufferUpdate(firstPixel);
+    if (m_pEncodeBuffer != m_pLastFrame)
     {
-        RGBData led = *pPixels++;
+        memcpy(m_pEncodeBuffer, m_pLastFrame, m_isLastFrameDithered ? m_packetSize + m_ledBytes : m_ledBytes);
+    }
+    emitPixels(pPixels, firstPixel, pixelCount);
+    if (m_isLastFrameDithered)
+    {
+        copyRangeToDitherVariant(firstPixel, pixelCount);
+        m_isEncodeDithered = true;
+    }
+    commitBackBuffer();
+}
 
-        emitByte(led.red);
-        emitByte(led.green);
-        emitByte(led.blue);
+void NeoPixel::emitDitheredPixels(const RGB16Data* pPixels)
+{
+    // Each channel is encoded as one of the two levels on either side of it in each encoding. Fractions under 1/4 of
+    // a level round down in both, those over 3/4 round up in both and the ones in between round up in just one so
+    // that the LEDs show the halfway point. Neighbouring LEDs round up in opposite encodings so that the strand as a
+    // whole doesn't pulse in brightness as the front buffers take turns.
+    for (size_t i = 0 ; i < m_ledCount ; i++)
+    {
+        uint32_t threshold = (i & 1) ? 0xC0 : 0x40;
+        moveEmitBufferToPixel(i);
+        uint8_t* pEmit = m_pEmitBuffer;
+
+        emitByte(ditherChannel(pPixels->red, threshold));
+        emitByte(ditherChannel(pPixels->green, threshold));
+        emitByte(ditherChannel(pPixels->blue, threshold));
+
+        threshold = 0x100 - threshold;
+        m_pEmitBuffer = pEmit + m_packetSize;
+        emitByte(ditherChannel(pPixels->red, threshold));
+        emitByte(ditherChannel(pPixels->green, threshold));
+        emitByte(ditherChannel(pPixels->blue, threshold));
+
+        m_pEmitBuffer = pEmit + m_bytesPerLed;
+        pPixels++;
     }
+}
 
-    // Let the DMA interrupt handler know that the back buffer is now ready to be copied into the next free
-    // front buffer.
-    m_backBufferId++;
-    m_backBufferState = BackBufferReadyToCopy;
+static inline uint8_t ditherChannel(uint32_t channel, uint32_t threshold)
+{
+    uint32_t level = (channel + 0x100 - threshold) >> 8;
+    return level > 255 ? 255 : level;
+}
+
+void NeoPixel::copyRangeToDitherVariant(size_t firstPixel, size_t pixelCount)
+{
+    uint8_t* pDitherVariant = m_pEncodeBuffer + m_packetSize;
+
+    if (m_pRemap)
+    {
+        for (size_t i = firstPixel ; i < firstPixel + pixelCount ; i++)
+        {
+            uint32_t offset = m_pRemap[i] * m_bytesPerLed;
+            memcpy(pDitherVariant + offset, m_pEncodeBuffer + offset, m_bytesPerLed);
+        }
+    }
+    else
+    {
+        uint32_t offset = firstPixel * m_bytesPerLed;
+        memcpy(pDitherVariant + offset, m_pEncodeBuffer + offset, pixelCount * m_bytesPerLed);
+    }
+}
+
+void NeoPixel::setPattern(const PixelData* pPattern, size_t patternLength, size_t patternOffset, size_t pixelCount)
+{
+    PROFILE_SCOPE(NeoPixel_setPattern);
+    assert ( pixelCount == m_ledCount );
+    assert ( patternLength > 0 );
+
+    startBackBufferUpdate(0);
+    emitPattern(pPattern, patternLength, patternOffset);
+    commitBackBuffer();
+}
+
+void NeoPixel::emitPattern(const PixelData* pPattern, size_t patternLength, size_t patternOffset)
+{
+    if (patternLength > m_ledCount)
+    {
+        patternLength = m_ledCount;
+    }
+
+    // Encode just the first repetition of the pattern.
+    size_t entry = (patternLength - patternOffset % patternLength) % patternLength;
+    for (uint32_t i = 0 ; i < patternLength ; i++)
+    {
+        moveEmitBufferToPixel(i);
+        emitPixel(&pPattern[entry]);
+        if (++entry >= patternLength)
+        {
+            entry = 0;
+        }
+    }
+
+    // The rest of the strand is made up of copies of those already encoded LEDs.
+    if (m_pRemap)
+    {
+        for (uint32_t i = patternLength ; i < m_ledCount ; i++)
+        {
+            memcpy(m_pEncodeBuffer + m_pRemap[i] * m_bytesPerLed,
+                   m_pEncodeBuffer + m_pRemap[i % patternLength] * m_bytesPerLed,
+                   m_bytesPerLed);
+        }
+    }
+    else
+    {
+        // Double the encoded run on each copy. It always holds a whole number of repetitions so the copies stay in
+        // step with the pattern.
+        uint32_t encodedBytes = patternLength * m_bytesPerLed;
+        while (encodedBytes < m_ledBytes)
+        {
+            uint32_t copyBytes = m_ledBytes - encodedBytes;
+            if (copyBytes > encodedBytes)
+            {
+                copyBytes = encodedBytes;
+            }
+            memcpy(m_pEncodeBuffer + encodedBytes, m_pEncodeBuffer, copyBytes);
+            encodedBytes += copyBytes;
+        }
+    }
+}
+
+bool NeoPixel::setPlaylist(const AnimationKeyFrame* pFrames, size_t frameCount, size_t pixelCount)
+{
+    assert ( pixelCount == m_ledCount );
+
+    // The playlist is played back by the transmit DMA channel so it has to be running already.
+    if (!m_isStarted || frameCount == 0 || frameCount > m_maxPlaylistFrames)
+    {
+        return false;
+    }
+
+    // Any frame committed by set() that the interrupt handler hasn't picked up yet is replaced by the playlist.
+    stopPlaylist();
+    flushFrameQueue();
+
+    // Encode every keyframe once, up front, into its own buffer.
+    for (size_t i = 0 ; i < frameCount ; i++)
+    {
+        const AnimationKeyFrame* pFrame = &pFrames[i];
+
+        assert ( !pFrame->interpolateBetweenFrames );
+        m_pEncodeBuffer = m_ppPlaylistBuffers[i];
+        m_pEmitBuffer = m_pEncodeBuffer;
+        if (pFrame->pPixels)
+        {
+            emitPixels(pFrame->pPixels, 0, m_ledCount);
+        }
+        else
+        {
+            emitPattern(pFrame->pPattern, pFrame->patternLength, pFrame->patternOffset);
+        }
+        // Zero length frames would never let the timeout handler catch up.
+        int32_t milliseconds = pFrame->millisecondsBeforeNextFrame;
+        m_pPlaylistMilliseconds[i] = milliseconds > 0 ? milliseconds : 1;
+    }
+    m_pEncodeBuffer = m_pBackBuffers[m_backBuffers.getWriteIndex()];
+
+    m_playlistFrameCount = frameCount;
+    m_playlistIndex = 0;
+    m_playlistMicrosecondsLeft = (uint64_t)m_pPlaylistMilliseconds[0] * 1000;
+    m_playlistTicker = us_ticker_read();
+
+    // From here on the CPU only has to repoint the DMA linked list when a frame is due.
+    __disable_irq();
+    {
+        // The whole playlist goes out under a single frame id.
+        m_backBufferId++;
+        m_backBuffers.discard();
+        setDmaSource(m_ppPlaylistBuffers[0]);
+        m_isPlaylistActive = true;
+    }
+    __enable_irq();
+    schedulePlaylistTimeout();
 
     m_setCount++;
+    return true;
 }
 
-void NeoPixel::waitForFreeBackBuffer()
+void NeoPixel::stopPlaylist()
 {
-    // Might hang forever if DMA operations haven't been started yet so just return.
-    if (!m_isStarted)
+    if (!m_isPlaylistActive)
+    {
         return;
+    }
+
+    m_playlistTimeout.detach();
+    waitForFrontBufferCopy();
+
+    // Leave the frame currently being shown in the back and front buffers so that the strand doesn't flash back to
+    // what it showed before the playlist started and so that setRange() has a complete frame to update.
+    const uint8_t* pCurrFrame = m_ppPlaylistBuffers[m_playlistIndex];
+    uint32_t       writeIndex = m_backBuffers.getWriteIndex();
+    memcpy(m_pBackBuffers[writeIndex], pCurrFrame, m_packetSize);
+    m_backBufferIds[writeIndex] = m_backBufferId;
+    m_backBufferDitherOffsets[writeIndex] = 0;
+    m_pLastFrame = m_pBackBuffers[writeIndex];
+    m_isLastFrameDithered = false;
+    memcpy(m_pFrontBuffers[0], pCurrFrame, m_packetSize);
+    memcpy(m_pFrontBuffers[1], pCurrFrame, m_packetSize);
+
+    __disable_irq();
+    {
+        m_dmaListItems[0].DMACCxSrcAddr = dmaAddress(m_pFrontBuffers[0]);
+        m_dmaListItems[1].DMACCxSrcAddr = dmaAddress(m_pFrontBuffers[1]);
+        m_frontBufferIds[0] = m_backBufferId;
+        m_frontBufferIds[1] = m_backBufferId;
+        m_shownBufferId = m_backBufferId;
+        m_pDitherSource = NULL;
+        m_isPlaylistActive = false;
+    }
+    __enable_irq();
+}
+
+void NeoPixel::startQueuedFrame(uint32_t presentTicker)
+{
+    assert ( !isFrameQueueFull() );
+    m_queuePresentTicker = presentTicker;
+    m_isQueueingFrame = true;
+}
+
+void NeoPixel::flushFrameQueue()
+{
+    if (m_frameQueue.getReadCount() == 0)
+    {
+        return;
+    }
+
+    // Clearing from this side of the queue is only safe while the interrupt handler can't run.
+    __disable_irq();
+    {
+        m_frameQueue.clear();
+        m_queueReadCount = 0;
+        m_queueHeldCount = 0;
+        m_pDitherSource = NULL;
+    }
+    __enable_irq();
+
+    // The interrupt handler may have just started copying out of a slot that set() is now free to overwrite.
+    waitForFrontBufferCopy();
+}
+
+void NeoPixel::setDmaSource(const uint8_t* pBuffer)
+{
+    // The DMA channel only picks up the new source address when it loads the next linked list item so the frame
+    // currently being sent always goes out whole.
+    m_dmaListItems[0].DMACCxSrcAddr = dmaAddress(pBuffer);
+    m_dmaListItems[1].DMACCxSrcAddr = dmaAddress(pBuffer);
+}
+
+void NeoPixel::schedulePlaylistTimeout()
+{
+    // Long frames are waited out in chunks so that the microsecond count can't overflow the Timeout.
+    const uint32_t maxTimeout = 1000000;
+    uint32_t timeout = m_playlistMicrosecondsLeft < maxTimeout ? (uint32_t)m_playlistMicrosecondsLeft : maxTimeout;
+
+    m_playlistTimeout.attach_us(this, &NeoPixel::playlistTimeoutHandler, timeout);
+}
+
+void NeoPixel::playlistTimeoutHandler()
+{
+    PROFILE_SCOPE(NeoPixel_playlistTimeout);
+    // Measure the actual time since the last timeout so that any lateness is taken out of the next frame rather than
+    // accumulating over the life of the playlist.
+    uint32_t currTicker = us_ticker_read();
+    uint32_t elapsed = currTicker - m_playlistTicker;
+    m_playlistTicker = currTicker;
+
+    if (elapsed >= m_playlistMicrosecondsLeft)
+    {
+        while (elapsed >= m_playlistMicrosecondsLeft)
+        {
+            elapsed -= m_playlistMicrosecondsLeft;
+            if (++m_playlistIndex >= m_playlistFrameCount)
+            {
+                m_playlistIndex = 0;
+            }
+            m_playlistMicrosecondsLeft = (uint64_t)m_pPlaylistMilliseconds[m_playlistIndex] * 1000;
+        }
+        setDmaSource(m_ppPlaylistBuffers[m_playlistIndex]);
+        TRACE(TRACE_PLAYLIST_FRAME, m_playlistIndex);
+    }
+    m_playlistMicrosecondsLeft -= elapsed;
+
+    schedulePlaylistTimeout();
+}
+
+void NeoPixel::setRemapTable(const uint16_t* pRemap)
+{
+#ifndef NDEBUG
+    for (uint32_t i = 0 ; pRemap && i < m_ledCount ; i++)
+    {
+        assert ( pRemap[i] < m_ledCount );
+    }
+#endif // NDEBUG
+    m_pRemap = pRemap;
+}
+
+void NeoPixel::startBackBufferUpdate(size_t firstPixel)
+{
+    TRACE(TRACE_SET_START, firstPixel);
+    // Frames sent one at a time take over from any running playlist.
+    stopPlaylist();
+
+    // Emit bits into the back buffer owned by this side of m_backBuffers, or the free slot at the tail of the frame
+    // queue. The interrupt handler never reads from either so there is no need to wait.
+    if (m_isQueueingFrame)
+    {
+        m_pEncodeBuffer = m_ppQueueBuffers[m_frameQueue.getWriteSlot()];
+    }
+    else
+    {
+        // A frame to be shown right away replaces any that were rendered ahead.
+        flushFrameQueue();
+        m_pEncodeBuffer = m_pBackBuffers[m_backBuffers.getWriteIndex()];
+    }
+    m_pEmitBuffer = m_pEncodeBuffer + firstPixel * m_bytesPerLed;
+    m_isEncodeDithered = false;
+}
+
+void NeoPixel::commitBackBuffer()
+{
+    uint32_t ditherOffset = m_isEncodeDithered ? m_packetSize : 0;
+
+    m_pLastFrame = m_pEncodeBuffer;
+    m_isLastFrameDithered = m_isEncodeDithered;
+    if (m_isQueueingFrame)
+    {
+        // The ticker and id have to be filled in before the slot is committed as the interrupt handler can pick it up
+        // straight away.
+        uint32_t slot = m_frameQueue.getWriteSlot();
+        m_pQueueTickers[slot] = m_queuePresentTicker;
+        m_pQueueIds[slot] = ++m_backBufferId;
+        m_pQueueDitherOffsets[slot] = ditherOffset;
+        m_frameQueue.commitWrite();
+        // Any further set*() calls go out as soon as possible again.
+        m_isQueueingFrame = false;
+    }
+    else
+    {
+        // Hand the back buffer over to the DMA interrupt handler to be copied into the next free front buffer and get
+        // back a free one to use for the next frame. If the interrupt handler hasn't picked up the previous frame yet
+        // then it is dropped in favour of this one.
+        uint32_t writeIndex = m_backBuffers.getWriteIndex();
+        m_backBufferTickers[writeIndex] = us_ticker_read();
+        m_backBufferIds[writeIndex] = ++m_backBufferId;
+        m_backBufferDitherOffsets[writeIndex] = ditherOffset;
+        m_backBuffers.publish();
+    }
 
-    while (m_backBufferState != BackBufferFree)
+    m_setCount++;
+    TRACE(TRACE_SET_END, m_backBufferId);
+}
+
+void NeoPixel::waitForFrontBufferCopy()
+{
+    // Only used when switching away from a playlist or the frame queue. A copy can only still be running if it was
+    // started by the flip just before and they take a small fraction of a frame.
+    while (m_isFrontBufferCopyActive)
     {
-        // Don't hit the memory bus too hard querying m_backBufferState while other DMA operations are running against
-        // the main SRAM bank.
+        // Don't hit the memory bus too hard while the DMA copy is running against the main SRAM bank.
         __NOP();
         __NOP();
         __NOP();
@@ -212,6 +674,8 @@ void NeoPixel::waitForFreeBackBuffer()
 
 void NeoPixel::emitByte(uint8_t byte)
 {
+    // Too short to be worth its own probe as reading CYCCNT and recording it would cost about as much as the encode.
+    // Divide the NeoPixel_set* probes by 3 bytes per pixel to get the cost of each byte instead.
     // Each NeoPixel bit will be represented in 12 SPI bits.
     // The format of the 12 SPI bits will be:
     //    1111xxxx0000
@@ -271,37 +735,129 @@ uint32_t NeoPixel::__spiTransmitInterruptHandler(void* pContext, uint32_t dmaInt
 
 uint32_t NeoPixel::spiTransmitInterruptHandler(uint32_t dmaInterruptStatus)
 {
+    PROFILE_SCOPE(NeoPixel_spiTransmitInterrupt);
     uint32_t txChannelMask = 1 << m_channelTx;
 
     if ((dmaInterruptStatus & txChannelMask) == 0)
     {
         return 0;
     }
+    TRACE(TRACE_FLIP, m_flipCount);
+
+    // Time between flips should stay steady at the time it takes to send one frame.
+    uint32_t currTicker = us_ticker_read();
+    if (m_flipCount > 0)
+    {
+        m_frameStats.flipInterval.record(currTicker - m_lastFlipTicker);
+    }
+    m_lastFlipTicker = currTicker;
+
+    // The playlist buffers are already fully encoded and the timeout handler takes care of switching between them.
+    if (m_isPlaylistActive)
+    {
+        // The DMA channel has just loaded the linked list items pointing at the playlist so it is what goes out from
+        // here on.
+        if (m_pFrameObserver)
+        {
+            m_pFrameObserver->frameSent(m_shownBufferId, currTicker);
+        }
+        m_shownBufferId = m_backBufferId;
+        m_flipCount++;
+        LPC_GPDMA->DMACIntTCClear = txChannelMask;
+        return txChannelMask;
+    }
 
     // Handle flipping from one front buffer to the other.
     // Determine which of the front buffers was just rendered and which one is just starting to render.
     uint32_t bufferJustSent = m_flipCount & 1;
     uint32_t bufferToSendNext = !bufferJustSent;
+    if (m_pFrameObserver)
+    {
+        m_pFrameObserver->frameSent(m_frontBufferIds[bufferJustSent], currTicker);
+    }
+
+    // The buffer that just started to go out was filled in on the previous flip so this is when its frame is first
+    // seen on the LEDs.
+    uint32_t startedBufferId = m_frontBufferIds[bufferToSendNext];
+    if (startedBufferId != m_shownBufferId)
+    {
+        m_frameStats.droppedFrames += startedBufferId - m_shownBufferId - 1;
+        // Frames from the queue can go out a little before the time they were queued for.
+        int32_t latency = (int32_t)(currTicker - m_frontBufferTickers[bufferToSendNext]);
+        m_frameStats.latency.record(latency > 0 ? latency : 0);
+        m_shownBufferId = startedBufferId;
+    }
 
-    if (m_backBufferState == BackBufferReadyToCopy)
+    // The buffer being filled in now starts going out on the next flip so look for the newest queued frame that is
+    // due closer to that flip than the one after it. Any older ones are now late and get skipped over.
+    uint32_t dueTicker = currTicker + getFrameMicroseconds() + getFrameMicroseconds() / 2;
+    uint32_t heldCount = m_queueHeldCount;
+    uint32_t queuedCount = m_frameQueue.getReadCount();
+    uint32_t dueCount = 0;
+    while (heldCount + dueCount < queuedCount &&
+           (int32_t)(m_pQueueTickers[m_frameQueue.getReadSlot(heldCount + dueCount)] - dueTicker) <= 0)
+    {
+        dueCount++;
+    }
+
+    // Front buffer 0 always gets the first encoding of a dithered frame and front buffer 1 the second so the LEDs
+    // alternate between them on every flip.
+    if (dueCount > 0)
+    {
+        // The slots can't be handed back to set() until the copy completes. m_queueReadCount is set before the copy
+        // is started so that the completion handler always releases the right number of slots, however soon the
+        // copy finishes. The slot of a dithered frame is held onto until its other encoding has been copied on the
+        // next flip.
+        uint32_t slot = m_frameQueue.getReadSlot(heldCount + dueCount - 1);
+        const uint8_t* pSrc = m_ppQueueBuffers[slot];
+        // set() flushes the queue before publishing a back buffer so one that is still waiting to be fetched is older
+        // than anything in the queue and would take the LEDs back in time if it were fetched on a later flip.
+        m_backBuffers.discard();
+        uint32_t ditherOffset = m_pQueueDitherOffsets[slot];
+        m_queueHeldCount = ditherOffset ? 1 : 0;
+        m_queueReadCount = heldCount + dueCount - m_queueHeldCount;
+        m_pDitherSource = ditherOffset ? pSrc + (bufferJustSent ? 0 : ditherOffset) : NULL;
+        m_isFrontBufferCopyActive = true;
+        int usedDma = dmaMemCopy(m_pFrontBuffers[bufferJustSent], pSrc + (bufferJustSent ? ditherOffset : 0),
+                                 m_packetSize, &m_dmaMemCopyCallback);
+        assert ( usedDma );
+        (void)usedDma;
+        m_frontBufferIds[bufferJustSent] = m_pQueueIds[slot];
+        m_frontBufferTickers[bufferJustSent] = m_pQueueTickers[slot];
+    }
+    else if (m_backBuffers.fetch())
     {
-        // There is a new back buffer to copy into the front buffer.
-        m_backBufferState = BackBufferCopying;
-        int usedDma = dmaMemCopy(m_pFrontBuffers[bufferJustSent], m_pBackBuffer, m_packetSize, &m_dmaMemCopyCallback);
+        // There is a new back buffer to copy into the front buffer. It stays owned by this side of m_backBuffers until
+        // the next fetch() which is a whole frame away so the copy will have long completed by then.
+        uint32_t readIndex = m_backBuffers.getReadIndex();
+        const uint8_t* pSrc = m_pBackBuffers[readIndex];
+        uint32_t ditherOffset = m_backBufferDitherOffsets[readIndex];
+        m_pDitherSource = ditherOffset ? pSrc + (bufferJustSent ? 0 : ditherOffset) : NULL;
+        m_isFrontBufferCopyActive = true;
+        int usedDma = dmaMemCopy(m_pFrontBuffers[bufferJustSent], pSrc + (bufferJustSent ? ditherOffset : 0),
+                                 m_packetSize, &m_dmaMemCopyCallback);
         assert ( usedDma );
         (void)usedDma;
-        m_frontBufferIds[bufferJustSent] = m_backBufferId;
+        m_frontBufferIds[bufferJustSent] = m_backBufferIds[readIndex];
+        m_frontBufferTickers[bufferJustSent] = m_backBufferTickers[readIndex];
     }
     else if (m_frontBufferIds[bufferJustSent] != m_frontBufferIds[bufferToSendNext])
     {
-        // Copy newer frame buffer into this older/stale one.
+        // Copy newer frame buffer into this older/stale one. A dithered frame gets its other encoding instead and from
+        // then on the two front buffers take turns showing the fraction without any more copies.
+        const uint8_t* pSrc = m_pDitherSource ? m_pDitherSource : m_pFrontBuffers[bufferToSendNext];
+        m_queueReadCount = m_queueHeldCount;
+        m_queueHeldCount = 0;
+        m_pDitherSource = NULL;
+        m_isFrontBufferCopyActive = true;
         int usedDma = dmaMemCopy(m_pFrontBuffers[bufferJustSent],
-                                 m_pFrontBuffers[bufferToSendNext],
+                                 pSrc,
                                  m_packetSize,
                                  &m_dmaMemCopyCallback);
         assert ( usedDma );
         (void)usedDma;
         m_frontBufferIds[bufferJustSent] = m_frontBufferIds[bufferToSendNext];
+        m_frontBufferTickers[bufferJustSent] = m_frontBufferTickers[bufferToSendNext];
     }
 
     m_flipCount++;
@@ -311,6 +867,22 @@ uint32_t NeoPixel::spiTransmitInterruptHandler(uint32_t dmaInterruptStatus)
     return txChannelMask;
 }
 
+void NeoPixel::getFrameStats(NeoPixelFrameStats* pStats, bool clearStats)
+{
+    // The interrupt handler updates most of these so stop it from running part way through the copy.
+    __disable_irq();
+    {
+        *pStats = m_frameStats;
+        if (clearStats)
+        {
+            m_frameStats.latency.clear();
+            m_frameStats.flipInterval.clear();
+            m_frameStats.droppedFrames = 0;
+        }
+    }
+    __enable_irq();
+}
+
 void NeoPixel::__memCopyCompleteHandler(void* pContext)
 {
     NeoPixel* pThis = (NeoPixel*)pContext;
@@ -320,9 +892,10 @@ void NeoPixel::__memCopyCompleteHandler(void* pContext)
 
 void NeoPixel::memCopyCompleteHandler()
 {
-    // Let the client app know if the back buffer was just freed for it to reuse for next frame.
-    if (m_backBufferState == BackBufferCopying)
-    {
-        m_backBufferState = BackBufferFree;
-    }
+    // The back buffer can't go back to set() until the next flip but any frame queue slots which were copied out of,
+    // or skipped over, can now be reused. Also lets stopPlaylist() know that it is safe to overwrite the front buffers.
+    m_frameQueue.commitRead(m_queueReadCount);
+    m_queueReadCount = 0;
+    m_isFrontBufferCopyActive = false;
+    TRACE(TRACE_BACK_BUFFER_FREE, 0);
 }
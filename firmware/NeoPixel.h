@@ -17,18 +17,106 @@
 
 #include <mbed.h>
 #include "Pixel.h"
+#include "PixelMath.h"
+#include "PixelSink.h"
 #include "GPDMA.h"
+#include "Histogram.h"
+#include "SpscRing.h"
+#include "TripleBuffer.h"
 
 
-class NeoPixel : public SPI
+// Frame pacing statistics gathered by the driver. All of the times are in microseconds.
+struct NeoPixelFrameStats
+{
+    // Time from set() handing over a frame to that frame starting to go out to the LEDs. For frames rendered ahead
+    // into the frame queue it is instead how late the frame started going out compared to the time it was queued for.
+    Histogram latency;
+    // Time between the starts of consecutive frames going out. Should stay at getFrameMicroseconds().
+    Histogram flipInterval;
+    // Frames that were replaced by a newer one before they could be shown.
+    uint32_t  droppedFrames;
+};
+
+
+// Interface used to find out when each frame has been completely sent out to the LEDs. frameId is the value that
+// getNextFrameId() returned before the frame was handed to the driver. Called from the DMA interrupt handler once per
+// flip so the same frame will be reported more than once if no newer frame was ready in time.
+class IFrameObserver
 {
 public:
-    NeoPixel(uint32_t ledCount, PinName outputPin);
+    virtual void frameSent(uint32_t frameId, uint32_t ticker) = 0;
+};
+
+
+class NeoPixel : public SPI, public IPixelSink
+{
+public:
+    // Room is set aside in the DMA heaps for up to maxPlaylistFrames pre-encoded frames to be used by setPlaylist()
+    // and for frameQueueDepth frames rendered ahead of time by startQueuedFrame(). When temporalDither is true, frames
+    // passed in as RGB16Data are encoded twice, rounded two different ways, and the two front buffers take turns
+    // sending them out so that the LEDs show the fraction of a level in between. This doubles the size of the back
+    // buffers and the frame queue slots.
+    NeoPixel(uint32_t ledCount, PinName outputPin, uint32_t maxPlaylistFrames = 0, uint32_t frameQueueDepth = 0,
+             bool temporalDither = false);
     ~NeoPixel();
 
     void     start();
-    void     set(const RGBData* pPixels, size_t pixelCount);
 
+    // Pixel i passed into set() will be sent to LED pRemap[i] on the strand. Applied while encoding so the animations
+    // don't need to reorder their pixels. Pass NULL to send the pixels in order. Takes effect on the next set().
+    void     setRemapTable(const uint16_t* pRemap);
+    // Pass NULL to stop sending frameSent() notifications.
+    void     setFrameObserver(IFrameObserver* pObserver)
+    {
+        m_pFrameObserver = pObserver;
+    }
+
+    // IPixelSink methods.
+    virtual void set(const RGBData* pPixels, size_t pixelCount);
+    virtual void set(const XRGBData* pPixels, size_t pixelCount);
+    virtual void set(const RGB16Data* pPixels, size_t pixelCount);
+    virtual void setRange(const XRGBData* pPixels, size_t firstPixel, size_t pixelCount);
+    virtual void setPattern(const PixelData* pPattern, size_t patternLength, size_t patternOffset,
+                            size_t pixelCount);
+    virtual bool setPlaylist(const AnimationKeyFrame* pFrames, size_t frameCount, size_t pixelCount);
+
+    // Frames from animations which know ahead of time what they will show can be queued up to be shown later. The
+    // interrupt handler sends each one out from the flip closest to its presentTicker (us_ticker_read() time) and
+    // skips over any that are already late. The next call to one of the set*() methods after startQueuedFrame() is
+    // encoded into the queue rather than being shown as soon as possible. Calling a set*() method outside of
+    // startQueuedFrame() and endQueuedFrame() flushes any frames still in the queue.
+    uint32_t getFrameQueueDepth()
+    {
+        return m_frameQueue.getCapacity();
+    }
+    bool     isFrameQueueFull()
+    {
+        return m_frameQueue.isFull();
+    }
+    void     startQueuedFrame(uint32_t presentTicker);
+    void     endQueuedFrame()
+    {
+        m_isQueueingFrame = false;
+    }
+    void     flushFrameQueue();
+
+    uint32_t getLedCount()
+    {
+        return m_ledCount;
+    }
+
+    // Time taken to send one complete frame to the strip.
+    uint32_t getFrameMicroseconds()
+    {
+        // Each SPI bit takes 1/10MHz = 0.1 usec.
+        return (m_packetSize * 8) / 10;
+    }
+
+    // Id which will be given to the next frame passed to one of the set*() methods.
+    uint32_t getNextFrameId()
+    {
+        return m_backBufferId + 1;
+    }
     // Number of times set() method was called.
     uint32_t getSetCount()
     {
@@ -39,29 +127,95 @@ public:
     {
         return m_flipCount;
     }
+    // Takes a consistent copy of the frame statistics, optionally clearing them to start a new measurement interval.
+    void     getFrameStats(NeoPixelFrameStats* pStats, bool clearStats = false);
 
 protected:
     void setConstantBitsInBuffers();
     void setConstantBitsInBuffer(uint8_t* pBuffer);
-    void waitForFreeBackBuffer();
+    void waitForFrontBufferCopy();
+    void stopPlaylist();
+    void setDmaSource(const uint8_t* pBuffer);
+    void schedulePlaylistTimeout();
+    void playlistTimeoutHandler();
+    void startBackBufferUpdate(size_t firstPixel);
+    void commitBackBuffer();
+    void emitPattern(const PixelData* pPattern, size_t patternLength, size_t patternOffset);
+    void emitDitheredPixels(const RGB16Data* pPixels);
+    void copyRangeToDitherVariant(size_t firstPixel, size_t pixelCount);
     void emitByte(uint8_t byte);
+    void emitPixel(const RGBData* pPixel)
+    {
+        emitByte(pPixel->red);
+        emitByte(pPixel->green);
+        emitByte(pPixel->blue);
+    }
+    void emitPixel(const XRGBData* pPixel)
+    {
+        // Fetch the whole pixel with a single word load.
+        uint32_t led = pPixel->xrgb;
+
+        emitByte(led >> 16);
+        emitByte(led >> 8);
+        emitByte(led);
+    }
+    void emitPixel(const RGB16Data* pPixel)
+    {
+        uint32_t led = packRgb(pPixel);
+
+        emitByte(led >> 16);
+        emitByte(led >> 8);
+        emitByte(led);
+    }
+    template <class PIXEL>
+    void emitPixels(const PIXEL* pPixels, size_t firstPixel, size_t pixelCount)
+    {
+        for (size_t i = 0 ; i < pixelCount ; i++)
+        {
+            moveEmitBufferToPixel(firstPixel + i);
+            emitPixel(pPixels++);
+        }
+    }
+    void moveEmitBufferToPixel(size_t pixel)
+    {
+        if (m_pRemap)
+        {
+            m_pEmitBuffer = m_pEncodeBuffer + m_pRemap[pixel] * m_bytesPerLed;
+        }
+    }
 
     static uint32_t __spiTransmitInterruptHandler(void* pContext, uint32_t dmaInterruptStatus);
     uint32_t        spiTransmitInterruptHandler(uint32_t dmaInterruptStatus);
     static void     __memCopyCompleteHandler(void* pContext);
     void            memCopyCompleteHandler();
 
-    enum BackBufferState
-    {
-        BackBufferFree,
-        BackBufferCopying,
-        BackBufferReadyToCopy
-    };
-
     uint8_t*                    m_pFrontBuffers[2];
-    uint8_t*                    m_pBackBuffer;
+    // set() encodes into one of these while the interrupt handler copies the newest complete one into a front
+    // buffer. m_backBuffers decides which buffer each side owns.
+    uint8_t*                    m_pBackBuffers[TripleBuffer::BUFFER_COUNT];
     uint8_t*                    m_pEmitBuffer;
+    // Buffer being encoded into. Normally the back buffer owned by set() but setPlaylist() encodes straight into its
+    // own buffers.
+    uint8_t*                    m_pEncodeBuffer;
+    uint8_t**                   m_ppPlaylistBuffers;
+    uint32_t*                   m_pPlaylistMilliseconds;
+    // Frames rendered ahead of time along with the us_ticker time at which each should be shown and its id. set() is
+    // the producer for m_frameQueue and the interrupt handler is the consumer.
+    uint8_t**                   m_ppQueueBuffers;
+    uint32_t*                   m_pQueueTickers;
+    uint32_t*                   m_pQueueIds;
+    // Offset of the second, differently rounded, encoding of a temporally dithered frame from the start of its back
+    // buffer or queue slot. 0 if the frame isn't dithered.
+    uint32_t*                   m_pQueueDitherOffsets;
+    uint32_t                    m_backBufferDitherOffsets[TripleBuffer::BUFFER_COUNT];
+    // Encoding of the last dithered frame copied into a front buffer which still needs to be copied into the other one.
+    const uint8_t*              m_pDitherSource;
+    // Last complete frame encoded by set() for setRange() to update.
+    const uint8_t*              m_pLastFrame;
+    const uint16_t*             m_pRemap;
+    IFrameObserver*             m_pFrameObserver;
     LPC_GPDMACH_TypeDef*        m_pChannelTx;
+    Timeout                     m_playlistTimeout;
     DmaInterruptHandler         m_dmaHandler;
     DmaMemCopyCallback          m_dmaMemCopyCallback;
     DmaLinkedListItem           m_dmaListItems[2];
@@ -69,12 +223,43 @@ protected:
     uint32_t                    m_sspTx;
     uint32_t                    m_ledCount;
     uint32_t                    m_ledBytes;
+    uint32_t                    m_bytesPerLed;
     uint32_t                    m_packetSize;
-    uint32_t                    m_setCount;
+    // Size of each back buffer and frame queue slot. Twice m_packetSize when temporal dithering is enabled.
+    uint32_t                    m_encodeBufferSize;
+    uint32_t                    m_maxPlaylistFrames;
+    uint32_t                    m_playlistFrameCount;
+    uint32_t                    m_playlistIndex;
+    uint32_t                    m_playlistTicker;
+    uint64_t                    m_playlistMicrosecondsLeft;
+    SpscRingBase                m_frameQueue;
+    // Slots that the interrupt handler has copied out of, or skipped over, but can't hand back to set() until the copy
+    // into the front buffer has completed.
+    volatile uint32_t           m_queueReadCount;
+    // The slot holding the last dithered frame from the queue is kept until m_pDitherSource has been copied out of it.
+    uint32_t                    m_queueHeldCount;
+    uint32_t                    m_queuePresentTicker;
+    volatile uint32_t           m_setCount;
     volatile uint32_t           m_flipCount;
+    TripleBuffer                m_backBuffers;
+    // Id of the newest frame committed by set() and the id of the frame held in each back buffer.
     volatile uint32_t           m_backBufferId;
+    uint32_t                    m_backBufferIds[TripleBuffer::BUFFER_COUNT];
     volatile uint32_t           m_frontBufferIds[2];
-    volatile BackBufferState    m_backBufferState;
+    // Id of the newest frame to have started going out to the LEDs.
+    volatile uint32_t           m_shownBufferId;
+    // us_ticker times at which the frame in each back and front buffer was committed.
+    uint32_t                    m_backBufferTickers[TripleBuffer::BUFFER_COUNT];
+    uint32_t                    m_frontBufferTickers[2];
+    uint32_t                    m_lastFlipTicker;
+    NeoPixelFrameStats          m_frameStats;
+    volatile bool               m_isFrontBufferCopyActive;
+    volatile bool               m_isPlaylistActive;
+    bool                        m_isQueueingFrame;
+    bool                        m_isTemporalDither;
+    // The frame being encoded, and the last one committed, have a second encoding for temporal dithering.
+    bool                        m_isEncodeDithered;
+    bool                        m_isLastFrameDithered;
     bool                        m_isStarted;
     uint8_t                     m_dummyRead;
 };
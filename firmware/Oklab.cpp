@@ -0,0 +1,185 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "Oklab.h"
+
+
+static uint32_t cubeRootQ14(int32_t value);
+
+
+// roundf(srgbToLinear(i / 255.0f) * 16384.0f) for i = 0 to 255.
+const uint16_t g_srgbToLinearTable[256] =
+{
+        0,     5,    10,    15,    20,    25,    30,    35,    40,    45,    50,    55,
+       60,    66,    72,    78,    85,    92,    99,   107,   115,   123,   131,   140,
+      150,   159,   169,   180,   190,   201,   213,   224,   237,   249,   262,   275,
+      289,   303,   318,   332,   348,   363,   379,   396,   413,   430,   448,   466,
+      484,   503,   523,   542,   563,   583,   604,   626,   648,   670,   693,   717,
+      740,   765,   789,   814,   840,   866,   893,   920,   947,   975,  1003,  1032,
+     1062,  1092,  1122,  1153,  1184,  1216,  1248,  1281,  1314,  1348,  1382,  1417,
+     1453,  1488,  1525,  1562,  1599,  1637,  1675,  1714,  1753,  1793,  1834,  1875,
+     1916,  1959,  2001,  2044,  2088,  2132,  2177,  2222,  2268,  2314,  2361,  2409,
+     2457,  2506,  2555,  2604,  2655,  2706,  2757,  2809,  2861,  2915,  2968,  3022,
+     3077,  3133,  3189,  3245,  3302,  3360,  3418,  3477,  3537,  3597,  3657,  3719,
+     3780,  3843,  3906,  3970,  4034,  4099,  4164,  4230,  4297,  4364,  4432,  4500,
+     4569,  4639,  4709,  4780,  4852,  4924,  4997,  5070,  5144,  5219,  5294,  5370,
+     5447,  5524,  5602,  5680,  5760,  5839,  5920,  6001,  6082,  6165,  6248,  6331,
+     6416,  6500,  6586,  6672,  6759,  6847,  6935,  7024,  7113,  7203,  7294,  7386,
+     7478,  7571,  7664,  7758,  7853,  7949,  8045,  8142,  8239,  8338,  8436,  8536,
+     8636,  8737,  8839,  8941,  9044,  9148,  9252,  9357,  9463,  9570,  9677,  9785,
+     9893, 10002, 10112, 10223, 10334, 10446, 10559, 10673, 10787, 10902, 11017, 11134,
+    11251, 11368, 11487, 11606, 11726, 11847, 11968, 12090, 12213, 12336, 12460, 12585,
+    12711, 12837, 12965, 13092, 13221, 13350, 13481, 13611, 13743, 13875, 14008, 14142,
+    14276, 14412, 14548, 14684, 14822, 14960, 15099, 15239, 15379, 15521, 15663, 15805,
+    15949, 16093, 16238, 16384
+};
+
+// roundf(linearToSrgb(i / 4096.0f) * 255.0f) for i = 0 to 255.
+const uint8_t g_linearToSrgbLowTable[256] =
+{
+      0,   1,   2,   2,   3,   4,   5,   6,   6,   7,   8,   9,  10,  10,  11,  12,
+     13,  13,  14,  15,  15,  16,  16,  17,  18,  18,  19,  19,  20,  20,  21,  21,
+     22,  22,  23,  23,  23,  24,  24,  25,  25,  25,  26,  26,  27,  27,  27,  28,
+     28,  29,  29,  29,  30,  30,  30,  31,  31,  31,  32,  32,  32,  33,  33,  33,
+     34,  34,  34,  34,  35,  35,  35,  36,  36,  36,  36,  37,  37,  37,  38,  38,
+     38,  38,  39,  39,  39,  40,  40,  40,  40,  41,  41,  41,  41,  42,  42,  42,
+     42,  43,  43,  43,  43,  43,  44,  44,  44,  44,  45,  45,  45,  45,  46,  46,
+     46,  46,  46,  47,  47,  47,  47,  48,  48,  48,  48,  48,  49,  49,  49,  49,
+     49,  50,  50,  50,  50,  50,  51,  51,  51,  51,  51,  52,  52,  52,  52,  52,
+     53,  53,  53,  53,  53,  54,  54,  54,  54,  54,  55,  55,  55,  55,  55,  55,
+     56,  56,  56,  56,  56,  57,  57,  57,  57,  57,  57,  58,  58,  58,  58,  58,
+     58,  59,  59,  59,  59,  59,  59,  60,  60,  60,  60,  60,  60,  61,  61,  61,
+     61,  61,  61,  62,  62,  62,  62,  62,  62,  63,  63,  63,  63,  63,  63,  64,
+     64,  64,  64,  64,  64,  64,  65,  65,  65,  65,  65,  65,  66,  66,  66,  66,
+     66,  66,  66,  67,  67,  67,  67,  67,  67,  67,  68,  68,  68,  68,  68,  68,
+     68,  69,  69,  69,  69,  69,  69,  69,  70,  70,  70,  70,  70,  70,  70,  71
+};
+
+// roundf(linearToSrgb((i * 4 + 1.5f) / 4096.0f) * 255.0f) for i = 0 to 1023.
+const uint8_t g_linearToSrgbHighTable[1024] =
+{
+      1,   4,   8,  11,  14,  16,  18,  20,  22,  24,  26,  27,  29,  30,  31,  33,
+     34,  35,  36,  37,  39,  40,  41,  42,  43,  44,  45,  45,  46,  47,  48,  49,
+     50,  51,  51,  52,  53,  54,  54,  55,  56,  57,  57,  58,  59,  59,  60,  61,
+     61,  62,  63,  63,  64,  65,  65,  66,  66,  67,  68,  68,  69,  69,  70,  70,
+     71,  71,  72,  73,  73,  74,  74,  75,  75,  76,  76,  77,  77,  78,  78,  79,
+     79,  80,  80,  81,  81,  82,  82,  82,  83,  83,  84,  84,  85,  85,  86,  86,
+     86,  87,  87,  88,  88,  89,  89,  89,  90,  90,  91,  91,  92,  92,  92,  93,
+     93,  94,  94,  94,  95,  95,  95,  96,  96,  97,  97,  97,  98,  98,  98,  99,
+     99, 100, 100, 100, 101, 101, 101, 102, 102, 102, 103, 103, 104, 104, 104, 105,
+    105, 105, 106, 106, 106, 107, 107, 107, 108, 108, 108, 109, 109, 109, 110, 110,
+    110, 111, 111, 111, 112, 112, 112, 112, 113, 113, 113, 114, 114, 114, 115, 115,
+    115, 116, 116, 116, 116, 117, 117, 117, 118, 118, 118, 119, 119, 119, 119, 120,
+    120, 120, 121, 121, 121, 121, 122, 122, 122, 123, 123, 123, 123, 124, 124, 124,
+    125, 125, 125, 125, 126, 126, 126, 126, 127, 127, 127, 128, 128, 128, 128, 129,
+    129, 129, 129, 130, 130, 130, 130, 131, 131, 131, 132, 132, 132, 132, 133, 133,
+    133, 133, 134, 134, 134, 134, 135, 135, 135, 135, 136, 136, 136, 136, 137, 137,
+    137, 137, 138, 138, 138, 138, 139, 139, 139, 139, 139, 140, 140, 140, 140, 141,
+    141, 141, 141, 142, 142, 142, 142, 143, 143, 143, 143, 143, 144, 144, 144, 144,
+    145, 145, 145, 145, 146, 146, 146, 146, 146, 147, 147, 147, 147, 148, 148, 148,
+    148, 148, 149, 149, 149, 149, 150, 150, 150, 150, 150, 151, 151, 151, 151, 152,
+    152, 152, 152, 152, 153, 153, 153, 153, 153, 154, 154, 154, 154, 155, 155, 155,
+    155, 155, 156, 156, 156, 156, 156, 157, 157, 157, 157, 157, 158, 158, 158, 158,
+    158, 159, 159, 159, 159, 159, 160, 160, 160, 160, 160, 161, 161, 161, 161, 161,
+    162, 162, 162, 162, 162, 163, 163, 163, 163, 163, 164, 164, 164, 164, 164, 165,
+    165, 165, 165, 165, 166, 166, 166, 166, 166, 167, 167, 167, 167, 167, 168, 168,
+    168, 168, 168, 168, 169, 169, 169, 169, 169, 170, 170, 170, 170, 170, 171, 171,
+    171, 171, 171, 171, 172, 172, 172, 172, 172, 173, 173, 173, 173, 173, 173, 174,
+    174, 174, 174, 174, 175, 175, 175, 175, 175, 175, 176, 176, 176, 176, 176, 176,
+    177, 177, 177, 177, 177, 178, 178, 178, 178, 178, 178, 179, 179, 179, 179, 179,
+    179, 180, 180, 180, 180, 180, 181, 181, 181, 181, 181, 181, 182, 182, 182, 182,
+    182, 182, 183, 183, 183, 183, 183, 183, 184, 184, 184, 184, 184, 184, 185, 185,
+    185, 185, 185, 185, 186, 186, 186, 186, 186, 186, 187, 187, 187, 187, 187, 187,
+    188, 188, 188, 188, 188, 188, 189, 189, 189, 189, 189, 189, 190, 190, 190, 190,
+    190, 190, 190, 191, 191, 191, 191, 191, 191, 192, 192, 192, 192, 192, 192, 193,
+    193, 193, 193, 193, 193, 194, 194, 194, 194, 194, 194, 194, 195, 195, 195, 195,
+    195, 195, 196, 196, 196, 196, 196, 196, 196, 197, 197, 197, 197, 197, 197, 198,
+    198, 198, 198, 198, 198, 198, 199, 199, 199, 199, 199, 199, 200, 200, 200, 200,
+    200, 200, 200, 201, 201, 201, 201, 201, 201, 201, 202, 202, 202, 202, 202, 202,
+    203, 203, 203, 203, 203, 203, 203, 204, 204, 204, 204, 204, 204, 204, 205, 205,
+    205, 205, 205, 205, 205, 206, 206, 206, 206, 206, 206, 206, 207, 207, 207, 207,
+    207, 207, 207, 208, 208, 208, 208, 208, 208, 208, 209, 209, 209, 209, 209, 209,
+    209, 210, 210, 210, 210, 210, 210, 210, 211, 211, 211, 211, 211, 211, 211, 212,
+    212, 212, 212, 212, 212, 212, 213, 213, 213, 213, 213, 213, 213, 214, 214, 214,
+    214, 214, 214, 214, 215, 215, 215, 215, 215, 215, 215, 215, 216, 216, 216, 216,
+    216, 216, 216, 217, 217, 217, 217, 217, 217, 217, 218, 218, 218, 218, 218, 218,
+    218, 218, 219, 219, 219, 219, 219, 219, 219, 220, 220, 220, 220, 220, 220, 220,
+    220, 221, 221, 221, 221, 221, 221, 221, 222, 222, 222, 222, 222, 222, 222, 222,
+    223, 223, 223, 223, 223, 223, 223, 223, 224, 224, 224, 224, 224, 224, 224, 225,
+    225, 225, 225, 225, 225, 225, 225, 226, 226, 226, 226, 226, 226, 226, 226, 227,
+    227, 227, 227, 227, 227, 227, 227, 228, 228, 228, 228, 228, 228, 228, 228, 229,
+    229, 229, 229, 229, 229, 229, 230, 230, 230, 230, 230, 230, 230, 230, 231, 231,
+    231, 231, 231, 231, 231, 231, 232, 232, 232, 232, 232, 232, 232, 232, 233, 233,
+    233, 233, 233, 233, 233, 233, 233, 234, 234, 234, 234, 234, 234, 234, 234, 235,
+    235, 235, 235, 235, 235, 235, 235, 236, 236, 236, 236, 236, 236, 236, 236, 237,
+    237, 237, 237, 237, 237, 237, 237, 238, 238, 238, 238, 238, 238, 238, 238, 238,
+    239, 239, 239, 239, 239, 239, 239, 239, 240, 240, 240, 240, 240, 240, 240, 240,
+    240, 241, 241, 241, 241, 241, 241, 241, 241, 242, 242, 242, 242, 242, 242, 242,
+    242, 242, 243, 243, 243, 243, 243, 243, 243, 243, 244, 244, 244, 244, 244, 244,
+    244, 244, 244, 245, 245, 245, 245, 245, 245, 245, 245, 246, 246, 246, 246, 246,
+    246, 246, 246, 246, 247, 247, 247, 247, 247, 247, 247, 247, 247, 248, 248, 248,
+    248, 248, 248, 248, 248, 248, 249, 249, 249, 249, 249, 249, 249, 249, 249, 250,
+    250, 250, 250, 250, 250, 250, 250, 251, 251, 251, 251, 251, 251, 251, 251, 251,
+    252, 252, 252, 252, 252, 252, 252, 252, 252, 253, 253, 253, 253, 253, 253, 253,
+    253, 253, 254, 254, 254, 254, 254, 254, 254, 254, 254, 254, 255, 255, 255, 255
+};
+
+
+void rgbToOklab(OklabData* pOklab, const RGBData* pRGB)
+{
+    int32_t red = g_srgbToLinearTable[pRGB->red];
+    int32_t green = g_srgbToLinearTable[pRGB->green];
+    int32_t blue = g_srgbToLinearTable[pRGB->blue];
+
+    // Linear sRGB to the LMS cone responses in Q14. Each row sums to 4096 so that greys have l == m == s.
+    int32_t l = (1688 * red + 2197 * green + 211 * blue + 2048) >> 12;
+    int32_t m = (868 * red + 2788 * green + 440 * blue + 2048) >> 12;
+    int32_t s = (362 * red + 1154 * green + 2580 * blue + 2048) >> 12;
+
+    int32_t lRoot = cubeRootQ14(l);
+    int32_t mRoot = cubeRootQ14(m);
+    int32_t sRoot = cubeRootQ14(s);
+
+    // The a and b rows sum to 0 so that greys have no colour.
+    pOklab->lightness = (862 * lRoot + 3251 * mRoot - 17 * sRoot + 2048) >> 12;
+    pOklab->a = (8102 * lRoot - 9948 * mRoot + 1846 * sRoot + 2048) >> 12;
+    pOklab->b = (106 * lRoot + 3206 * mRoot - 3312 * sRoot + 2048) >> 12;
+}
+
+void rgbToOklab(OklabData* pOklab, const XRGBData* pXRGB)
+{
+    RGBData rgb(pXRGB->red, pXRGB->green, pXRGB->blue);
+    rgbToOklab(pOklab, &rgb);
+}
+
+static uint32_t cubeRootQ14(int32_t value)
+{
+    // Only called when keyframes are first converted so a bit at a time search is fast enough.
+    // cbrt(value / 2^14) * 2^14 == cbrt(value * 2^28)
+    uint64_t cube = (uint64_t)value << 28;
+    uint32_t root = 0;
+    for (int bit = 15 ; bit >= 0 ; bit--)
+    {
+        uint32_t trial = root | (1 << bit);
+        if ((uint64_t)trial * trial * trial <= cube)
+        {
+            root = trial;
+        }
+    }
+
+    // Round to the nearer of root and root + 1.
+    uint64_t below = cube - (uint64_t)root * root * root;
+    uint64_t above = (uint64_t)(root + 1) * (root + 1) * (root + 1) - cube;
+    return (above < below) ? root + 1 : root;
+}
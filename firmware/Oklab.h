@@ -0,0 +1,163 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Fixed point conversions to and from the Oklab perceptual colour space for smoother interpolation between colours.
+   Straight lines in Oklab look like even steps in both colour and brightness to the human eye and, unlike HSV, there
+   is no hue wheel to go the long way around. All of the maths is done with integers and small flash based tables
+   since the Cortex-M3 has no FPU. */
+#ifndef OKLAB_H_
+#define OKLAB_H_
+
+#include <mbed.h>
+#include "Pixel.h"
+
+
+struct OklabData
+{
+    // lightness is 0 (black) to 16384 (white) in Q14 format. a (green/red) and b (blue/yellow) are in the same
+    // Q14 format and always fall between -0.5 and 0.5 for colours that the LEDs can show.
+    int16_t lightness;
+    int16_t a;
+    int16_t b;
+};
+
+// Linear light intensity for each of the 256 sRGB levels in Q14 format.
+extern const uint16_t g_srgbToLinearTable[256];
+// sRGB level for Q12 linear light intensities. The low table covers the steep part of the curve near black one
+// entry per intensity and the high table covers the full range at every fourth intensity.
+extern const uint8_t  g_linearToSrgbLowTable[256];
+extern const uint8_t  g_linearToSrgbHighTable[1024];
+
+
+void rgbToOklab(OklabData* pOklab, const RGBData* pRGB);
+void rgbToOklab(OklabData* pOklab, const XRGBData* pXRGB);
+
+
+// Converts a linear light intensity in Q12 format back to an 8-bit sRGB level, clamping anything out of range.
+static inline uint32_t linearToSrgb(int32_t linear)
+{
+    if (linear <= 0)
+    {
+        return 0;
+    }
+    if (linear < 256)
+    {
+        return g_linearToSrgbLowTable[linear];
+    }
+    if (linear >= 4096)
+    {
+        return 255;
+    }
+    return g_linearToSrgbHighTable[linear >> 2];
+}
+
+// Converts a linear light intensity in Q14 format to an sRGB level with 8 fractional bits, as used by RGB16Data.
+// The fraction comes from interpolating between neighbouring entries in the same tables used by linearToSrgb().
+static inline uint32_t linearToSrgb16(int32_t linear)
+{
+    uint32_t curr;
+    uint32_t next;
+    uint32_t fraction;
+    uint32_t fractionBits;
+
+    if (linear <= 0)
+    {
+        return 0;
+    }
+    if (linear >= 16384)
+    {
+        return 0xFF00;
+    }
+    if (linear < 1024)
+    {
+        uint32_t index = linear >> 2;
+        curr = g_linearToSrgbLowTable[index];
+        next = index < 255 ? g_linearToSrgbLowTable[index + 1] : g_linearToSrgbHighTable[64];
+        fraction = linear & 3;
+        fractionBits = 2;
+    }
+    else
+    {
+        uint32_t index = linear >> 4;
+        curr = g_linearToSrgbHighTable[index];
+        next = index < 1023 ? g_linearToSrgbHighTable[index + 1] : 255;
+        fraction = linear & 15;
+        fractionBits = 4;
+    }
+    return (curr << 8) + ((((next - curr) << 8) * fraction) >> fractionBits);
+}
+
+// Converts from Oklab to the LMS cone responses in Q14 format.
+static inline void oklabToLms(int32_t lightness, int32_t a, int32_t b, int32_t* pL, int32_t* pM, int32_t* pS)
+{
+    // Back to the cube roots of the LMS cone responses (Q14) using the inverse of the Oklab matrix in Q12.
+    int32_t lRoot = lightness + ((1623 * a + 884 * b + 2048) >> 12);
+    int32_t mRoot = lightness + ((-432 * a - 262 * b + 2048) >> 12);
+    int32_t sRoot = lightness + ((-367 * a - 5290 * b + 2048) >> 12);
+
+    *pL = (((lRoot * lRoot) >> 14) * lRoot) >> 14;
+    *pM = (((mRoot * mRoot) >> 14) * mRoot) >> 14;
+    *pS = (((sRoot * sRoot) >> 14) * sRoot) >> 14;
+}
+
+// Returns the colour as a packed 0x00RRGGBB pixel, ready for unpackRgb().
+static inline uint32_t oklabToPackedRgb(int32_t lightness, int32_t a, int32_t b)
+{
+    int32_t l;
+    int32_t m;
+    int32_t s;
+    oklabToLms(lightness, a, b, &l, &m, &s);
+
+    // LMS to linear sRGB in Q12. Each row sums to 4096 so that white stays white.
+    int32_t red = (16698 * l - 13548 * m + 946 * s + 8192) >> 14;
+    int32_t green = (-5196 * l + 10690 * m - 1398 * s + 8192) >> 14;
+    int32_t blue = (-17 * l - 2881 * m + 6994 * s + 8192) >> 14;
+
+    return (linearToSrgb(red) << 16) | (linearToSrgb(green) << 8) | linearToSrgb(blue);
+}
+
+// Same as above but keeps the linear values in Q14 to fill in the fractional bits of each RGB16Data channel.
+static inline void oklabToRgb16(RGB16Data* pRGB16, int32_t lightness, int32_t a, int32_t b)
+{
+    int32_t l;
+    int32_t m;
+    int32_t s;
+    oklabToLms(lightness, a, b, &l, &m, &s);
+
+    pRGB16->red = linearToSrgb16((16698 * l - 13548 * m + 946 * s + 2048) >> 12);
+    pRGB16->green = linearToSrgb16((-5196 * l + 10690 * m - 1398 * s + 2048) >> 12);
+    pRGB16->blue = linearToSrgb16((-17 * l - 2881 * m + 6994 * s + 2048) >> 12);
+}
+
+// Linear interpolation from pStart to pStop where fraction is in the range 0 (all pStart) to 4096 (all pStop).
+static inline uint32_t oklabLerpToPackedRgb(const OklabData* pStart, const OklabData* pStop, int32_t fraction)
+{
+    int32_t lightness = pStart->lightness + (((pStop->lightness - pStart->lightness) * fraction) >> 12);
+    int32_t a = pStart->a + (((pStop->a - pStart->a) * fraction) >> 12);
+    int32_t b = pStart->b + (((pStop->b - pStart->b) * fraction) >> 12);
+
+    return oklabToPackedRgb(lightness, a, b);
+}
+
+static inline void oklabLerpToRgb16(RGB16Data* pRGB16, const OklabData* pStart, const OklabData* pStop,
+                                    int32_t fraction)
+{
+    int32_t lightness = pStart->lightness + (((pStop->lightness - pStart->lightness) * fraction) >> 12);
+    int32_t a = pStart->a + (((pStop->a - pStart->a) * fraction) >> 12);
+    int32_t b = pStart->b + (((pStop->b - pStart->b) * fraction) >> 12);
+
+    oklabToRgb16(pRGB16, lightness, a, b);
+}
+
+#endif // OKLAB_H_
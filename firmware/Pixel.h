@@ -27,6 +27,74 @@ struct RGBData
     }
 };
 
+// Pixel packed into one aligned 32-bit word as 0x00RRGGBB so that it can be loaded, stored and copied with single
+// word operations instead of the 3 unaligned byte accesses needed for RGBData.
+struct XRGBData
+{
+    union
+    {
+        struct
+        {
+            uint8_t blue;
+            uint8_t green;
+            uint8_t red;
+            uint8_t unused;
+        };
+        uint32_t xrgb;
+    };
+
+    XRGBData(int r, int g, int b) : xrgb(((uint32_t)(r & 0xFF) << 16) | ((uint32_t)(g & 0xFF) << 8) | (b & 0xFF))
+    {
+    }
+    XRGBData(const RGBData& rgb) : xrgb(((uint32_t)rgb.red << 16) | ((uint32_t)rgb.green << 8) | rgb.blue)
+    {
+    }
+    XRGBData() : xrgb(0)
+    {
+    }
+} __attribute__((aligned(4)));
+
+// Pixel with 8 extra bits of precision in each channel. The upper byte of each channel is the 8-bit level and the
+// lower byte is a fraction of a level which sinks like NeoPixel can show by dithering over time.
+struct RGB16Data
+{
+    uint16_t red;
+    uint16_t green;
+    uint16_t blue;
+
+    RGB16Data(const RGBData& rgb) : red(rgb.red << 8), green(rgb.green << 8), blue(rgb.blue << 8)
+    {
+    }
+    RGB16Data(const XRGBData& xrgb) : red(xrgb.red << 8), green(xrgb.green << 8), blue(xrgb.blue << 8)
+    {
+    }
+    RGB16Data() : red(0), green(0), blue(0)
+    {
+    }
+};
+
+// The layout used by the animation pixel buffers. Defining PIXEL_STORAGE_XRGB trades an extra byte per pixel for
+// word sized pixel operations.
+#ifdef PIXEL_STORAGE_XRGB
+typedef XRGBData PixelData;
+#else
+typedef RGBData  PixelData;
+#endif
+
+// Set TEMPORAL_DITHER to 1 to have the NeoPixel driver show the fraction of a level kept by interpolated frames by
+// alternating between two roundings of each frame. Those frames are only stored with the extra precision when it is
+// set as they would otherwise take twice the RAM just to have the driver round them off again.
+#ifndef TEMPORAL_DITHER
+#define TEMPORAL_DITHER 0
+#endif
+
+#if TEMPORAL_DITHER
+typedef RGB16Data FramePixelData;
+#else
+typedef PixelData FramePixelData;
+#endif
+
+
 struct HSVData
 {
     uint8_t hue;
@@ -41,6 +109,14 @@ struct HSVData
     }
 };
 
+// HSV colour whose hue and value have 8 extra bits of precision, in the same format as the RGB16Data channels.
+struct HSV16Data
+{
+    uint16_t hue;
+    uint8_t  saturation;
+    uint16_t value;
+};
+
 
 // Commonly used colours.
 #define RED         RGBData(0xFF, 0x00, 0x00)
@@ -112,6 +188,78 @@ static inline void hsvToRgb(RGBData* pRGB, const HSVData* pHSV)
     }
 }
 
+static inline void hsvToRgb(XRGBData* pXRGB, const HSVData* pHSV)
+{
+    RGBData rgb;
+    hsvToRgb(&rgb, pHSV);
+    *pXRGB = XRGBData(rgb);
+}
+
+// Same as above but the extra precision of the hue and value carries through to all three channels.
+static inline void hsvToRgb(RGB16Data* pRGB, const HSV16Data* pHSV)
+{
+    const uint32_t regionSize = 43 << 8;
+    const uint32_t maxRemainder = 255 << 8;
+    uint32_t hue = pHSV->hue;
+    uint32_t saturation = pHSV->saturation;
+    uint32_t value = pHSV->value;
+
+    if (saturation == 0)
+    {
+        pRGB->red = value;
+        pRGB->green = value;
+        pRGB->blue = value;
+        return;
+    }
+
+    // The remainder also has 8 fractional bits. Hues in the last step of a region take it just past the top so
+    // clamp it.
+    uint32_t region = hue / regionSize;
+    uint32_t remainder = ((hue - region * regionSize) * 255) / 42;
+    if (remainder > maxRemainder)
+    {
+        remainder = maxRemainder;
+    }
+
+    uint32_t p = (value * (255 - saturation)) >> 8;
+    uint32_t q = (value * (maxRemainder - ((saturation * remainder) >> 8))) >> 16;
+    uint32_t t = (value * (maxRemainder - ((saturation * (maxRemainder - remainder)) >> 8))) >> 16;
+
+    switch (region)
+    {
+    case 0:
+        pRGB->red = value;
+        pRGB->green = t;
+        pRGB->blue = p;
+        break;
+    case 1:
+        pRGB->red = q;
+        pRGB->green = value;
+        pRGB->blue = p;
+        break;
+    case 2:
+        pRGB->red = p;
+        pRGB->green = value;
+        pRGB->blue = t;
+        break;
+    case 3:
+        pRGB->red = p;
+        pRGB->green = q;
+        pRGB->blue = value;
+        break;
+    case 4:
+        pRGB->red = t;
+        pRGB->green = p;
+        pRGB->blue = value;
+        break;
+    default:
+        pRGB->red = value;
+        pRGB->green = p;
+        pRGB->blue = q;
+        break;
+    }
+}
+
 static inline void rgbToHsv(HSVData* pHSV, const RGBData* pRGB)
 {
     uint32_t red = pRGB->red;
@@ -150,4 +298,10 @@ static inline void rgbToHsv(HSVData* pHSV, const RGBData* pRGB)
     }
 }
 
+static inline void rgbToHsv(HSVData* pHSV, const XRGBData* pXRGB)
+{
+    RGBData rgb(pXRGB->red, pXRGB->green, pXRGB->blue);
+    rgbToHsv(pHSV, &rgb);
+}
+
 #endif // PIXEL_H_
@@ -0,0 +1,321 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Pixel math on packed 32-bit 0x00RRGGBB pixels.
+   The Cortex-M3 has no SIMD instructions so these use SWAR (SIMD within a register) tricks instead. The red and blue
+   channels are processed together in 16-bit lanes of one word (0x00RR00BB) with green handled on its own so that
+   each operation takes 2 multiplies instead of 3 and no per-channel branches. */
+#ifndef PIXEL_MATH_H_
+#define PIXEL_MATH_H_
+
+#include <mbed.h>
+#include "Pixel.h"
+
+
+#define PIXEL_RED_BLUE_MASK     0x00FF00FF
+#define PIXEL_GREEN_MASK        0x0000FF00
+
+
+static inline uint32_t roundRgb16Channel(uint32_t channel)
+{
+    uint32_t level = (channel + 0x80) >> 8;
+    return level > 255 ? 255 : level;
+}
+
+static inline uint32_t packRgb(const RGBData* pRGB)
+{
+    return ((uint32_t)pRGB->red << 16) | ((uint32_t)pRGB->green << 8) | (uint32_t)pRGB->blue;
+}
+
+static inline void unpackRgb(RGBData* pRGB, uint32_t pixel)
+{
+    pRGB->red = pixel >> 16;
+    pRGB->green = pixel >> 8;
+    pRGB->blue = pixel;
+}
+
+// Rounds off the fraction of a level in each channel.
+static inline uint32_t packRgb(const RGB16Data* pRGB16)
+{
+    return (roundRgb16Channel(pRGB16->red) << 16) | (roundRgb16Channel(pRGB16->green) << 8) |
+           roundRgb16Channel(pRGB16->blue);
+}
+
+// XRGBData is already stored in the packed format so these are just word copies.
+static inline uint32_t packRgb(const XRGBData* pXRGB)
+{
+    return pXRGB->xrgb;
+}
+
+static inline void unpackRgb(XRGBData* pXRGB, uint32_t pixel)
+{
+    pXRGB->xrgb = pixel;
+}
+
+// Copies a pixel between any two of the layouts, rounding off the fraction of a level when going to 8 bits.
+template <class DEST, class SRC>
+static inline void convertPixel(DEST* pDest, const SRC* pSrc)
+{
+    unpackRgb(pDest, packRgb(pSrc));
+}
+
+template <class SRC>
+static inline void convertPixel(RGB16Data* pDest, const SRC* pSrc)
+{
+    *pDest = RGB16Data(*pSrc);
+}
+
+// Per channel a + b, clamped to 255.
+static inline uint32_t pixelAddSaturate(uint32_t a, uint32_t b)
+{
+    // Add the lower 7 bits of each byte so that no carry can cross into the next channel.
+    uint32_t sum = (a & 0x7F7F7F7F) + (b & 0x7F7F7F7F);
+    // Carry out of the top bit of each byte is the majority of the two top bits and the carry into that bit.
+    uint32_t carry = ((a & b) | ((a | b) & sum)) & 0x80808080;
+    sum ^= (a ^ b) & 0x80808080;
+    // Saturate any byte which overflowed.
+    return sum | ((carry >> 7) * 0xFF);
+}
+
+// Per channel (channel * scale) / 256 where scale is in the range 0 to 256.
+static inline uint32_t pixelScale(uint32_t pixel, uint32_t scale)
+{
+    uint32_t redBlue = (((pixel & PIXEL_RED_BLUE_MASK) * scale) >> 8) & PIXEL_RED_BLUE_MASK;
+    uint32_t green = (((pixel & PIXEL_GREEN_MASK) * scale) >> 8) & PIXEL_GREEN_MASK;
+    return redBlue | green;
+}
+
+// Per channel channel - (channel * decay) / 256, except that channels at or below threshold go straight to 0.
+static inline uint32_t pixelFadeToBlack(uint32_t pixel, uint32_t decay, uint32_t threshold)
+{
+    uint32_t redBlue = pixel & PIXEL_RED_BLUE_MASK;
+    uint32_t green = (pixel >> 8) & 0xFF;
+
+    // Adding 0x7FFF - threshold to each 16-bit lane sets its top bit only if the channel is above the threshold.
+    uint32_t keepRedBlue = (((redBlue + (0x7FFF - threshold) * 0x00010001) & 0x80008000) >> 15) * 0xFF;
+    uint32_t keepGreen = green > threshold ? 0xFF : 0x00;
+
+    redBlue = (redBlue - (((redBlue * decay) >> 8) & PIXEL_RED_BLUE_MASK)) & keepRedBlue;
+    green = (green - ((green * decay) >> 8)) & keepGreen;
+
+    return redBlue | (green << 8);
+}
+
+// Per channel maximum of a and b.
+static inline uint32_t pixelMax(uint32_t a, uint32_t b)
+{
+    // Borrowing each 8-bit channel from a 9th guard bit leaves that bit set only where a >= b. Red and blue share
+    // one subtraction in their 16-bit lanes and green gets its own.
+    uint32_t aRedBlue = a & PIXEL_RED_BLUE_MASK;
+    uint32_t bRedBlue = b & PIXEL_RED_BLUE_MASK;
+    uint32_t aGreen = a & PIXEL_GREEN_MASK;
+    uint32_t bGreen = b & PIXEL_GREEN_MASK;
+    uint32_t selectRedBlue = ((((aRedBlue | 0x01000100) - bRedBlue) & 0x01000100) >> 8) * 0xFF;
+    uint32_t selectGreen = ((((aGreen | 0x00010000) - bGreen) & 0x00010000) >> 16) * 0xFF00;
+
+    return (aRedBlue & selectRedBlue) | (bRedBlue & ~selectRedBlue & PIXEL_RED_BLUE_MASK) |
+           (aGreen & selectGreen) | (bGreen & ~selectGreen & PIXEL_GREEN_MASK);
+}
+
+// Per channel (a * b) / 255, rounded so that multiplying by white leaves the other pixel unchanged.
+static inline uint32_t pixelMultiply(uint32_t a, uint32_t b)
+{
+    // Each channel needs its own multiplier so there is no way to share the multiplies across lanes here.
+    uint32_t red = (((a >> 16) & 0xFF) * (((b >> 16) & 0xFF) + 1)) >> 8;
+    uint32_t green = (((a >> 8) & 0xFF) * (((b >> 8) & 0xFF) + 1)) >> 8;
+    uint32_t blue = ((a & 0xFF) * ((b & 0xFF) + 1)) >> 8;
+    return (red << 16) | (green << 8) | blue;
+}
+
+// Per channel linear interpolation from a to b where fraction is in the range 0 (all a) to 256 (all b).
+static inline uint32_t pixelLerp(uint32_t a, uint32_t b, uint32_t fraction)
+{
+    uint32_t inverse = 256 - fraction;
+    uint32_t redBlue = (((a & PIXEL_RED_BLUE_MASK) * inverse + (b & PIXEL_RED_BLUE_MASK) * fraction) >> 8) &
+                       PIXEL_RED_BLUE_MASK;
+    uint32_t green = (((a & PIXEL_GREEN_MASK) * inverse + (b & PIXEL_GREEN_MASK) * fraction) >> 8) &
+                     PIXEL_GREEN_MASK;
+    return redBlue | green;
+}
+
+// Same as above but for RGB16Data pixels so that the fraction of a level is kept.
+static inline void pixelLerp(RGB16Data* pDest, const RGB16Data* pA, const RGB16Data* pB, uint32_t fraction)
+{
+    pDest->red = pA->red + ((((int32_t)pB->red - (int32_t)pA->red) * (int32_t)fraction) >> 8);
+    pDest->green = pA->green + ((((int32_t)pB->green - (int32_t)pA->green) * (int32_t)fraction) >> 8);
+    pDest->blue = pA->blue + ((((int32_t)pB->blue - (int32_t)pA->blue) * (int32_t)fraction) >> 8);
+}
+
+
+
+// Bulk versions of the above for operating on whole arrays of packed pixels.
+static inline void pixelsFill(uint32_t* pDest, size_t pixelCount, uint32_t pixel)
+{
+    while (pixelCount--)
+    {
+        *pDest++ = pixel;
+    }
+}
+
+static inline void pixelsPack(uint32_t* pDest, const RGBData* pSrc, size_t pixelCount)
+{
+    while (pixelCount--)
+    {
+        *pDest++ = packRgb(pSrc++);
+    }
+}
+
+static inline void pixelsPack(uint32_t* pDest, const XRGBData* pSrc, size_t pixelCount)
+{
+    while (pixelCount--)
+    {
+        *pDest++ = packRgb(pSrc++);
+    }
+}
+
+static inline void pixelsPack(uint32_t* pDest, const RGB16Data* pSrc, size_t pixelCount)
+{
+    while (pixelCount--)
+    {
+        *pDest++ = packRgb(pSrc++);
+    }
+}
+
+static inline void pixelsUnpack(RGBData* pDest, const uint32_t* pSrc, size_t pixelCount)
+{
+    while (pixelCount--)
+    {
+        unpackRgb(pDest++, *pSrc++);
+    }
+}
+
+static inline void pixelsUnpack(XRGBData* pDest, const uint32_t* pSrc, size_t pixelCount)
+{
+    while (pixelCount--)
+    {
+        unpackRgb(pDest++, *pSrc++);
+    }
+}
+
+static inline void pixelsAddSaturate(uint32_t* pDest, const uint32_t* pSrc, size_t pixelCount)
+{
+    while (pixelCount--)
+    {
+        *pDest = pixelAddSaturate(*pDest, *pSrc++);
+        pDest++;
+    }
+}
+
+static inline void pixelsScale(uint32_t* pPixels, size_t pixelCount, uint32_t scale)
+{
+    while (pixelCount--)
+    {
+        *pPixels = pixelScale(*pPixels, scale);
+        pPixels++;
+    }
+}
+
+static inline void pixelsFadeToBlack(uint32_t* pPixels, size_t pixelCount, uint32_t decay, uint32_t threshold)
+{
+    while (pixelCount--)
+    {
+        *pPixels = pixelFadeToBlack(*pPixels, decay, threshold);
+        pPixels++;
+    }
+}
+
+// Only fades the pixels whose bit is set in pMask (bit 0 of pMask[0] is the first pixel).
+static inline void pixelsFadeToBlackMasked(uint32_t* pPixels, size_t pixelCount, const uint32_t* pMask,
+                                           uint32_t decay, uint32_t threshold)
+{
+    for (size_t i = 0 ; i < pixelCount ; i += 32)
+    {
+        uint32_t mask = *pMask++;
+        uint32_t* pCurr = pPixels + i;
+        while (mask)
+        {
+            // Jump straight to the next set bit.
+            uint32_t bit = __CLZ(__RBIT(mask));
+            if (i + bit >= pixelCount)
+            {
+                break;
+            }
+            pCurr[bit] = pixelFadeToBlack(pCurr[bit], decay, threshold);
+            mask &= mask - 1;
+        }
+    }
+}
+
+// Versions of the fades which work in place on RGBData or XRGBData pixels. Each pixel is packed, faded and unpacked
+// again, which is just a word load and store for XRGBData.
+template <class PIXEL>
+static inline void pixelsFadeToBlack(PIXEL* pPixels, size_t pixelCount, uint32_t decay, uint32_t threshold)
+{
+    while (pixelCount--)
+    {
+        unpackRgb(pPixels, pixelFadeToBlack(packRgb(pPixels), decay, threshold));
+        pPixels++;
+    }
+}
+
+template <class PIXEL>
+static inline void pixelsFadeToBlackMasked(PIXEL* pPixels, size_t pixelCount, const uint32_t* pMask,
+                                           uint32_t decay, uint32_t threshold)
+{
+    for (size_t i = 0 ; i < pixelCount ; i += 32)
+    {
+        uint32_t mask = *pMask++;
+        PIXEL*   pCurr = pPixels + i;
+        while (mask)
+        {
+            uint32_t bit = __CLZ(__RBIT(mask));
+            if (i + bit >= pixelCount)
+            {
+                break;
+            }
+            unpackRgb(&pCurr[bit], pixelFadeToBlack(packRgb(&pCurr[bit]), decay, threshold));
+            mask &= mask - 1;
+        }
+    }
+}
+
+static inline void pixelsLerp(uint32_t* pDest, const uint32_t* pA, const uint32_t* pB, size_t pixelCount,
+                              uint32_t fraction)
+{
+    while (pixelCount--)
+    {
+        *pDest++ = pixelLerp(*pA++, *pB++, fraction);
+    }
+}
+
+static inline void pixelsLerp(RGB16Data* pDest, const RGB16Data* pA, const RGB16Data* pB, size_t pixelCount,
+                              uint32_t fraction)
+{
+    while (pixelCount--)
+    {
+        pixelLerp(pDest++, pA++, pB++, fraction);
+    }
+}
+
+// Version for RGBData or XRGBData pixels which blends each one in its packed form.
+template <class PIXEL>
+static inline void pixelsLerp(PIXEL* pDest, const PIXEL* pA, const PIXEL* pB, size_t pixelCount, uint32_t fraction)
+{
+    while (pixelCount--)
+    {
+        unpackRgb(pDest++, pixelLerp(packRgb(pA++), packRgb(pB++), fraction));
+    }
+}
+
+#endif // PIXEL_MATH_H_
@@ -0,0 +1,44 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Interface implemented by anything that animations can send their rendered frames to. NeoPixel is the real
+   output but other implementations, like the layers of the Compositor, can capture a frame for further processing. */
+#ifndef PIXEL_SINK_H_
+#define PIXEL_SINK_H_
+
+#include <mbed.h>
+#include "KeyFrame.h"
+#include "Pixel.h"
+
+
+class IPixelSink
+{
+public:
+    virtual void set(const RGBData* pPixels, size_t pixelCount) = 0;
+    virtual void set(const XRGBData* pPixels, size_t pixelCount) = 0;
+    // Sinks that can't show the fraction of a level kept in each channel just round it off.
+    virtual void set(const RGB16Data* pPixels, size_t pixelCount) = 0;
+    // Only updates pixelCount pixels starting at firstPixel. The rest keep the values they were last set to.
+    virtual void setRange(const XRGBData* pPixels, size_t firstPixel, size_t pixelCount) = 0;
+    // Repeats the patternLength entries of pPattern along all pixelCount pixels, shifted patternOffset pixels along
+    // the strand so that pixel i is given pattern entry (i - patternOffset) modulo patternLength.
+    virtual void setPattern(const PixelData* pPattern, size_t patternLength, size_t patternOffset,
+                            size_t pixelCount) = 0;
+    // Hands over a whole sequence of non-interpolated keyframes for the sink to loop through on its own, each frame
+    // shown for its millisecondsBeforeNextFrame. Returns false if the sink can't play them back itself, in which
+    // case the caller should keep sending each frame as it comes due. Any other set call ends the playback.
+    virtual bool setPlaylist(const AnimationKeyFrame* pFrames, size_t frameCount, size_t pixelCount) = 0;
+};
+
+#endif // PIXEL_SINK_H_
@@ -0,0 +1,94 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <cmsis.h>
+#include <stdio.h>
+#include <string.h>
+#include "Profiler.h"
+
+#ifdef PROFILE_CYCLES
+
+static ProfileProbe* g_pProbes;
+
+
+void profileInit(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+void profileRecord(ProfileProbe* pProbe, uint32_t startCycles)
+{
+    uint32_t cycles = DWT->CYCCNT - startCycles;
+
+    if (!pProbe->isRegistered)
+    {
+        // Probes can first fire from interrupt handlers so keep them out while updating the list.
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        {
+            pProbe->pNext = g_pProbes;
+            g_pProbes = pProbe;
+            pProbe->isRegistered = 1;
+        }
+        __set_PRIMASK(primask);
+    }
+
+    pProbe->count++;
+    pProbe->totalCycles += cycles;
+    if (cycles < pProbe->minCycles)
+    {
+        pProbe->minCycles = cycles;
+    }
+    if (cycles > pProbe->maxCycles)
+    {
+        pProbe->maxCycles = cycles;
+    }
+}
+
+void profileDump(void)
+{
+    ProfileProbe* pCurr = g_pProbes;
+
+    printf("probe,count,min,max,mean\n");
+    while (pCurr)
+    {
+        // Take a consistent copy of probes that are updated from interrupt handlers and clear them for the next
+        // interval. printf() is much too slow to call with interrupts disabled.
+        ProfileProbe snapshot;
+        __disable_irq();
+        {
+            snapshot = *pCurr;
+            pCurr->count = 0;
+            pCurr->minCycles = 0xFFFFFFFF;
+            pCurr->maxCycles = 0;
+            pCurr->totalCycles = 0;
+        }
+        __enable_irq();
+
+        if (snapshot.count > 0)
+        {
+            printf("%s,%lu,%lu,%lu,%lu\n",
+                   snapshot.pName,
+                   snapshot.count,
+                   snapshot.minCycles,
+                   snapshot.maxCycles,
+                   (uint32_t)(snapshot.totalCycles / snapshot.count));
+        }
+        pCurr = snapshot.pNext;
+    }
+}
+
+#endif // PROFILE_CYCLES
@@ -0,0 +1,127 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Lightweight cycle count profiler based on the Cortex-M3 DWT CYCCNT register.
+   Each probe keeps the count, minimum, maximum, and total number of cycles spent between its begin and end. The
+   probes add themselves to a list the first time they fire so there is no need to register them up front. Everything
+   compiles away unless PROFILE_CYCLES is defined (see the makefile).
+
+   From C++:
+       PROFILE_SCOPE(name);         // Times from here to the end of the enclosing scope.
+   From C:
+       PROFILE_BEGIN(name);
+       ...
+       PROFILE_END(name);
+*/
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <cmsis.h>
+#include <stdint.h>
+
+
+typedef struct ProfileProbe
+{
+    const char*          pName;
+    struct ProfileProbe* pNext;
+    uint32_t             count;
+    uint32_t             minCycles;
+    uint32_t             maxCycles;
+    uint64_t             totalCycles;
+    int                  isRegistered;
+} ProfileProbe;
+
+#define PROFILE_PROBE_INITIALIZER(NAME) { NAME, NULL, 0, 0xFFFFFFFF, 0, 0, 0 }
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifdef PROFILE_CYCLES
+
+// Starts the DWT cycle counter. Call once at startup before any of the probes fire.
+void profileInit(void);
+// Prints the statistics for each probe that has fired, as CSV lines, and then clears them for the next interval:
+//     probe,count,min,max,mean
+void profileDump(void);
+void profileRecord(ProfileProbe* pProbe, uint32_t startCycles);
+
+static __INLINE uint32_t profileCycles(void)
+{
+    return DWT->CYCCNT;
+}
+
+#define PROFILE_BEGIN(NAME) \
+    static ProfileProbe profileProbe_##NAME = PROFILE_PROBE_INITIALIZER(#NAME); \
+    uint32_t            profileStart_##NAME = profileCycles()
+#define PROFILE_END(NAME) \
+    profileRecord(&profileProbe_##NAME, profileStart_##NAME)
+
+#else
+
+static __INLINE void profileInit(void)
+{
+}
+
+static __INLINE void profileDump(void)
+{
+}
+
+#define PROFILE_BEGIN(NAME)
+#define PROFILE_END(NAME)
+
+#endif // PROFILE_CYCLES
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#ifdef __cplusplus
+
+#ifdef PROFILE_CYCLES
+
+class ScopedProbe
+{
+public:
+    ScopedProbe(ProfileProbe* pProbe)
+    {
+        m_pProbe = pProbe;
+        m_startCycles = profileCycles();
+    }
+    ~ScopedProbe()
+    {
+        profileRecord(m_pProbe, m_startCycles);
+    }
+
+protected:
+    ProfileProbe* m_pProbe;
+    uint32_t      m_startCycles;
+};
+
+#define PROFILE_SCOPE(NAME) \
+    static ProfileProbe profileProbe_##NAME = PROFILE_PROBE_INITIALIZER(#NAME); \
+    ScopedProbe         scopedProbe_##NAME(&profileProbe_##NAME)
+
+#else
+
+#define PROFILE_SCOPE(NAME)
+
+#endif // PROFILE_CYCLES
+
+#endif // __cplusplus
+
+#endif // PROFILER_H_
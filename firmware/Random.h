@@ -0,0 +1,108 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Small and fast xorshift32 pseudo random number generator. Each animation owns its own instance so that a given
+   seed always produces the same sequence of frames. */
+#ifndef RANDOM_H_
+#define RANDOM_H_
+
+#include <mbed.h>
+
+
+class Random
+{
+public:
+    Random(uint32_t seed = DEFAULT_SEED)
+    {
+        setSeed(seed);
+    }
+
+    void setSeed(uint32_t seed)
+    {
+        // xorshift gets stuck at 0 so never allow it as a state.
+        m_state = seed ? seed : (uint32_t)DEFAULT_SEED;
+    }
+
+    // Returns 32 uniformly distributed random bits.
+    uint32_t next()
+    {
+        uint32_t x = m_state;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        m_state = x;
+        return x;
+    }
+
+    // Returns a value in the range [0, range) without the bias that would come from using modulo.
+    // Uses Lemire's multiply and shift method which only needs a UMULL in the common case.
+    uint32_t nextBounded(uint32_t range)
+    {
+        uint64_t product = (uint64_t)next() * range;
+        uint32_t low = (uint32_t)product;
+        if (low < range)
+        {
+            uint32_t threshold = (0 - range) % range;
+            while (low < threshold)
+            {
+                product = (uint64_t)next() * range;
+                low = (uint32_t)product;
+            }
+        }
+        return (uint32_t)(product >> 32);
+    }
+
+    // Returns a value in the range [min, max). Returns min when the range is empty.
+    uint32_t nextInRange(uint32_t min, uint32_t max)
+    {
+        if (max <= min)
+        {
+            return min;
+        }
+        return min + nextBounded(max - min);
+    }
+
+    // Returns 32 random bits where each bit is independently set with a probability of probability/256.
+    // Costs one next() call per set bit of probability rather than one call per output bit.
+    uint32_t nextMask(uint32_t probability)
+    {
+        if (probability >= 256)
+        {
+            return 0xFFFFFFFF;
+        }
+
+        // Walk the bits of probability from least to most significant. ORing in a fresh random word maps a
+        // probability p to (1+p)/2 and ANDing maps it to p/2 so this builds up the binary fraction probability/256.
+        uint32_t mask = 0;
+        for (int i = 0 ; i < 8 ; i++)
+        {
+            if (probability & (1 << i))
+            {
+                mask |= next();
+            }
+            else if (mask != 0)
+            {
+                mask &= next();
+            }
+        }
+        return mask;
+    }
+
+protected:
+    enum { DEFAULT_SEED = 0x2545F491 };
+
+    uint32_t m_state;
+};
+
+#endif // RANDOM_H_
@@ -0,0 +1,139 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Lock-free ring buffer for handing items from a single producer (the main loop) to a single consumer (an interrupt
+   handler), or the other way around. The producer only ever moves the tail and the consumer only ever moves the head
+   so neither side has to wait for or lock out the other.
+
+   SpscRingBase just keeps track of which slots are full so that it can be used with slots whose storage is owned by
+   someone else. SpscRing<T, SIZE> adds the storage for SIZE items of type T. */
+#ifndef SPSC_RING_H_
+#define SPSC_RING_H_
+
+#include <mbed.h>
+#include "Atomic.h"
+
+
+class SpscRingBase
+{
+public:
+    SpscRingBase(uint32_t capacity)
+    {
+        m_capacity = capacity;
+        m_wrap = capacity * 2;
+    }
+
+    uint32_t getCapacity() const
+    {
+        return m_capacity;
+    }
+
+    // Producer methods.
+    bool isFull() const
+    {
+        return getReadCount() >= m_capacity;
+    }
+    // Slot to be filled in next. Only valid when the ring isn't full.
+    uint32_t getWriteSlot() const
+    {
+        return slotFromPosition(m_tail.load());
+    }
+    // Hands the slot from getWriteSlot() over to the consumer. Everything written to the slot before this call will be
+    // seen by the consumer.
+    void commitWrite()
+    {
+        m_tail.store(advancePosition(m_tail.load(), 1));
+    }
+
+    // Consumer methods.
+    // Number of full slots.
+    uint32_t getReadCount() const
+    {
+        return advancePosition(m_tail.load(), m_wrap - m_head.load());
+    }
+    // Slot holding the offset'th oldest item. offset must be less than getReadCount().
+    uint32_t getReadSlot(uint32_t offset = 0) const
+    {
+        return slotFromPosition(advancePosition(m_head.load(), offset));
+    }
+    // Hands the count oldest slots back to the producer. The consumer can hold on to slots after reading them, for as
+    // long as it still needs their contents, by delaying this call.
+    void commitRead(uint32_t count = 1)
+    {
+        m_head.store(advancePosition(m_head.load(), count));
+    }
+
+    // Empties the ring. Isn't atomic with respect to the other side so it must be stopped, by disabling its interrupt
+    // for example, while this is called.
+    void clear()
+    {
+        m_head.store(m_tail.load());
+    }
+
+protected:
+    uint32_t advancePosition(uint32_t position, uint32_t count) const
+    {
+        position += count;
+        return position >= m_wrap ? position - m_wrap : position;
+    }
+    uint32_t slotFromPosition(uint32_t position) const
+    {
+        return position >= m_capacity ? position - m_capacity : position;
+    }
+
+    // The head and tail positions run from 0 to twice the capacity so that a full ring can be told apart from an
+    // empty one without wasting a slot.
+    Atomic<uint32_t> m_head;
+    Atomic<uint32_t> m_tail;
+    uint32_t         m_capacity;
+    uint32_t         m_wrap;
+};
+
+
+template <class T, uint32_t SIZE>
+class SpscRing : public SpscRingBase
+{
+public:
+    SpscRing() : SpscRingBase(SIZE)
+    {
+    }
+
+    // Returns false if the ring is full.
+    bool push(const T& item)
+    {
+        if (isFull())
+        {
+            return false;
+        }
+        m_items[getWriteSlot()] = item;
+        commitWrite();
+        return true;
+    }
+    // Returns false if the ring is empty.
+    bool pop(T* pItem)
+    {
+        if (getReadCount() == 0)
+        {
+            return false;
+        }
+        *pItem = m_items[getReadSlot()];
+        commitRead();
+        return true;
+    }
+
+protected:
+    T m_items[SIZE];
+};
+
+#endif // SPSC_RING_H_
@@ -0,0 +1,80 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <mbed.h>
+#include <us_ticker_api.h>
+#include "TickSource.h"
+
+
+static ITickSource* g_pTickSource;
+
+
+HardwareTickSource::HardwareTickSource()
+{
+    m_microseconds = 0;
+    m_milliseconds = 0;
+    m_microsecondRemainder = 0;
+    m_lastTicker = us_ticker_read();
+}
+
+uint64_t HardwareTickSource::readMicroseconds()
+{
+    update();
+    return m_microseconds;
+}
+
+uint64_t HardwareTickSource::readMilliseconds()
+{
+    update();
+    return m_milliseconds;
+}
+
+void HardwareTickSource::update()
+{
+    // Can be read from both thread and interrupt context so don't let the 64-bit counters tear.
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    {
+        uint32_t currTicker = us_ticker_read();
+        uint32_t delta = currTicker - m_lastTicker;
+        m_lastTicker = currTicker;
+
+        // Accumulate milliseconds separately, carrying the sub-millisecond remainder forward, so that reading the
+        // millisecond count doesn't require a 64-bit divide.
+        m_microseconds += delta;
+        m_microsecondRemainder += delta;
+        m_milliseconds += m_microsecondRemainder / 1000;
+        m_microsecondRemainder %= 1000;
+    }
+    __set_PRIMASK(primask);
+}
+
+
+
+void setTickSource(ITickSource* pTickSource)
+{
+    g_pTickSource = pTickSource;
+}
+
+ITickSource* getTickSource()
+{
+    // Constructed on first use so that it is valid even when read from other static constructors (ie. Encoder).
+    static HardwareTickSource hardwareTickSource;
+
+    if (g_pTickSource)
+    {
+        return g_pTickSource;
+    }
+    return &hardwareTickSource;
+}
@@ -0,0 +1,103 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Shared monotonic 64-bit time base used by the animations, encoders and main loop. */
+#ifndef TICK_SOURCE_H_
+#define TICK_SOURCE_H_
+
+#include <mbed.h>
+
+
+class ITickSource
+{
+public:
+    virtual uint64_t readMicroseconds() = 0;
+    virtual uint64_t readMilliseconds() = 0;
+};
+
+
+// Extends the 32-bit microsecond us_ticker to 64-bits. The underlying counter wraps every ~71 minutes so it must be
+// read at least that often to catch every wrap (the main loop reads it continuously).
+class HardwareTickSource : public ITickSource
+{
+public:
+    HardwareTickSource();
+
+    // ITickSource methods.
+    virtual uint64_t readMicroseconds();
+    virtual uint64_t readMilliseconds();
+
+protected:
+    void update();
+
+    uint64_t m_microseconds;
+    uint64_t m_milliseconds;
+    uint32_t m_lastTicker;
+    uint32_t m_microsecondRemainder;
+};
+
+
+// Time only moves when the owner advances it. Install it with setTickSource() to run the animations against
+// simulated time, fast-forwarding through days of animation in seconds.
+class ManualTickSource : public ITickSource
+{
+public:
+    ManualTickSource(uint64_t startMicroseconds = 0)
+    {
+        m_microseconds = startMicroseconds;
+    }
+
+    void setMicroseconds(uint64_t microseconds)
+    {
+        m_microseconds = microseconds;
+    }
+    void advanceMicroseconds(uint64_t microseconds)
+    {
+        m_microseconds += microseconds;
+    }
+    void advanceMilliseconds(uint64_t milliseconds)
+    {
+        m_microseconds += milliseconds * 1000;
+    }
+
+    // ITickSource methods.
+    virtual uint64_t readMicroseconds()
+    {
+        return m_microseconds;
+    }
+    virtual uint64_t readMilliseconds()
+    {
+        return m_microseconds / 1000;
+    }
+
+protected:
+    uint64_t m_microseconds;
+};
+
+
+// Switch the global time base. Passing NULL restores the hardware based tick source.
+void         setTickSource(ITickSource* pTickSource);
+ITickSource* getTickSource();
+
+static inline uint64_t tickMicroseconds()
+{
+    return getTickSource()->readMicroseconds();
+}
+
+static inline uint64_t tickMilliseconds()
+{
+    return getTickSource()->readMilliseconds();
+}
+
+#endif // TICK_SOURCE_H_
@@ -0,0 +1,71 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <cmsis.h>
+#include <stdio.h>
+#include <us_ticker_api.h>
+#include "Interlock.h"
+#include "Trace.h"
+
+#ifdef TRACE_EVENTS
+
+static TraceEvent        g_traceEvents[TRACE_EVENT_COUNT];
+static volatile uint32_t g_traceIndex;
+static volatile int      g_isTracePaused;
+
+
+void traceRecord(TraceEventId id, uint32_t arg)
+{
+    if (g_isTracePaused)
+    {
+        return;
+    }
+
+    // Claiming the slot atomically means that an interrupt which records its own event part way through this one
+    // just takes the next slot rather than both landing in the same one. The decoder sorts on the timestamps.
+    uint32_t    index = interlockedIncrement(&g_traceIndex) - 1;
+    TraceEvent* pEvent = &g_traceEvents[index & (TRACE_EVENT_COUNT - 1)];
+
+    pEvent->timestamp = us_ticker_read();
+    pEvent->arg = arg;
+    pEvent->id = id;
+    pEvent->reserved = 0;
+}
+
+void traceDump(void)
+{
+    // Stop the interrupt handlers from overwriting the events while they are slowly being sent out.
+    g_isTracePaused = 1;
+
+    uint32_t        totalCount = g_traceIndex;
+    uint32_t        eventCount = totalCount < TRACE_EVENT_COUNT ? totalCount : TRACE_EVENT_COUNT;
+    TraceDumpHeader header;
+
+    header.signature = TRACE_DUMP_SIGNATURE;
+    header.version = TRACE_DUMP_VERSION;
+    header.eventSize = sizeof(TraceEvent);
+    header.eventCount = eventCount;
+    header.lostCount = totalCount - eventCount;
+    fwrite(&header, sizeof(header), 1, stdout);
+    for (uint32_t i = totalCount - eventCount ; i != totalCount ; i++)
+    {
+        fwrite(&g_traceEvents[i & (TRACE_EVENT_COUNT - 1)], sizeof(TraceEvent), 1, stdout);
+    }
+    fflush(stdout);
+
+    g_traceIndex = 0;
+    g_isTracePaused = 0;
+}
+
+#endif // TRACE_EVENTS
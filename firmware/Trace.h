@@ -0,0 +1,107 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Event trace buffer used to track down hard to reproduce stutters.
+   Each event is a timestamp, an id and a 16-bit argument stored in a fixed size ring buffer in RAM. Recording an
+   event only takes a few dozen cycles and is safe from both thread and interrupt context so the buffer can show
+   whether a hitch came from the DMA interrupt handlers, the encoder handling or the animation code. The ring holds
+   the most recent TRACE_EVENT_COUNT events and is sent out over the serial port in binary by traceDump(). The
+   tools/trace_decode.py script turns that dump back into a timeline. Everything compiles away unless TRACE_EVENTS is
+   defined (see the makefile).
+
+       TRACE(TRACE_FLIP, frameId);
+*/
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <cmsis.h>
+#include <stdint.h>
+
+
+// Events recorded in the trace. The meaning of the 16-bit argument is given for each one.
+// The decoder in tools/trace_decode.py has a matching table so only ever add new events to the end.
+typedef enum TraceEventId
+{
+    TRACE_SET_START = 0,        // set*() called on the driver. arg: first pixel being updated.
+    TRACE_SET_END,              // set*() returned. arg: lower 16 bits of the frame id that was committed.
+    TRACE_FLIP,                 // Front buffers flipped at the end of a frame. arg: lower 16 bits of the flip count.
+    TRACE_BACK_BUFFER_FREE,     // Finished copying a frame into a front buffer. arg: unused.
+    TRACE_MEMCOPY_START,        // DMA memory copy started. arg: byte count.
+    TRACE_MEMCOPY_DONE,         // DMA memory copy completed. arg: unused.
+    TRACE_MEMCOPY_FALLBACK,     // DMA channel was busy so the CPU did the copy. arg: byte count.
+    TRACE_ENCODER_TURN,         // Encoder rotated. arg: encoder index in upper byte, signed detent count in lower.
+    TRACE_ENCODER_PRESS,        // Encoder shaft pressed. arg: encoder index.
+    TRACE_ANIMATION_SWITCH,     // New animation selected. arg: animation index.
+    TRACE_PLAYLIST_FRAME,       // Playlist moved on to a new frame. arg: playlist index.
+    TRACE_EVENT_ID_COUNT
+} TraceEventId;
+
+// Layout of each event in RAM and in the binary dump. Stored in the little endian format used by the Cortex-M3.
+typedef struct TraceEvent
+{
+    uint32_t timestamp;         // us_ticker_read() time at which the event was recorded.
+    uint16_t arg;
+    uint8_t  id;
+    uint8_t  reserved;
+} TraceEvent;
+
+// The binary dump is this header followed by eventCount TraceEvent structures from oldest to newest.
+#define TRACE_DUMP_SIGNATURE    0x5254504E  // "NPTR" when sent out in little endian order.
+#define TRACE_DUMP_VERSION      1
+
+typedef struct TraceDumpHeader
+{
+    uint32_t signature;
+    uint16_t version;
+    uint16_t eventSize;
+    uint32_t eventCount;
+    // Number of older events which were overwritten before this dump.
+    uint32_t lostCount;
+} TraceDumpHeader;
+
+// Must be a power of 2.
+#ifndef TRACE_EVENT_COUNT
+#define TRACE_EVENT_COUNT       512
+#endif
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifdef TRACE_EVENTS
+
+// Writes the contents of the trace buffer to stdout in the binary format described above and then empties it.
+// Recording is paused while the dump is being sent.
+void traceDump(void);
+void traceRecord(TraceEventId id, uint32_t arg);
+
+#define TRACE(ID, ARG) traceRecord(ID, ARG)
+
+#else
+
+static __INLINE void traceDump(void)
+{
+}
+
+#define TRACE(ID, ARG)
+
+#endif // TRACE_EVENTS
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TRACE_H_
@@ -0,0 +1,106 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "TreeGeometry.h"
+
+
+// Models the tree as 9 levels with 10, 9, 8, 7, 6, 4, 3, 2, and 1 branches from the bottom up, one LED at the tip of
+// each branch. The strand starts at the bottom level and runs around each level before climbing to the next, reversing
+// direction on every other level. Branches alternate between long and short, the longer ones drooping a bit lower,
+// and the branches on each level are staggered from those on the level below. The sorted lists below are generated
+// from this table by tools/tree_sort.py so rerun it after any change here.
+const TreeLedPosition g_treeLedPositions[TREE_LED_COUNT] =
+{
+    // level, angle, height, radius
+    { 0,   0,   0, 255 }, //  0
+    { 0,  26,   6, 204 }, //  1
+    { 0,  51,   0, 255 }, //  2
+    { 0,  77,   6, 204 }, //  3
+    { 0, 102,   0, 255 }, //  4
+    { 0, 128,   6, 204 }, //  5
+    { 0, 154,   0, 255 }, //  6
+    { 0, 179,   6, 204 }, //  7
+    { 0, 205,   0, 255 }, //  8
+    { 0, 230,   6, 204 }, //  9
+    { 1,   9,  31, 227 }, // 10
+    { 1, 236,  37, 181 }, // 11
+    { 1, 208,  31, 227 }, // 12
+    { 1, 179,  37, 181 }, // 13
+    { 1, 151,  31, 227 }, // 14
+    { 1, 122,  37, 181 }, // 15
+    { 1,  94,  31, 227 }, // 16
+    { 1,  65,  37, 181 }, // 17
+    { 1,  37,  31, 227 }, // 18
+    { 2,  74,  63, 198 }, // 19
+    { 2, 106,  68, 159 }, // 20
+    { 2, 138,  63, 198 }, // 21
+    { 2, 170,  68, 159 }, // 22
+    { 2, 202,  63, 198 }, // 23
+    { 2, 234,  68, 159 }, // 24
+    { 2,  10,  63, 198 }, // 25
+    { 2,  42,  68, 159 }, // 26
+    { 3,  74,  94, 170 }, // 27
+    { 3,  38,  98, 136 }, // 28
+    { 3,   1,  94, 170 }, // 29
+    { 3, 221,  98, 136 }, // 30
+    { 3, 184,  94, 170 }, // 31
+    { 3, 148,  98, 136 }, // 32
+    { 3, 111,  94, 170 }, // 33
+    { 4, 148, 126, 142 }, // 34
+    { 4, 191, 129, 113 }, // 35
+    { 4, 233, 126, 142 }, // 36
+    { 4,  20, 129, 113 }, // 37
+    { 4,  63, 126, 142 }, // 38
+    { 4, 105, 129, 113 }, // 39
+    { 5, 121, 160,  91 }, // 40
+    { 5,  57, 157, 113 }, // 41
+    { 5, 249, 160,  91 }, // 42
+    { 5, 185, 157, 113 }, // 43
+    { 6, 222, 189,  85 }, // 44
+    { 6,  51, 191,  68 }, // 45
+    { 6, 137, 189,  85 }, // 46
+    { 7, 131, 222,  45 }, // 47
+    { 7,   3, 220,  57 }, // 48
+    { 8,  40, 255,   0 }  // 49
+};
+
+// LED indices sorted from the bottom of the tree to the top.
+const uint16_t g_treeLedsByHeight[TREE_LED_COUNT] =
+{
+     0,  2,  4,  6,  8,  1,  3,  5,  7,  9,
+    10, 18, 16, 14, 12, 17, 15, 13, 11, 25,
+    19, 21, 23, 26, 20, 22, 24, 29, 27, 33,
+    31, 28, 32, 30, 38, 34, 36, 37, 39, 35,
+    41, 43, 40, 42, 46, 44, 45, 48, 47, 49
+};
+
+// LED indices sorted by angle around the trunk.
+const uint16_t g_treeLedsByAngle[TREE_LED_COUNT] =
+{
+     0, 29, 48, 10, 25, 37,  1, 18, 28, 49,
+    26,  2, 45, 41, 38, 17, 19, 27,  3, 16,
+     4, 39, 20, 33, 40, 15,  5, 47, 46, 21,
+    32, 34, 14,  6, 22,  7, 13, 31, 43, 35,
+    23,  8, 12, 30, 44,  9, 36, 24, 11, 42
+};
+
+// LED indices sorted from the trunk out to the tips of the branches.
+const uint16_t g_treeLedsByRadius[TREE_LED_COUNT] =
+{
+    49, 47, 48, 45, 44, 46, 40, 42, 35, 37,
+    39, 41, 43, 28, 30, 32, 34, 36, 38, 20,
+    22, 24, 26, 27, 29, 31, 33, 11, 13, 15,
+    17, 19, 21, 23, 25,  1,  3,  5,  7,  9,
+    10, 12, 14, 16, 18,  0,  2,  4,  6,  8
+};
@@ -0,0 +1,47 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Physical location of each LED on the tree so that effects can sweep across the tree in physical space rather than
+   following the strand as it zigzags from branch to branch. */
+#ifndef TREE_GEOMETRY_H_
+#define TREE_GEOMETRY_H_
+
+#include <mbed.h>
+
+
+// Number of LEDs described by the tables below. Must match the length of the strand.
+#define TREE_LED_COUNT      50
+
+struct TreeLedPosition
+{
+    // Level of the tree (trunk board) that the LED's branch is attached to. 0 is the bottom level.
+    uint8_t level;
+    // Angle of the branch around the trunk where 256 would be a full turn.
+    uint8_t angle;
+    // Height of the LED from the lowest (0) to the highest (255) LED on the tree.
+    uint8_t height;
+    // Distance of the LED from the trunk from 0 (on the trunk) to 255 (tip of the longest branch).
+    uint8_t radius;
+};
+
+// Indexed by the LED's position in the strand.
+extern const TreeLedPosition g_treeLedPositions[TREE_LED_COUNT];
+
+// Strand indices of the LEDs pre-sorted along each physical axis. Passing one of these to an animation which accepts
+// a pixel order lets it sweep along that axis with no sorting at runtime.
+extern const uint16_t g_treeLedsByHeight[TREE_LED_COUNT];
+extern const uint16_t g_treeLedsByAngle[TREE_LED_COUNT];
+extern const uint16_t g_treeLedsByRadius[TREE_LED_COUNT];
+
+#endif // TREE_GEOMETRY_H_
@@ -0,0 +1,94 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Lock-free triple buffer used to hand complete frames from a single writer (the main loop) to a single reader (an
+   interrupt handler). There are always three buffers in play: one owned by the writer, one owned by the reader and
+   one shared between them. The writer publishes a buffer by swapping it with the shared one and the reader picks up
+   the newest published buffer by swapping its own with the shared one. A flag is kept alongside the index of the
+   shared buffer to tell the reader if it holds a frame that it hasn't seen yet. Both swaps are a single atomic
+   exchange() so neither side ever has to wait for the other and the writer always has a free buffer. If
+   the writer publishes faster than the reader can keep up, the older frames are just dropped. */
+#ifndef TRIPLE_BUFFER_H_
+#define TRIPLE_BUFFER_H_
+
+#include <mbed.h>
+#include "Atomic.h"
+
+
+class TripleBuffer
+{
+public:
+    enum { BUFFER_COUNT = 3 };
+
+    TripleBuffer()
+    {
+        m_writeIndex = 0;
+        m_shared.store(1);
+        m_readIndex = 2;
+    }
+
+    // Writer methods.
+    // Index of the buffer that the writer is free to fill in. The reader will never touch it.
+    uint32_t getWriteIndex() const
+    {
+        return m_writeIndex;
+    }
+    // Makes the write buffer available to the reader as the newest frame and returns the index of the buffer to be
+    // written next. That buffer holds an older frame which was either already read or was dropped in favour of this
+    // one.
+    uint32_t publish()
+    {
+        uint32_t prevShared = m_shared.exchange(m_writeIndex | FRESH_FLAG);
+        m_writeIndex = prevShared & INDEX_MASK;
+        return m_writeIndex;
+    }
+
+    // Reader methods.
+    // Index of the buffer that the reader is free to read from. The writer will never touch it.
+    uint32_t getReadIndex() const
+    {
+        return m_readIndex;
+    }
+    // Swaps the read buffer for the newest published one. Returns false and keeps the current read buffer if nothing
+    // has been published since the last call.
+    bool fetch()
+    {
+        // Only the reader ever clears the flag so once it is seen to be set it will stay set until the exchange below.
+        if ((m_shared.load() & FRESH_FLAG) == 0)
+        {
+            return false;
+        }
+        uint32_t prevShared = m_shared.exchange(m_readIndex);
+        m_readIndex = prevShared & INDEX_MASK;
+        return true;
+    }
+    // Throws away any published buffer that hasn't been fetched yet.
+    void discard()
+    {
+        m_shared.fetchAnd(INDEX_MASK);
+    }
+
+protected:
+    enum
+    {
+        INDEX_MASK = 0x3,
+        FRESH_FLAG = 0x4
+    };
+
+    uint32_t         m_writeIndex;
+    uint32_t         m_readIndex;
+    Atomic<uint32_t> m_shared;
+};
+
+#endif // TRIPLE_BUFFER_H_
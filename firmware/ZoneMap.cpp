@@ -0,0 +1,176 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <assert.h>
+#include <mbed.h>
+#include "PixelMath.h"
+#include "TickSource.h"
+#include "ZoneMap.h"
+
+
+ZoneMapBase::ZoneMapBase()
+{
+    m_pFramePixels = NULL;
+    m_pixelCount = 0;
+    m_zoneCount = 0;
+    m_isFullUpdateNeeded = true;
+}
+
+bool ZoneMapBase::addZone(IPixelUpdate* pSource, size_t firstPixel, size_t pixelCount,
+                          uint32_t updateMilliseconds, uint8_t brightness)
+{
+    if (m_zoneCount >= MAX_ZONES || firstPixel + pixelCount > m_pixelCount)
+    {
+        return false;
+    }
+
+    Zone* pZone = &m_zones[m_zoneCount++];
+    pZone->pSource = pSource;
+    pZone->pPixels = &m_pFramePixels[firstPixel];
+    pZone->firstPixel = firstPixel;
+    pZone->pixelCount = pixelCount;
+    pZone->nextUpdate = 0;
+    pZone->updateInterval = updateMilliseconds;
+    // Scale brightness to 0 - 256 so that 255 leaves the pixels untouched.
+    pZone->brightness = brightness + (brightness >> 7);
+    pZone->isChanged = false;
+
+    // Pixels not covered by any zone are left black.
+    m_isFullUpdateNeeded = true;
+    return true;
+}
+
+void ZoneMapBase::clearZones()
+{
+    m_zoneCount = 0;
+    memset(m_pFramePixels, 0, sizeof(*m_pFramePixels) * m_pixelCount);
+    m_isFullUpdateNeeded = true;
+}
+
+void ZoneMapBase::updatePixels(IPixelSink& ledControl)
+{
+    uint64_t currTime = tickMilliseconds();
+    size_t   dirtyStart = m_pixelCount;
+    size_t   dirtyEnd = 0;
+
+    for (size_t i = 0 ; i < m_zoneCount ; i++)
+    {
+        Zone* pZone = &m_zones[i];
+        if (currTime < pZone->nextUpdate)
+        {
+            continue;
+        }
+        if (pZone->updateInterval == UPDATE_ONCE)
+        {
+            pZone->nextUpdate = ~0ULL;
+        }
+        else
+        {
+            // Schedule relative to the previous deadline so that loop latency doesn't accumulate as drift. If the
+            // loop stalled for more than a whole interval then resynchronize rather than bursting to catch up.
+            pZone->nextUpdate += pZone->updateInterval;
+            if (pZone->nextUpdate <= currTime)
+            {
+                pZone->nextUpdate = currTime + pZone->updateInterval;
+            }
+        }
+
+        pZone->isChanged = false;
+        pZone->pSource->updatePixels(*pZone);
+        if (pZone->isChanged)
+        {
+            if (pZone->firstPixel < dirtyStart)
+            {
+                dirtyStart = pZone->firstPixel;
+            }
+            if (pZone->firstPixel + pZone->pixelCount > dirtyEnd)
+            {
+                dirtyEnd = pZone->firstPixel + pZone->pixelCount;
+            }
+        }
+    }
+
+    if (m_isFullUpdateNeeded)
+    {
+        ledControl.set(m_pFramePixels, m_pixelCount);
+        m_isFullUpdateNeeded = false;
+    }
+    else if (dirtyStart < dirtyEnd)
+    {
+        // Only re-encode the span of LEDs covering the zones which actually changed.
+        ledControl.setRange(&m_pFramePixels[dirtyStart], dirtyStart, dirtyEnd - dirtyStart);
+    }
+}
+
+
+
+void ZoneMapBase::Zone::set(const RGBData* pSrc, size_t srcPixelCount)
+{
+    assert ( srcPixelCount == pixelCount );
+    for (size_t i = 0 ; i < pixelCount ; i++)
+    {
+        pPixels[i].xrgb = pixelScale(packRgb(pSrc++), brightness);
+    }
+    isChanged = true;
+}
+
+void ZoneMapBase::Zone::set(const XRGBData* pSrc, size_t srcPixelCount)
+{
+    assert ( srcPixelCount == pixelCount );
+    setRange(pSrc, 0, srcPixelCount);
+}
+
+void ZoneMapBase::Zone::set(const RGB16Data* pSrc, size_t srcPixelCount)
+{
+    assert ( srcPixelCount == pixelCount );
+    for (size_t i = 0 ; i < pixelCount ; i++)
+    {
+        pPixels[i].xrgb = pixelScale(packRgb(pSrc++), brightness);
+    }
+    isChanged = true;
+}
+
+void ZoneMapBase::Zone::setRange(const XRGBData* pSrc, size_t first, size_t srcPixelCount)
+{
+    assert ( first + srcPixelCount <= pixelCount );
+    for (size_t i = first ; i < first + srcPixelCount ; i++)
+    {
+        pPixels[i].xrgb = pixelScale(packRgb(pSrc++), brightness);
+    }
+    isChanged = true;
+}
+
+void ZoneMapBase::Zone::setPattern(const PixelData* pPattern, size_t patternLength, size_t patternOffset,
+                                   size_t srcPixelCount)
+{
+    assert ( srcPixelCount == pixelCount );
+    assert ( patternLength > 0 );
+
+    size_t entry = (patternLength - patternOffset % patternLength) % patternLength;
+    for (size_t i = 0 ; i < pixelCount ; i++)
+    {
+        pPixels[i].xrgb = pixelScale(packRgb(&pPattern[entry]), brightness);
+        if (++entry >= patternLength)
+        {
+            entry = 0;
+        }
+    }
+    isChanged = true;
+}
+
+bool ZoneMapBase::Zone::setPlaylist(const AnimationKeyFrame* pFrames, size_t frameCount, size_t srcPixelCount)
+{
+    // Every frame needs to be scaled on the CPU so the source must keep sending its frames one at a time.
+    return false;
+}
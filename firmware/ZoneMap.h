@@ -0,0 +1,89 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Splits the LED strand into zones (ie. the levels of the tree) with each zone running its own animation. */
+#ifndef ZONE_MAP_H_
+#define ZONE_MAP_H_
+
+#include <mbed.h>
+#include "Animation.h"
+#include "PixelSink.h"
+
+
+class ZoneMapBase : public IPixelUpdate
+{
+public:
+    // Pass this as the update interval for zones which never change after their first frame. Their animation is only
+    // run once so they cost nothing on later ticks.
+    enum { UPDATE_ONCE = 0xFFFFFFFF };
+
+    // The animation for a zone should be sized for pixelCount pixels. It is run no more often than every
+    // updateMilliseconds (0 to run it every tick) and its output is scaled by brightness (255 for full brightness).
+    // Returns false if all zones are in use or the range doesn't fit in the strand.
+    bool addZone(IPixelUpdate* pSource, size_t firstPixel, size_t pixelCount,
+                 uint32_t updateMilliseconds, uint8_t brightness = 255);
+    void clearZones();
+
+    // IPixelUpdate methods.
+    virtual void updatePixels(IPixelSink& ledControl);
+
+protected:
+    ZoneMapBase();
+
+    // Captures the frames sent by a zone's animation into its slice of the shared frame.
+    class Zone : public IPixelSink
+    {
+    public:
+        // IPixelSink methods.
+        virtual void set(const RGBData* pPixels, size_t pixelCount);
+        virtual void set(const XRGBData* pPixels, size_t pixelCount);
+        virtual void set(const RGB16Data* pPixels, size_t pixelCount);
+        virtual void setRange(const XRGBData* pPixels, size_t firstPixel, size_t pixelCount);
+        virtual void setPattern(const PixelData* pPattern, size_t patternLength, size_t patternOffset,
+                                size_t pixelCount);
+        virtual bool setPlaylist(const AnimationKeyFrame* pFrames, size_t frameCount, size_t pixelCount);
+
+        IPixelUpdate* pSource;
+        XRGBData*     pPixels;
+        size_t        firstPixel;
+        size_t        pixelCount;
+        uint64_t      nextUpdate;
+        uint32_t      updateInterval;
+        uint32_t      brightness;
+        bool          isChanged;
+    };
+    enum { MAX_ZONES = 8 };
+
+    Zone        m_zones[MAX_ZONES];
+    XRGBData*   m_pFramePixels;
+    size_t      m_pixelCount;
+    size_t      m_zoneCount;
+    bool        m_isFullUpdateNeeded;
+};
+
+template <size_t PIXEL_COUNT>
+class ZoneMap : public ZoneMapBase
+{
+public:
+    ZoneMap()
+    {
+        m_pixelCount = PIXEL_COUNT;
+        m_pFramePixels = m_framePixels;
+    }
+
+protected:
+    XRGBData m_framePixels[PIXEL_COUNT];
+};
+
+#endif // ZONE_MAP_H_
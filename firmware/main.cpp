@@ -13,14 +13,49 @@
    limitations under the License.
 */
 #include <mbed.h>
+#include <new>
+#include <us_ticker_api.h>
 #include "Animation.h"
+#include "Benchmark.h"
+#include "Compositor.h"
 #include "Encoders.h"
+#include "FrameInterpolator.h"
+#include "InputLatency.h"
 #include "NeoPixel.h"
+#include "Profiler.h"
+#include "TickSource.h"
+#include "Trace.h"
+#include "TreeGeometry.h"
+#include "ZoneMap.h"
 
 
 #define LED_COUNT                           50
+#if LED_COUNT != TREE_LED_COUNT
+    #error("The tree geometry tables don't match LED_COUNT.")
+#endif
+// Split of the strand used by the Zoned_Levels animation. The bottom levels of the tree come first in the strand.
+#define ZONE_BOTTOM_COUNT                   20
+#define ZONE_MIDDLE_COUNT                   20
+#define ZONE_TOP_COUNT                      (LED_COUNT - ZONE_BOTTOM_COUNT - ZONE_MIDDLE_COUNT)
 #define SECONDS_BETWEEN_ANIMATION_SWITCH    30
 #define DUMP_COUNTERS                       0
+#define DUMP_MEMORY_USAGE                   0
+// Set to 1 to print the CSV encoder timings from Benchmark.h at startup, before any animation is sent to the LEDs.
+#define RUN_BENCHMARKS                      0
+// Set to 1 to have g_encoderScript turn the speed and brightness knobs so that the input latencies dumped with
+// DUMP_COUNTERS can be compared between builds without someone having to sit and turn the knobs.
+#define SCRIPTED_ENCODER_INPUT              0
+// Number of frames that the keyframe, running lights and meteor animations can render ahead of time to be shown by the
+// NeoPixel driver exactly when they are due. Set to 0 to always render frames just before they are shown. Only 2 of
+// the larger frames needed for TEMPORAL_DITHER, which is turned on from the makefile, fit in the DMA heaps alongside
+// the playlist.
+#define RENDER_AHEAD_FRAMES                 (TEMPORAL_DITHER ? 2 : 4)
+// Frames due further out than this aren't rendered yet. Stops the animations from getting too far ahead of the last
+// knob change.
+#define RENDER_AHEAD_MILLISECONDS           100
+// The throbbing, fade, twinkle and flicker animations only compute a new frame this often and the frames in between
+// are blended from the last two that they computed. Set to 0 to have them compute every frame themselves.
+#define FRAME_INTERPOLATION_MILLISECONDS    20
 
 #define BRIGHTNESS_MIN                      1
 #define BRIGHTNESS_MAX                      255
@@ -34,6 +69,13 @@
 
 #define ARRAY_SIZE(X) (sizeof(X)/sizeof(X[0]))
 
+// The longest pattern used by the solid, chase, throbbing, and fade animations.
+#define MAX_PATTERN_LENGTH                  5
+
+// Colour space used to blend between the dim and bright keyframes of the throbbing animations. Oklab ramps the
+// brightness in perceptually even steps without needing the exponential curve used by the HSV blend.
+#define THROB_INTERPOLATION_SPACE           Interpolate_Oklab
+
 // The animations that I currently have defined for this sample.
 enum Animations
 {
@@ -63,6 +105,9 @@ enum Animations
     Twinkle_Snow,
     Running_Lights,
     Meteor,
+    Meteor_Snowfall,
+    Meteor_Over_Rainbow,
+    Zoned_Levels,
     Candle_Flicker,
     Max_Animation
 };
@@ -74,19 +119,59 @@ enum AdvanceMode
     Advance_Prev
 };
 
+// The rotary encoders. Used to index their input latency histograms and to identify them in trace events.
+enum Knobs
+{
+    Knob_Pattern,
+    Knob_Speed,
+    Knob_Brightness,
+    Max_Knob
+};
+
+// Knob turns played back by SCRIPTED_ENCODER_INPUT, repeating forever. The pattern knob is left alone since turning
+// it would take the tree out of demo mode.
+struct ScriptedEncoderInput
+{
+    Knobs    knob;
+    int32_t  count;
+    // Delay before the next input in the script.
+    uint32_t milliseconds;
+};
+
+static const ScriptedEncoderInput g_encoderScript[] =
+{
+    { Knob_Brightness,  1, 1000 },
+    { Knob_Brightness, -1, 1000 },
+    { Knob_Speed,       1, 1000 },
+    { Knob_Speed,      -1, 1000 }
+};
+
 static Animations        g_currAnimation = Solid_White;
 static bool              g_demoMode = true;
 static IPixelUpdate*     g_pPixelUpdate;
 static int16_t           g_brightness = BRIGHTNESS_DEFAULT;
 static int32_t           g_delay = DELAY_DEFAULT;
+static uint32_t          g_frameBudget;
 static Encoder           g_encoderPattern(p11, p12, p17);
 static Encoder           g_encoderSpeed(p13, p14, p18);
 static Encoder           g_encoderBrightness(p15, p16, p19);
+static InputLatency      g_inputLatency;
+static size_t            g_encoderScriptIndex;
+static uint64_t          g_nextScriptedInputTime;
+static bool              g_isFrameQueueStale;
 
 
 // Function Prototypes.
 static void updateAnimation();
+static void interpolateFrames(FrameInterpolatorBase* pInterpolator);
+static void renderPixels(NeoPixel& ledControl);
+static bool sampleEncoder(Knobs knob, Encoder& encoder, EncoderState* pState, NeoPixel& ledControl);
+static bool playEncoderScript(Knobs knob, EncoderState* pState);
 static void advanceToNextAnimation(AdvanceMode advance);
+static void dumpMemoryUsage();
+static void dumpFrameStats(NeoPixel& ledControl);
+static void dumpInputLatency();
+static void dumpHistogram(const char* pName, const Histogram* pHistogram);
 
 
 int main()
@@ -94,19 +179,29 @@ int main()
     uint32_t lastFlipCount = 0;
     uint32_t lastSetCount = 0;
     static   DigitalOut myled(LED1);
-    static   NeoPixel   ledControl(LED_COUNT, p5);
-    static   Timer      timer;
-    static   Timer      ledTimer;
+    static   NeoPixel   ledControl(LED_COUNT, p5, MAX_PATTERN_LENGTH, RENDER_AHEAD_FRAMES, TEMPORAL_DITHER);
 
+    profileInit();
+    if (DUMP_MEMORY_USAGE)
+    {
+        dumpMemoryUsage();
+    }
+    if (RUN_BENCHMARKS)
+    {
+        runBenchmarks(ledControl);
+    }
+    g_frameBudget = ledControl.getFrameMicroseconds();
     updateAnimation();
+    ledControl.setFrameObserver(&g_inputLatency);
     ledControl.start();
 
-    timer.start();
-    ledTimer.start();
+    uint64_t nextSwitchTime = tickMilliseconds() + SECONDS_BETWEEN_ANIMATION_SWITCH * 1000;
+    uint64_t nextLedToggleTime = tickMilliseconds() + 250;
 
     while(1)
     {
-        if (timer.read_ms() > SECONDS_BETWEEN_ANIMATION_SWITCH * 1000)
+        uint64_t currTime = tickMilliseconds();
+        if (currTime >= nextSwitchTime)
         {
             uint32_t currSetCount = ledControl.getSetCount();
             uint32_t setCount =  currSetCount - lastSetCount;
@@ -115,12 +210,18 @@ int main()
 
             if (DUMP_COUNTERS)
             {
-                printf("flips: %lu/sec    sets: %lu/sec\n",
+                // Statistics for the animation that is just finishing, followed by its probe timings when built with
+                // PROFILE_CYCLES.
+                printf("animation,flips/sec,sets/sec\n%d,%lu,%lu\n",
+                       g_currAnimation,
                        flipCount / SECONDS_BETWEEN_ANIMATION_SWITCH,
                        setCount / SECONDS_BETWEEN_ANIMATION_SWITCH);
+                dumpFrameStats(ledControl);
+                dumpInputLatency();
+                profileDump();
             }
 
-            timer.reset();
+            nextSwitchTime = currTime + SECONDS_BETWEEN_ANIMATION_SWITCH * 1000;
             lastSetCount = currSetCount;
             lastFlipCount = currFlipCount;
 
@@ -130,16 +231,25 @@ int main()
                 advanceToNextAnimation(Advance_Next);
             }
         }
-        g_pPixelUpdate->updatePixels(ledControl);
+        {
+            PROFILE_SCOPE(updatePixels);
+            if (g_isFrameQueueStale)
+            {
+                // Frames rendered ahead by the previous animation or with the old knob settings shouldn't be shown.
+                ledControl.flushFrameQueue();
+                g_isFrameQueueStale = false;
+            }
+            renderPixels(ledControl);
+        }
 
-        if (ledTimer.read_ms() >= 250)
+        if (currTime >= nextLedToggleTime)
         {
             myled = !myled;
-            ledTimer.reset();
+            nextLedToggleTime += 250;
         }
 
         EncoderState state;
-        if (g_encoderPattern.sample(&state))
+        if (sampleEncoder(Knob_Pattern, g_encoderPattern, &state, ledControl))
         {
             if (state.count > 0)
             {
@@ -154,10 +264,13 @@ int main()
             if (state.isPressed)
             {
                 g_demoMode = true;
+                // Press the pattern knob just after seeing a stutter to send out the events leading up to it when
+                // built with TRACE_EVENTS.
+                traceDump();
             }
         }
 
-        if (g_encoderSpeed.sample(&state))
+        if (sampleEncoder(Knob_Speed, g_encoderSpeed, &state, ledControl))
         {
             // Increasing count on speed encoder will cause a decrease in delay so the logic is inverted from the
             // other encoders.
@@ -185,7 +298,7 @@ int main()
             updateAnimation();
         }
 
-        if (g_encoderBrightness.sample(&state))
+        if (sampleEncoder(Knob_Brightness, g_encoderBrightness, &state, ledControl))
         {
             if (state.count > 0)
             {
@@ -213,420 +326,697 @@ int main()
     }
 }
 
-static void updateAnimation()
+// Each scene holds all of the animation engines, keyframes and properties needed by one group of animations. Only
+// one scene is active at a time so they are all constructed in the same arena and RAM use is that of the largest
+// scene rather than the sum of them all.
+struct KeyFrameScene
+{
+    Animation<LED_COUNT>        animation;
+    PixelData                   pattern1[MAX_PATTERN_LENGTH];
+    PixelData                   pattern2[MAX_PATTERN_LENGTH];
+    AnimationKeyFrame           keyFrames[MAX_PATTERN_LENGTH];
+    FrameInterpolator<LED_COUNT> interpolator;
+};
+
+struct RainbowScene
+{
+    Animation<LED_COUNT>        animation;
+    PixelData                   pixels1[LED_COUNT];
+    PixelData                   pixels2[LED_COUNT];
+    AnimationKeyFrame           keyFrames[2];
+    FrameInterpolator<LED_COUNT> interpolator;
+};
+
+struct TwinkleScene
 {
-    static Animation<LED_COUNT>        animation;
-    static TwinkleAnimation<LED_COUNT> twinkle;
-    static TwinkleProperties           twinkleProperties;
-    static FlickerAnimation<LED_COUNT> flicker;
-    static FlickerProperties           flickerProperties;
-    static RunningLightsAnimation<LED_COUNT> runningLights;
-    static MeteorProperties            meteorProperties;
-    static MeteorAnimation<LED_COUNT>  meteor;
-    static RGBData                     pixels1[LED_COUNT];
-    static RGBData                     pixels2[LED_COUNT];
-    static RGBData                     pixels3[LED_COUNT];
-    static RGBData                     pixels4[LED_COUNT];
-    static RGBData                     pixels5[LED_COUNT];
-    static AnimationKeyFrame           keyFrames[5];
+    TwinkleAnimation<LED_COUNT> twinkle;
+    TwinkleProperties           twinkleProperties;
+    FrameInterpolator<LED_COUNT> interpolator;
+};
+
+struct FlickerScene
+{
+    FlickerAnimation<LED_COUNT> flicker;
+    FlickerProperties           flickerProperties;
+    FrameInterpolator<LED_COUNT> interpolator;
+};
+
+struct RunningLightsScene
+{
+    RunningLightsAnimation<LED_COUNT> runningLights;
+};
 
+struct MeteorScene
+{
+    MeteorAnimation<LED_COUNT>  meteor;
+    MeteorProperties            meteorProperties;
+};
+
+struct MeteorOverRainbowScene
+{
+    Animation<LED_COUNT>        animation;
+    MeteorAnimation<LED_COUNT>  meteor;
+    MeteorProperties            meteorProperties;
+    Compositor<LED_COUNT, 2>    compositor;
+    PixelData                   pixels1[LED_COUNT];
+    PixelData                   pixels2[LED_COUNT];
+    AnimationKeyFrame           keyFrames[2];
+};
+
+struct ZonedLevelsScene
+{
+    ZoneMap<LED_COUNT>                  zoneMap;
+    Animation<ZONE_BOTTOM_COUNT>        zoneBottom;
+    FlickerAnimation<ZONE_MIDDLE_COUNT> zoneMiddle;
+    TwinkleAnimation<ZONE_TOP_COUNT>    zoneTop;
+    PixelData                           zonePattern[1];
+    AnimationKeyFrame                   keyFrames[1];
+    FlickerProperties                   flickerProperties;
+    TwinkleProperties                   twinkleProperties;
+};
+
+union SceneArena
+{
+    uint8_t  keyFrameScene[sizeof(KeyFrameScene)];
+    uint8_t  rainbowScene[sizeof(RainbowScene)];
+    uint8_t  twinkleScene[sizeof(TwinkleScene)];
+    uint8_t  flickerScene[sizeof(FlickerScene)];
+    uint8_t  runningLightsScene[sizeof(RunningLightsScene)];
+    uint8_t  meteorScene[sizeof(MeteorScene)];
+    uint8_t  meteorOverRainbowScene[sizeof(MeteorOverRainbowScene)];
+    uint8_t  zonedLevelsScene[sizeof(ZonedLevelsScene)];
+    // Force the strictest alignment needed by any of the scene members.
+    uint64_t alignment;
+};
+
+static SceneArena   g_sceneArena;
+static void         (*g_pDestroyScene)(void* pScene);
+
+template <class SCENE>
+static void destroyScene(void* pScene)
+{
+    ((SCENE*)pScene)->~SCENE();
+}
+
+template <class SCENE>
+static SCENE* activateScene()
+{
+    // Keep the current scene when only the speed or brightness changed, otherwise tear it down and construct the
+    // requested scene in its place. The destroy function also identifies the type of scene currently in the arena.
+    if (g_pDestroyScene != destroyScene<SCENE>)
+    {
+        if (g_pDestroyScene)
+        {
+            g_pDestroyScene(&g_sceneArena);
+        }
+        new (&g_sceneArena) SCENE();
+        g_pDestroyScene = destroyScene<SCENE>;
+    }
+    return (SCENE*)&g_sceneArena;
+}
+
+static void updateAnimation()
+{
     // Use the natural logarithm of brightness setting to create a smoother gradient.
     uint8_t brightness = logOfBrightness(g_brightness);
+    g_isFrameQueueStale = true;
 
     switch (g_currAnimation)
     {
     case Solid_White:
         {
+            KeyFrameScene* pScene = activateScene<KeyFrameScene>();
+
             RGBData pattern[] = { WHITE };
             changeBrightness(pattern, ARRAY_SIZE(pattern), brightness);
-            createRepeatingPixelPattern(pixels1, ARRAY_SIZE(pixels1), pattern, ARRAY_SIZE(pattern));
-            keyFrames[0] = {pixels1, 0x7FFFFFFF, false};
-            animation.setKeyFrames(keyFrames, 1);
-            g_pPixelUpdate = &animation;
+            createRepeatingPixelPattern(pScene->pattern1, ARRAY_SIZE(pattern), pattern, ARRAY_SIZE(pattern));
+            pScene->keyFrames[0] = {NULL, 0x7FFFFFFF, false, pScene->pattern1, ARRAY_SIZE(pattern), 0};
+            pScene->animation.setKeyFrames(pScene->keyFrames, 1);
+            g_pPixelUpdate = &pScene->animation;
             break;
         }
     case Solid_Red:
         {
+            KeyFrameScene* pScene = activateScene<KeyFrameScene>();
+
             RGBData pattern[] = { RED };
             changeBrightness(pattern, ARRAY_SIZE(pattern), brightness);
-            createRepeatingPixelPattern(pixels1, ARRAY_SIZE(pixels1), pattern, ARRAY_SIZE(pattern));
-            keyFrames[0] = {pixels1, 0x7FFFFFFF, false};
-            animation.setKeyFrames(keyFrames, 1);
-            g_pPixelUpdate = &animation;
+            createRepeatingPixelPattern(pScene->pattern1, ARRAY_SIZE(pattern), pattern, ARRAY_SIZE(pattern));
+            pScene->keyFrames[0] = {NULL, 0x7FFFFFFF, false, pScene->pattern1, ARRAY_SIZE(pattern), 0};
+            pScene->animation.setKeyFrames(pScene->keyFrames, 1);
+            g_pPixelUpdate = &pScene->animation;
             break;
         }
     case Solid_Green:
         {
+            KeyFrameScene* pScene = activateScene<KeyFrameScene>();
+
             RGBData pattern[] = { GREEN };
             changeBrightness(pattern, ARRAY_SIZE(pattern), brightness);
-            createRepeatingPixelPattern(pixels1, ARRAY_SIZE(pixels1), pattern, ARRAY_SIZE(pattern));
-            keyFrames[0] = {pixels1, 0x7FFFFFFF, false};
-            animation.setKeyFrames(keyFrames, 1);
-            g_pPixelUpdate = &animation;
+            createRepeatingPixelPattern(pScene->pattern1, ARRAY_SIZE(pattern), pattern, ARRAY_SIZE(pattern));
+            pScene->keyFrames[0] = {NULL, 0x7FFFFFFF, false, pScene->pattern1, ARRAY_SIZE(pattern), 0};
+            pScene->animation.setKeyFrames(pScene->keyFrames, 1);
+            g_pPixelUpdate = &pScene->animation;
             break;
         }
     case Solid_Blue_White:
         {
+            KeyFrameScene* pScene = activateScene<KeyFrameScene>();
+
             RGBData pattern[] = { BLUE, WHITE };
             changeBrightness(pattern, ARRAY_SIZE(pattern), brightness);
-            createRepeatingPixelPattern(pixels1, ARRAY_SIZE(pixels1), pattern, ARRAY_SIZE(pattern));
-            keyFrames[0] = {pixels1, 0x7FFFFFFF, false};
-            animation.setKeyFrames(keyFrames, 1);
-            g_pPixelUpdate = &animation;
+            createRepeatingPixelPattern(pScene->pattern1, ARRAY_SIZE(pattern), pattern, ARRAY_SIZE(pattern));
+            pScene->keyFrames[0] = {NULL, 0x7FFFFFFF, false, pScene->pattern1, ARRAY_SIZE(pattern), 0};
+            pScene->animation.setKeyFrames(pScene->keyFrames, 1);
+            g_pPixelUpdate = &pScene->animation;
             break;
         }
     case Solid_Red_Green:
         {
+            KeyFrameScene* pScene = activateScene<KeyFrameScene>();
+
             RGBData pattern[] = { RED, GREEN };
             changeBrightness(pattern, ARRAY_SIZE(pattern), brightness);
-            createRepeatingPixelPattern(pixels1, ARRAY_SIZE(pixels1), pattern, ARRAY_SIZE(pattern));
-            keyFrames[0] = {pixels1, 0x7FFFFFFF, false};
-            animation.setKeyFrames(keyFrames, 1);
-            g_pPixelUpdate = &animation;
+            createRepeatingPixelPattern(pScene->pattern1, ARRAY_SIZE(pattern), pattern, ARRAY_SIZE(pattern));
+            pScene->keyFrames[0] = {NULL, 0x7FFFFFFF, false, pScene->pattern1, ARRAY_SIZE(pattern), 0};
+            pScene->animation.setKeyFrames(pScene->keyFrames, 1);
+            g_pPixelUpdate = &pScene->animation;
             break;
         }
     case Solid_Red_Green_White:
         {
+            KeyFrameScene* pScene = activateScene<KeyFrameScene>();
+
             RGBData pattern[] = { RED, GREEN, WHITE };
             changeBrightness(pattern, ARRAY_SIZE(pattern), brightness);
-            createRepeatingPixelPattern(pixels1, ARRAY_SIZE(pixels1), pattern, ARRAY_SIZE(pattern));
-            keyFrames[0] = {pixels1, 0x7FFFFFFF, false};
-            animation.setKeyFrames(keyFrames, 1);
-            g_pPixelUpdate = &animation;
+            createRepeatingPixelPattern(pScene->pattern1, ARRAY_SIZE(pattern), pattern, ARRAY_SIZE(pattern));
+            pScene->keyFrames[0] = {NULL, 0x7FFFFFFF, false, pScene->pattern1, ARRAY_SIZE(pattern), 0};
+            pScene->animation.setKeyFrames(pScene->keyFrames, 1);
+            g_pPixelUpdate = &pScene->animation;
             break;
         }
     case Solid_Red_Orange_Yellow_Green_Blue:
         {
+            KeyFrameScene* pScene = activateScene<KeyFrameScene>();
+
             RGBData pattern[] = { RED, DARK_ORANGE, YELLOW, GREEN, BLUE };
             changeBrightness(pattern, ARRAY_SIZE(pattern), brightness);
-            createRepeatingPixelPattern(pixels1, ARRAY_SIZE(pixels1), pattern, ARRAY_SIZE(pattern));
-            keyFrames[0] = {pixels1, 0x7FFFFFFF, false};
-            animation.setKeyFrames(keyFrames, 1);
-            g_pPixelUpdate = &animation;
+            createRepeatingPixelPattern(pScene->pattern1, ARRAY_SIZE(pattern), pattern, ARRAY_SIZE(pattern));
+            pScene->keyFrames[0] = {NULL, 0x7FFFFFFF, false, pScene->pattern1, ARRAY_SIZE(pattern), 0};
+            pScene->animation.setKeyFrames(pScene->keyFrames, 1);
+            g_pPixelUpdate = &pScene->animation;
             break;
         }
     case Chase_Blue_White:
         {
-            RGBData pattern1[] = { BLUE, WHITE };
-            RGBData pattern2[] = { WHITE, BLUE };
-            changeBrightness(pattern1, ARRAY_SIZE(pattern1), brightness);
-            changeBrightness(pattern2, ARRAY_SIZE(pattern2), brightness);
-            createRepeatingPixelPattern(pixels1, ARRAY_SIZE(pixels1), pattern1, ARRAY_SIZE(pattern1));
-            createRepeatingPixelPattern(pixels2, ARRAY_SIZE(pixels2), pattern2, ARRAY_SIZE(pattern2));
-            keyFrames[0] = {pixels1, g_delay, false};
-            keyFrames[1] = {pixels2, g_delay, false};
-            animation.setKeyFrames(keyFrames, 2);
-            g_pPixelUpdate = &animation;
+            KeyFrameScene* pScene = activateScene<KeyFrameScene>();
+
+            // Each keyframe shifts the same pattern one more pixel along the strand.
+            RGBData pattern[] = { BLUE, WHITE };
+            changeBrightness(pattern, ARRAY_SIZE(pattern), brightness);
+            createRepeatingPixelPattern(pScene->pattern1, ARRAY_SIZE(pattern), pattern, ARRAY_SIZE(pattern));
+            for (uint16_t i = 0 ; i < ARRAY_SIZE(pattern) ; i++)
+            {
+                pScene->keyFrames[i] = {NULL, g_delay, false, pScene->pattern1, ARRAY_SIZE(pattern), i};
+            }
+            pScene->animation.setKeyFrames(pScene->keyFrames, ARRAY_SIZE(pattern));
+            g_pPixelUpdate = &pScene->animation;
             break;
         }
     case Chase_Red_Green:
         {
-            RGBData pattern1[] = { RED, GREEN };
-            RGBData pattern2[] = { GREEN, RED };
-            changeBrightness(pattern1, ARRAY_SIZE(pattern1), brightness);
-            changeBrightness(pattern2, ARRAY_SIZE(pattern2), brightness);
-            createRepeatingPixelPattern(pixels1, ARRAY_SIZE(pixels1), pattern1, ARRAY_SIZE(pattern1));
-            createRepeatingPixelPattern(pixels2, ARRAY_SIZE(pixels2), pattern2, ARRAY_SIZE(pattern2));
-            keyFrames[0] = {pixels1, g_delay, false};
-            keyFrames[1] = {pixels2, g_delay, false};
-            animation.setKeyFrames(keyFrames, 2);
-            g_pPixelUpdate = &animation;
+            KeyFrameScene* pScene = activateScene<KeyFrameScene>();
+
+            // Each keyframe shifts the same pattern one more pixel along the strand.
+            RGBData pattern[] = { RED, GREEN };
+            changeBrightness(pattern, ARRAY_SIZE(pattern), brightness);
+            createRepeatingPixelPattern(pScene->pattern1, ARRAY_SIZE(pattern), pattern, ARRAY_SIZE(pattern));
+            for (uint16_t i = 0 ; i < ARRAY_SIZE(pattern) ; i++)
+            {
+                pScene->keyFrames[i] = {NULL, g_delay, false, pScene->pattern1, ARRAY_SIZE(pattern), i};
+            }
+            pScene->animation.setKeyFrames(pScene->keyFrames, ARRAY_SIZE(pattern));
+            g_pPixelUpdate = &pScene->animation;
             break;
         }
     case Chase_Red_Green_White:
         {
-            RGBData pattern1[] = { RED, GREEN, WHITE };
-            RGBData pattern2[] = { WHITE, RED, GREEN };
-            RGBData pattern3[] = { GREEN, WHITE, RED };
-            changeBrightness(pattern1, ARRAY_SIZE(pattern1), brightness);
-            changeBrightness(pattern2, ARRAY_SIZE(pattern2), brightness);
-            changeBrightness(pattern3, ARRAY_SIZE(pattern3), brightness);
-            createRepeatingPixelPattern(pixels1, ARRAY_SIZE(pixels1), pattern1, ARRAY_SIZE(pattern1));
-            createRepeatingPixelPattern(pixels2, ARRAY_SIZE(pixels2), pattern2, ARRAY_SIZE(pattern2));
-            createRepeatingPixelPattern(pixels3, ARRAY_SIZE(pixels3), pattern3, ARRAY_SIZE(pattern3));
-            keyFrames[0] = {pixels1, g_delay, false};
-            keyFrames[1] = {pixels2, g_delay, false};
-            keyFrames[2] = {pixels3, g_delay, false};
-            animation.setKeyFrames(keyFrames, 3);
-            g_pPixelUpdate = &animation;
+            KeyFrameScene* pScene = activateScene<KeyFrameScene>();
+
+            // Each keyframe shifts the same pattern one more pixel along the strand.
+            RGBData pattern[] = { RED, GREEN, WHITE };
+            changeBrightness(pattern, ARRAY_SIZE(pattern), brightness);
+            createRepeatingPixelPattern(pScene->pattern1, ARRAY_SIZE(pattern), pattern, ARRAY_SIZE(pattern));
+            for (uint16_t i = 0 ; i < ARRAY_SIZE(pattern) ; i++)
+            {
+                pScene->keyFrames[i] = {NULL, g_delay, false, pScene->pattern1, ARRAY_SIZE(pattern), i};
+            }
+            pScene->animation.setKeyFrames(pScene->keyFrames, ARRAY_SIZE(pattern));
+            g_pPixelUpdate = &pScene->animation;
             break;
         }
     case Chase_Red_Orange_Yellow_Green_Blue:
         {
-            RGBData pattern1[] = { RED, DARK_ORANGE, YELLOW, GREEN, BLUE };
-            RGBData pattern2[] = { BLUE, RED, DARK_ORANGE, YELLOW, GREEN };
-            RGBData pattern3[] = { GREEN, BLUE, RED, DARK_ORANGE, YELLOW };
-            RGBData pattern4[] = { YELLOW, GREEN, BLUE, RED, DARK_ORANGE };
-            RGBData pattern5[] = { DARK_ORANGE, YELLOW, GREEN, BLUE, RED };
-            changeBrightness(pattern1, ARRAY_SIZE(pattern1), brightness);
-            changeBrightness(pattern2, ARRAY_SIZE(pattern2), brightness);
-            changeBrightness(pattern3, ARRAY_SIZE(pattern3), brightness);
-            changeBrightness(pattern4, ARRAY_SIZE(pattern4), brightness);
-            changeBrightness(pattern5, ARRAY_SIZE(pattern5), brightness);
-            createRepeatingPixelPattern(pixels1, ARRAY_SIZE(pixels1), pattern1, ARRAY_SIZE(pattern1));
-            createRepeatingPixelPattern(pixels2, ARRAY_SIZE(pixels2), pattern2, ARRAY_SIZE(pattern2));
-            createRepeatingPixelPattern(pixels3, ARRAY_SIZE(pixels3), pattern3, ARRAY_SIZE(pattern3));
-            createRepeatingPixelPattern(pixels4, ARRAY_SIZE(pixels4), pattern4, ARRAY_SIZE(pattern4));
-            createRepeatingPixelPattern(pixels5, ARRAY_SIZE(pixels5), pattern5, ARRAY_SIZE(pattern5));
-            keyFrames[0] = {pixels1, g_delay, false};
-            keyFrames[1] = {pixels2, g_delay, false};
-            keyFrames[2] = {pixels3, g_delay, false};
-            keyFrames[3] = {pixels4, g_delay, false};
-            keyFrames[4] = {pixels5, g_delay, false};
-            animation.setKeyFrames(keyFrames, 5);
-            g_pPixelUpdate = &animation;
+            KeyFrameScene* pScene = activateScene<KeyFrameScene>();
+
+            // Each keyframe shifts the same pattern one more pixel along the strand.
+            RGBData pattern[] = { RED, DARK_ORANGE, YELLOW, GREEN, BLUE };
+            changeBrightness(pattern, ARRAY_SIZE(pattern), brightness);
+            createRepeatingPixelPattern(pScene->pattern1, ARRAY_SIZE(pattern), pattern, ARRAY_SIZE(pattern));
+            for (uint16_t i = 0 ; i < ARRAY_SIZE(pattern) ; i++)
+            {
+                pScene->keyFrames[i] = {NULL, g_delay, false, pScene->pattern1, ARRAY_SIZE(pattern), i};
+            }
+            pScene->animation.setKeyFrames(pScene->keyFrames, ARRAY_SIZE(pattern));
+            g_pPixelUpdate = &pScene->animation;
             break;
         }
     case Throbbing_Red:
         {
+            KeyFrameScene* pScene = activateScene<KeyFrameScene>();
+
             RGBData pattern1[] = { RGBData(8, 0, 0) };
             RGBData pattern2[] = { RGBData(255, 0, 0) };
             changeBrightness(pattern1, ARRAY_SIZE(pattern1), brightness);
             changeBrightness(pattern2, ARRAY_SIZE(pattern2), brightness);
-            createRepeatingPixelPattern(pixels1, ARRAY_SIZE(pixels1), pattern1, ARRAY_SIZE(pattern1));
-            createRepeatingPixelPattern(pixels2, ARRAY_SIZE(pixels2), pattern2, ARRAY_SIZE(pattern2));
-            keyFrames[0] = {pixels1, g_delay * 4, true};
-            keyFrames[1] = {pixels2, g_delay * 4, true};
-            animation.setKeyFrames(keyFrames, 2);
-            g_pPixelUpdate = &animation;
+            createRepeatingPixelPattern(pScene->pattern1, ARRAY_SIZE(pattern1), pattern1, ARRAY_SIZE(pattern1));
+            createRepeatingPixelPattern(pScene->pattern2, ARRAY_SIZE(pattern2), pattern2, ARRAY_SIZE(pattern2));
+            pScene->keyFrames[0] = {NULL, g_delay * 4, true, pScene->pattern1, ARRAY_SIZE(pattern1), 0,
+                                    THROB_INTERPOLATION_SPACE};
+            pScene->keyFrames[1] = {NULL, g_delay * 4, true, pScene->pattern2, ARRAY_SIZE(pattern2), 0,
+                                    THROB_INTERPOLATION_SPACE};
+            pScene->animation.setKeyFrames(pScene->keyFrames, 2);
+            g_pPixelUpdate = &pScene->animation;
+            interpolateFrames(&pScene->interpolator);
             break;
         }
     case Throbbing_Green:
         {
+            KeyFrameScene* pScene = activateScene<KeyFrameScene>();
+
             RGBData pattern1[] = { RGBData(0, 8, 0) };
             RGBData pattern2[] = { RGBData(0, 255, 0) };
             changeBrightness(pattern1, ARRAY_SIZE(pattern1), brightness);
             changeBrightness(pattern2, ARRAY_SIZE(pattern2), brightness);
-            createRepeatingPixelPattern(pixels1, ARRAY_SIZE(pixels1), pattern1, ARRAY_SIZE(pattern1));
-            createRepeatingPixelPattern(pixels2, ARRAY_SIZE(pixels2), pattern2, ARRAY_SIZE(pattern2));
-            keyFrames[0] = {pixels1, g_delay * 4, true};
-            keyFrames[1] = {pixels2, g_delay * 4, true};
-            animation.setKeyFrames(keyFrames, 2);
-            g_pPixelUpdate = &animation;
+            createRepeatingPixelPattern(pScene->pattern1, ARRAY_SIZE(pattern1), pattern1, ARRAY_SIZE(pattern1));
+            createRepeatingPixelPattern(pScene->pattern2, ARRAY_SIZE(pattern2), pattern2, ARRAY_SIZE(pattern2));
+            pScene->keyFrames[0] = {NULL, g_delay * 4, true, pScene->pattern1, ARRAY_SIZE(pattern1), 0,
+                                    THROB_INTERPOLATION_SPACE};
+            pScene->keyFrames[1] = {NULL, g_delay * 4, true, pScene->pattern2, ARRAY_SIZE(pattern2), 0,
+                                    THROB_INTERPOLATION_SPACE};
+            pScene->animation.setKeyFrames(pScene->keyFrames, 2);
+            g_pPixelUpdate = &pScene->animation;
+            interpolateFrames(&pScene->interpolator);
             break;
         }
     case Throbbing_White:
         {
+            KeyFrameScene* pScene = activateScene<KeyFrameScene>();
+
             RGBData pattern1[] = { RGBData(8, 8, 8) };
             RGBData pattern2[] = { RGBData(255, 255, 255) };
             changeBrightness(pattern1, ARRAY_SIZE(pattern1), brightness);
             changeBrightness(pattern2, ARRAY_SIZE(pattern2), brightness);
-            createRepeatingPixelPattern(pixels1, ARRAY_SIZE(pixels1), pattern1, ARRAY_SIZE(pattern1));
-            createRepeatingPixelPattern(pixels2, ARRAY_SIZE(pixels2), pattern2, ARRAY_SIZE(pattern2));
-            keyFrames[0] = {pixels1, g_delay * 4, true};
-            keyFrames[1] = {pixels2, g_delay * 4, true};
-            animation.setKeyFrames(keyFrames, 2);
-            g_pPixelUpdate = &animation;
+            createRepeatingPixelPattern(pScene->pattern1, ARRAY_SIZE(pattern1), pattern1, ARRAY_SIZE(pattern1));
+            createRepeatingPixelPattern(pScene->pattern2, ARRAY_SIZE(pattern2), pattern2, ARRAY_SIZE(pattern2));
+            pScene->keyFrames[0] = {NULL, g_delay * 4, true, pScene->pattern1, ARRAY_SIZE(pattern1), 0,
+                                    THROB_INTERPOLATION_SPACE};
+            pScene->keyFrames[1] = {NULL, g_delay * 4, true, pScene->pattern2, ARRAY_SIZE(pattern2), 0,
+                                    THROB_INTERPOLATION_SPACE};
+            pScene->animation.setKeyFrames(pScene->keyFrames, 2);
+            g_pPixelUpdate = &pScene->animation;
+            interpolateFrames(&pScene->interpolator);
             break;
         }
     case Fade_Blue_White:
         {
-            RGBData pattern1[] = { BLUE, WHITE };
-            RGBData pattern2[] = { WHITE, BLUE };
-            changeBrightness(pattern1, ARRAY_SIZE(pattern1), brightness);
-            changeBrightness(pattern2, ARRAY_SIZE(pattern2), brightness);
-            createRepeatingPixelPattern(pixels1, ARRAY_SIZE(pixels1), pattern1, ARRAY_SIZE(pattern1));
-            createRepeatingPixelPattern(pixels2, ARRAY_SIZE(pixels2), pattern2, ARRAY_SIZE(pattern2));
-            keyFrames[0] = {pixels1, g_delay, true};
-            keyFrames[1] = {pixels2, g_delay, true};
-            animation.setKeyFrames(keyFrames, 2);
-            g_pPixelUpdate = &animation;
+            KeyFrameScene* pScene = activateScene<KeyFrameScene>();
+
+            // Each keyframe shifts the same pattern one more pixel along the strand.
+            RGBData pattern[] = { BLUE, WHITE };
+            changeBrightness(pattern, ARRAY_SIZE(pattern), brightness);
+            createRepeatingPixelPattern(pScene->pattern1, ARRAY_SIZE(pattern), pattern, ARRAY_SIZE(pattern));
+            for (uint16_t i = 0 ; i < ARRAY_SIZE(pattern) ; i++)
+            {
+                pScene->keyFrames[i] = {NULL, g_delay, true, pScene->pattern1, ARRAY_SIZE(pattern), i};
+            }
+            pScene->animation.setKeyFrames(pScene->keyFrames, ARRAY_SIZE(pattern));
+            g_pPixelUpdate = &pScene->animation;
+            interpolateFrames(&pScene->interpolator);
             break;
         }
     case Fade_Red_Green:
         {
-            RGBData pattern1[] = { RED, GREEN };
-            RGBData pattern2[] = { GREEN, RED };
-            changeBrightness(pattern1, ARRAY_SIZE(pattern1), brightness);
-            changeBrightness(pattern2, ARRAY_SIZE(pattern2), brightness);
-            createRepeatingPixelPattern(pixels1, ARRAY_SIZE(pixels1), pattern1, ARRAY_SIZE(pattern1));
-            createRepeatingPixelPattern(pixels2, ARRAY_SIZE(pixels2), pattern2, ARRAY_SIZE(pattern2));
-            keyFrames[0] = {pixels1, g_delay, true};
-            keyFrames[1] = {pixels2, g_delay, true};
-            animation.setKeyFrames(keyFrames, 2);
-            g_pPixelUpdate = &animation;
+            KeyFrameScene* pScene = activateScene<KeyFrameScene>();
+
+            // Each keyframe shifts the same pattern one more pixel along the strand.
+            RGBData pattern[] = { RED, GREEN };
+            changeBrightness(pattern, ARRAY_SIZE(pattern), brightness);
+            createRepeatingPixelPattern(pScene->pattern1, ARRAY_SIZE(pattern), pattern, ARRAY_SIZE(pattern));
+            for (uint16_t i = 0 ; i < ARRAY_SIZE(pattern) ; i++)
+            {
+                pScene->keyFrames[i] = {NULL, g_delay, true, pScene->pattern1, ARRAY_SIZE(pattern), i};
+            }
+            pScene->animation.setKeyFrames(pScene->keyFrames, ARRAY_SIZE(pattern));
+            g_pPixelUpdate = &pScene->animation;
+            interpolateFrames(&pScene->interpolator);
             break;
         }
     case Fade_Red_Green_White:
         {
-            RGBData pattern1[] = { RED, GREEN, WHITE };
-            RGBData pattern2[] = { WHITE, RED, GREEN };
-            RGBData pattern3[] = { GREEN, WHITE, RED };
-            changeBrightness(pattern1, ARRAY_SIZE(pattern1), brightness);
-            changeBrightness(pattern2, ARRAY_SIZE(pattern2), brightness);
-            changeBrightness(pattern3, ARRAY_SIZE(pattern3), brightness);
-            createRepeatingPixelPattern(pixels1, ARRAY_SIZE(pixels1), pattern1, ARRAY_SIZE(pattern1));
-            createRepeatingPixelPattern(pixels2, ARRAY_SIZE(pixels2), pattern2, ARRAY_SIZE(pattern2));
-            createRepeatingPixelPattern(pixels3, ARRAY_SIZE(pixels3), pattern3, ARRAY_SIZE(pattern3));
-            keyFrames[0] = {pixels1, g_delay, true};
-            keyFrames[1] = {pixels2, g_delay, true};
-            keyFrames[2] = {pixels3, g_delay, true};
-            animation.setKeyFrames(keyFrames, 3);
-            g_pPixelUpdate = &animation;
+            KeyFrameScene* pScene = activateScene<KeyFrameScene>();
+
+            // Each keyframe shifts the same pattern one more pixel along the strand.
+            RGBData pattern[] = { RED, GREEN, WHITE };
+            changeBrightness(pattern, ARRAY_SIZE(pattern), brightness);
+            createRepeatingPixelPattern(pScene->pattern1, ARRAY_SIZE(pattern), pattern, ARRAY_SIZE(pattern));
+            for (uint16_t i = 0 ; i < ARRAY_SIZE(pattern) ; i++)
+            {
+                pScene->keyFrames[i] = {NULL, g_delay, true, pScene->pattern1, ARRAY_SIZE(pattern), i};
+            }
+            pScene->animation.setKeyFrames(pScene->keyFrames, ARRAY_SIZE(pattern));
+            g_pPixelUpdate = &pScene->animation;
+            interpolateFrames(&pScene->interpolator);
             break;
         }
     case Fade_Red_Orange_Yellow_Green_Blue:
         {
-            RGBData pattern1[] = { RED, DARK_ORANGE, YELLOW, GREEN, BLUE };
-            RGBData pattern2[] = { BLUE, RED, DARK_ORANGE, YELLOW, GREEN };
-            RGBData pattern3[] = { GREEN, BLUE, RED, DARK_ORANGE, YELLOW };
-            RGBData pattern4[] = { YELLOW, GREEN, BLUE, RED, DARK_ORANGE };
-            RGBData pattern5[] = { DARK_ORANGE, YELLOW, GREEN, BLUE, RED };
-            changeBrightness(pattern1, ARRAY_SIZE(pattern1), brightness);
-            changeBrightness(pattern2, ARRAY_SIZE(pattern2), brightness);
-            changeBrightness(pattern3, ARRAY_SIZE(pattern3), brightness);
-            changeBrightness(pattern4, ARRAY_SIZE(pattern4), brightness);
-            changeBrightness(pattern5, ARRAY_SIZE(pattern5), brightness);
-            createRepeatingPixelPattern(pixels1, ARRAY_SIZE(pixels1), pattern1, ARRAY_SIZE(pattern1));
-            createRepeatingPixelPattern(pixels2, ARRAY_SIZE(pixels2), pattern2, ARRAY_SIZE(pattern2));
-            createRepeatingPixelPattern(pixels3, ARRAY_SIZE(pixels3), pattern3, ARRAY_SIZE(pattern3));
-            createRepeatingPixelPattern(pixels4, ARRAY_SIZE(pixels4), pattern4, ARRAY_SIZE(pattern4));
-            createRepeatingPixelPattern(pixels5, ARRAY_SIZE(pixels5), pattern5, ARRAY_SIZE(pattern5));
-            keyFrames[0] = {pixels1, g_delay, true};
-            keyFrames[1] = {pixels2, g_delay, true};
-            keyFrames[2] = {pixels3, g_delay, true};
-            keyFrames[3] = {pixels4, g_delay, true};
-            keyFrames[4] = {pixels5, g_delay, true};
-            animation.setKeyFrames(keyFrames, 5);
-            g_pPixelUpdate = &animation;
+            KeyFrameScene* pScene = activateScene<KeyFrameScene>();
+
+            // Each keyframe shifts the same pattern one more pixel along the strand.
+            RGBData pattern[] = { RED, DARK_ORANGE, YELLOW, GREEN, BLUE };
+            changeBrightness(pattern, ARRAY_SIZE(pattern), brightness);
+            createRepeatingPixelPattern(pScene->pattern1, ARRAY_SIZE(pattern), pattern, ARRAY_SIZE(pattern));
+            for (uint16_t i = 0 ; i < ARRAY_SIZE(pattern) ; i++)
+            {
+                pScene->keyFrames[i] = {NULL, g_delay, true, pScene->pattern1, ARRAY_SIZE(pattern), i};
+            }
+            pScene->animation.setKeyFrames(pScene->keyFrames, ARRAY_SIZE(pattern));
+            g_pPixelUpdate = &pScene->animation;
+            interpolateFrames(&pScene->interpolator);
             break;
         }
     case Fade_Rainbow:
         {
+            RainbowScene* pScene = activateScene<RainbowScene>();
+
             RGBData pattern1[] = { RED };
             RGBData pattern2[] = { VIOLET };
             changeBrightness(pattern1, ARRAY_SIZE(pattern1), brightness);
             changeBrightness(pattern2, ARRAY_SIZE(pattern2), brightness);
-            createInterpolatedPixelPattern(pixels1, ARRAY_SIZE(pixels1), pattern1, pattern2);
-            createInterpolatedPixelPattern(pixels2, ARRAY_SIZE(pixels2), pattern2, pattern1);
-            keyFrames[0] = {pixels1, g_delay * 4, true};
-            keyFrames[1] = {pixels2, g_delay * 4, true};
-            animation.setKeyFrames(keyFrames, 2);
-            g_pPixelUpdate = &animation;
+            createInterpolatedPixelPattern(pScene->pixels1, ARRAY_SIZE(pScene->pixels1), pattern1, pattern2);
+            createInterpolatedPixelPattern(pScene->pixels2, ARRAY_SIZE(pScene->pixels2), pattern2, pattern1);
+            pScene->keyFrames[0] = {pScene->pixels1, g_delay * 4, true};
+            pScene->keyFrames[1] = {pScene->pixels2, g_delay * 4, true};
+            pScene->animation.setKeyFrames(pScene->keyFrames, 2);
+            g_pPixelUpdate = &pScene->animation;
+            interpolateFrames(&pScene->interpolator);
             break;
         }
     case Twinkle_White:
         {
-            twinkleProperties.lifetimeMin = g_delay / 2;
-            twinkleProperties.lifetimeMax = g_delay;
-            twinkleProperties.probability = 250;
-            twinkleProperties.hueMin = 0;
-            twinkleProperties.hueMax = 0;
-            twinkleProperties.saturationMin = 0;
-            twinkleProperties.saturationMax = 0;
-            twinkleProperties.valueMin = brightness / 2;
-            twinkleProperties.valueMax = brightness;
-            twinkleProperties.hsvBackground = HSVData(0, 0, 0);
-            twinkle.setProperties(&twinkleProperties);
-            g_pPixelUpdate = &twinkle;
+            TwinkleScene* pScene = activateScene<TwinkleScene>();
+
+            pScene->twinkleProperties.lifetimeMin = g_delay / 2;
+            pScene->twinkleProperties.lifetimeMax = g_delay;
+            pScene->twinkleProperties.twinkleRate = 80;
+            pScene->twinkleProperties.hueMin = 0;
+            pScene->twinkleProperties.hueMax = 0;
+            pScene->twinkleProperties.saturationMin = 0;
+            pScene->twinkleProperties.saturationMax = 0;
+            pScene->twinkleProperties.valueMin = brightness / 2;
+            pScene->twinkleProperties.valueMax = brightness;
+            pScene->twinkleProperties.hsvBackground = HSVData(0, 0, 0);
+            pScene->twinkle.setProperties(&pScene->twinkleProperties);
+            g_pPixelUpdate = &pScene->twinkle;
+            interpolateFrames(&pScene->interpolator);
             break;
         }
     case Twinkle_Red:
         {
-            twinkleProperties.lifetimeMin = g_delay / 2;
-            twinkleProperties.lifetimeMax = g_delay;
-            twinkleProperties.probability = 250;
-            twinkleProperties.hueMin = 0;
-            twinkleProperties.hueMax = 0;
-            twinkleProperties.saturationMin = 255;
-            twinkleProperties.saturationMax = 255;
-            twinkleProperties.valueMin = brightness / 2;
-            twinkleProperties.valueMax = brightness;
-            twinkleProperties.hsvBackground = HSVData(0, 255, 0);
-            twinkle.setProperties(&twinkleProperties);
-            g_pPixelUpdate = &twinkle;
+            TwinkleScene* pScene = activateScene<TwinkleScene>();
+
+            pScene->twinkleProperties.lifetimeMin = g_delay / 2;
+            pScene->twinkleProperties.lifetimeMax = g_delay;
+            pScene->twinkleProperties.twinkleRate = 80;
+            pScene->twinkleProperties.hueMin = 0;
+            pScene->twinkleProperties.hueMax = 0;
+            pScene->twinkleProperties.saturationMin = 255;
+            pScene->twinkleProperties.saturationMax = 255;
+            pScene->twinkleProperties.valueMin = brightness / 2;
+            pScene->twinkleProperties.valueMax = brightness;
+            pScene->twinkleProperties.hsvBackground = HSVData(0, 255, 0);
+            pScene->twinkle.setProperties(&pScene->twinkleProperties);
+            g_pPixelUpdate = &pScene->twinkle;
+            interpolateFrames(&pScene->interpolator);
             break;
         }
     case Twinkle_Green:
         {
-            twinkleProperties.lifetimeMin = g_delay / 2;
-            twinkleProperties.lifetimeMax = g_delay;
-            twinkleProperties.probability = 250;
-            twinkleProperties.hueMin = 84;
-            twinkleProperties.hueMax = 84;
-            twinkleProperties.saturationMin = 255;
-            twinkleProperties.saturationMax = 255;
-            twinkleProperties.valueMin = brightness / 2;
-            twinkleProperties.valueMax = brightness;
-            twinkleProperties.hsvBackground = HSVData(84, 255, 0);
-            twinkle.setProperties(&twinkleProperties);
-            g_pPixelUpdate = &twinkle;
+            TwinkleScene* pScene = activateScene<TwinkleScene>();
+
+            pScene->twinkleProperties.lifetimeMin = g_delay / 2;
+            pScene->twinkleProperties.lifetimeMax = g_delay;
+            pScene->twinkleProperties.twinkleRate = 80;
+            pScene->twinkleProperties.hueMin = 84;
+            pScene->twinkleProperties.hueMax = 84;
+            pScene->twinkleProperties.saturationMin = 255;
+            pScene->twinkleProperties.saturationMax = 255;
+            pScene->twinkleProperties.valueMin = brightness / 2;
+            pScene->twinkleProperties.valueMax = brightness;
+            pScene->twinkleProperties.hsvBackground = HSVData(84, 255, 0);
+            pScene->twinkle.setProperties(&pScene->twinkleProperties);
+            g_pPixelUpdate = &pScene->twinkle;
+            interpolateFrames(&pScene->interpolator);
             break;
         }
     case Twinkle_AnyColor:
         {
-            twinkleProperties.lifetimeMin = g_delay / 2;
-            twinkleProperties.lifetimeMax = g_delay;
-            twinkleProperties.probability = 250;
-            twinkleProperties.hueMin = 0;
-            twinkleProperties.hueMax = 255;
-            twinkleProperties.saturationMin = 0;
-            twinkleProperties.saturationMax = 255;
-            twinkleProperties.valueMin = brightness / 2;
-            twinkleProperties.valueMax = brightness;
-            twinkleProperties.hsvBackground = HSVData(0, 0, 0);
-            twinkle.setProperties(&twinkleProperties);
-            g_pPixelUpdate = &twinkle;
+            TwinkleScene* pScene = activateScene<TwinkleScene>();
+
+            pScene->twinkleProperties.lifetimeMin = g_delay / 2;
+            pScene->twinkleProperties.lifetimeMax = g_delay;
+            pScene->twinkleProperties.twinkleRate = 80;
+            pScene->twinkleProperties.hueMin = 0;
+            pScene->twinkleProperties.hueMax = 255;
+            pScene->twinkleProperties.saturationMin = 0;
+            pScene->twinkleProperties.saturationMax = 255;
+            pScene->twinkleProperties.valueMin = brightness / 2;
+            pScene->twinkleProperties.valueMax = brightness;
+            pScene->twinkleProperties.hsvBackground = HSVData(0, 0, 0);
+            pScene->twinkle.setProperties(&pScene->twinkleProperties);
+            g_pPixelUpdate = &pScene->twinkle;
+            interpolateFrames(&pScene->interpolator);
             break;
         }
     case Twinkle_Snow:
         {
-            twinkleProperties.lifetimeMin = g_delay / 2;
-            twinkleProperties.lifetimeMax = g_delay;
-            twinkleProperties.probability = 250;
-            twinkleProperties.hueMin = 0;
-            twinkleProperties.hueMax = 0;
-            twinkleProperties.saturationMin = 0;
-            twinkleProperties.saturationMax = 0;
-            twinkleProperties.valueMin = brightness / 2;
-            twinkleProperties.valueMax = brightness;
-            twinkleProperties.hsvBackground = HSVData(0x00, 0x00, brightness >= 10 ? brightness / 10 : 1);
-            twinkle.setProperties(&twinkleProperties);
-            g_pPixelUpdate = &twinkle;
+            TwinkleScene* pScene = activateScene<TwinkleScene>();
+
+            pScene->twinkleProperties.lifetimeMin = g_delay / 2;
+            pScene->twinkleProperties.lifetimeMax = g_delay;
+            pScene->twinkleProperties.twinkleRate = 80;
+            pScene->twinkleProperties.hueMin = 0;
+            pScene->twinkleProperties.hueMax = 0;
+            pScene->twinkleProperties.saturationMin = 0;
+            pScene->twinkleProperties.saturationMax = 0;
+            pScene->twinkleProperties.valueMin = brightness / 2;
+            pScene->twinkleProperties.valueMax = brightness;
+            pScene->twinkleProperties.hsvBackground = HSVData(0x00, 0x00, brightness >= 10 ? brightness / 10 : 1);
+            pScene->twinkle.setProperties(&pScene->twinkleProperties);
+            g_pPixelUpdate = &pScene->twinkle;
+            interpolateFrames(&pScene->interpolator);
             break;
         }
     case Running_Lights:
         {
+            RunningLightsScene* pScene = activateScene<RunningLightsScene>();
+
             HSVData hsv;
             hsv.hue = 0;
             hsv.saturation = 0;
             hsv.value = brightness;
-            runningLights.setProperties(&hsv, g_delay/4);
-            g_pPixelUpdate = &runningLights;
+            pScene->runningLights.setProperties(&hsv, g_delay/4);
+            g_pPixelUpdate = &pScene->runningLights;
             break;
         }
     case Meteor:
         {
-            meteorProperties.brightColor.red = brightness;
-            meteorProperties.brightColor.green = brightness;
-            meteorProperties.brightColor.blue = brightness;
-            meteorProperties.size = 10;
-            meteorProperties.trailDecay = 64;
-            meteorProperties.isDecayRandom = true;
-            meteorProperties.delay = g_delay / 5;
-            meteor.setProperties(&meteorProperties);
-            g_pPixelUpdate = &meteor;
+            MeteorScene* pScene = activateScene<MeteorScene>();
+
+            pScene->meteorProperties.brightColor.red = brightness;
+            pScene->meteorProperties.brightColor.green = brightness;
+            pScene->meteorProperties.brightColor.blue = brightness;
+            pScene->meteorProperties.size = 10;
+            pScene->meteorProperties.trailDecay = 64;
+            pScene->meteorProperties.isDecayRandom = true;
+            pScene->meteorProperties.delay = g_delay / 5;
+            pScene->meteor.setProperties(&pScene->meteorProperties);
+            pScene->meteor.setPixelOrder(NULL);
+            g_pPixelUpdate = &pScene->meteor;
+            break;
+        }
+    case Meteor_Snowfall:
+        {
+            MeteorScene* pScene = activateScene<MeteorScene>();
+
+            // Same as the Meteor animation but falling from the top of the tree to the bottom.
+            pScene->meteorProperties.brightColor.red = brightness;
+            pScene->meteorProperties.brightColor.green = brightness;
+            pScene->meteorProperties.brightColor.blue = brightness;
+            pScene->meteorProperties.size = 10;
+            pScene->meteorProperties.trailDecay = 64;
+            pScene->meteorProperties.isDecayRandom = true;
+            pScene->meteorProperties.delay = g_delay / 5;
+            pScene->meteor.setProperties(&pScene->meteorProperties);
+            pScene->meteor.setPixelOrder(g_treeLedsByHeight);
+            g_pPixelUpdate = &pScene->meteor;
+            break;
+        }
+    case Meteor_Over_Rainbow:
+        {
+            MeteorOverRainbowScene* pScene = activateScene<MeteorOverRainbowScene>();
+
+            // Slowly fading rainbow in the background at a quarter of the selected brightness.
+            RGBData pattern1[] = { RED };
+            RGBData pattern2[] = { VIOLET };
+            changeBrightness(pattern1, ARRAY_SIZE(pattern1), brightness / 4);
+            changeBrightness(pattern2, ARRAY_SIZE(pattern2), brightness / 4);
+            createInterpolatedPixelPattern(pScene->pixels1, ARRAY_SIZE(pScene->pixels1), pattern1, pattern2);
+            createInterpolatedPixelPattern(pScene->pixels2, ARRAY_SIZE(pScene->pixels2), pattern2, pattern1);
+            pScene->keyFrames[0] = {pScene->pixels1, g_delay * 8, true};
+            pScene->keyFrames[1] = {pScene->pixels2, g_delay * 8, true};
+            pScene->animation.setKeyFrames(pScene->keyFrames, 2);
+
+            // Snow falling over the top of it.
+            pScene->meteorProperties.brightColor.red = brightness;
+            pScene->meteorProperties.brightColor.green = brightness;
+            pScene->meteorProperties.brightColor.blue = brightness;
+            pScene->meteorProperties.size = 10;
+            pScene->meteorProperties.trailDecay = 64;
+            pScene->meteorProperties.isDecayRandom = true;
+            pScene->meteorProperties.delay = g_delay / 5;
+            pScene->meteor.setProperties(&pScene->meteorProperties);
+            pScene->meteor.setPixelOrder(NULL);
+
+            pScene->compositor.clearLayers();
+            pScene->compositor.addLayer(&pScene->animation, Blend_Normal);
+            pScene->compositor.addLayer(&pScene->meteor, Blend_Max);
+            pScene->compositor.setFrameBudget(g_frameBudget);
+            g_pPixelUpdate = &pScene->compositor;
+            break;
+        }
+    case Zoned_Levels:
+        {
+            ZonedLevelsScene* pScene = activateScene<ZonedLevelsScene>();
+
+            // Solid green base which never changes after the first frame.
+            RGBData pattern[] = { GREEN };
+            createRepeatingPixelPattern(pScene->zonePattern, ARRAY_SIZE(pattern), pattern, ARRAY_SIZE(pattern));
+            pScene->keyFrames[0] = {NULL, 0x7FFFFFFF, false, pScene->zonePattern, ARRAY_SIZE(pattern), 0};
+            pScene->zoneBottom.setKeyFrames(pScene->keyFrames, 1);
+
+            // Candles flickering on the middle levels.
+            pScene->flickerProperties.timeMin = 2;
+            pScene->flickerProperties.timeMax = 3;
+            pScene->flickerProperties.stayBrightFactor = 100;
+            pScene->flickerProperties.brightnessMin = 128;
+            pScene->flickerProperties.brightnessMax = 255;
+            pScene->flickerProperties.baseRGBColour = DARK_ORANGE;
+            pScene->zoneMiddle.setProperties(&pScene->flickerProperties);
+
+            // White twinkles at the top of the tree.
+            pScene->twinkleProperties.lifetimeMin = g_delay / 2;
+            pScene->twinkleProperties.lifetimeMax = g_delay;
+            pScene->twinkleProperties.twinkleRate = 400;
+            pScene->twinkleProperties.hueMin = 0;
+            pScene->twinkleProperties.hueMax = 0;
+            pScene->twinkleProperties.saturationMin = 0;
+            pScene->twinkleProperties.saturationMax = 0;
+            pScene->twinkleProperties.valueMin = 128;
+            pScene->twinkleProperties.valueMax = 255;
+            pScene->twinkleProperties.hsvBackground = HSVData(0, 0, 0);
+            pScene->zoneTop.setProperties(&pScene->twinkleProperties);
+
+            // Each level gets its own brightness relative to the brightness knob.
+            pScene->zoneMap.clearZones();
+            pScene->zoneMap.addZone(&pScene->zoneBottom, 0, ZONE_BOTTOM_COUNT,
+                                    ZoneMapBase::UPDATE_ONCE, brightness / 4);
+            pScene->zoneMap.addZone(&pScene->zoneMiddle, ZONE_BOTTOM_COUNT, ZONE_MIDDLE_COUNT,
+                                    10, brightness / 2);
+            pScene->zoneMap.addZone(&pScene->zoneTop, ZONE_BOTTOM_COUNT + ZONE_MIDDLE_COUNT, ZONE_TOP_COUNT,
+                                    0, brightness);
+            g_pPixelUpdate = &pScene->zoneMap;
             break;
         }
     case Candle_Flicker:
         {
-            flickerProperties.timeMin = 2;
-            flickerProperties.timeMax = 3;
-            flickerProperties.stayBrightFactor = 100;
-            flickerProperties.brightnessMin = brightness / 2;
-            flickerProperties.brightnessMax = brightness;
-            flickerProperties.baseRGBColour = DARK_ORANGE;
-            flicker.setProperties(&flickerProperties);
-            g_pPixelUpdate = &flicker;
+            FlickerScene* pScene = activateScene<FlickerScene>();
+
+            pScene->flickerProperties.timeMin = 2;
+            pScene->flickerProperties.timeMax = 3;
+            pScene->flickerProperties.stayBrightFactor = 100;
+            pScene->flickerProperties.brightnessMin = brightness / 2;
+            pScene->flickerProperties.brightnessMax = brightness;
+            pScene->flickerProperties.baseRGBColour = DARK_ORANGE;
+            pScene->flicker.setProperties(&pScene->flickerProperties);
+            g_pPixelUpdate = &pScene->flicker;
+            interpolateFrames(&pScene->interpolator);
             break;
         }
     default:
         {
-            RGBData pattern = BLACK;
-            createRepeatingPixelPattern(pixels1, ARRAY_SIZE(pixels1), &pattern, 1);
-            keyFrames[0] = {pixels1, 0x7FFFFFFF, false};
-            animation.setKeyFrames(keyFrames, 1);
-            g_pPixelUpdate = &animation;
+            KeyFrameScene* pScene = activateScene<KeyFrameScene>();
+
+            RGBData pattern[] = { BLACK };
+            createRepeatingPixelPattern(pScene->pattern1, ARRAY_SIZE(pattern), pattern, ARRAY_SIZE(pattern));
+            pScene->keyFrames[0] = {NULL, 0x7FFFFFFF, false, pScene->pattern1, ARRAY_SIZE(pattern), 0};
+            pScene->animation.setKeyFrames(pScene->keyFrames, 1);
+            g_pPixelUpdate = &pScene->animation;
+            break;
+        }
+    }
+}
+
+static void interpolateFrames(FrameInterpolatorBase* pInterpolator)
+{
+    // Only used for the animations which change smoothly and recompute every pixel of each frame. The solid and chase
+    // animations are already played back by the driver, running lights and meteors step too far between frames to be
+    // blended and the zones of Zoned_Levels each run at their own rate. The interpolator lives in the scene so that
+    // the scenes which don't use it don't pay for its frames.
+    if (FRAME_INTERPOLATION_MILLISECONDS > 0)
+    {
+        pInterpolator->setSource(g_pPixelUpdate, FRAME_INTERPOLATION_MILLISECONDS);
+        g_pPixelUpdate = pInterpolator;
+    }
+}
+
+static void renderPixels(NeoPixel& ledControl)
+{
+    // Step through continuously changing animations at the rate the frames go out to the LEDs.
+    uint32_t frameMilliseconds = (ledControl.getFrameMicroseconds() + 999) / 1000;
+    uint64_t frameTime;
+
+    if (ledControl.getFrameQueueDepth() == 0 || !g_pPixelUpdate->getNextFrameTime(frameMilliseconds, &frameTime))
+    {
+        g_pPixelUpdate->updatePixels(ledControl);
+        return;
+    }
+
+    // Fill any free room in the frame queue while there is nothing else to do. The due time of each frame is
+    // converted from the 64-bit tick source to the us_ticker time used by the NeoPixel interrupt handler.
+    while (!ledControl.isFrameQueueFull() && frameTime <= tickMilliseconds() + RENDER_AHEAD_MILLISECONDS)
+    {
+        int32_t  delay = (int32_t)(frameTime * 1000 - tickMicroseconds());
+        uint32_t setCount = ledControl.getSetCount();
+
+        ledControl.startQueuedFrame(us_ticker_read() + delay);
+        g_pPixelUpdate->renderNextFrame(ledControl);
+        ledControl.endQueuedFrame();
+        // Don't spin here if the animation had nothing new to show.
+        if (ledControl.getSetCount() == setCount ||
+            !g_pPixelUpdate->getNextFrameTime(frameMilliseconds, &frameTime))
+        {
             break;
         }
     }
@@ -650,5 +1040,107 @@ static void advanceToNextAnimation(AdvanceMode advance)
         }
         g_currAnimation = (Animations)(g_currAnimation - 1);
     }
+    TRACE(TRACE_ANIMATION_SWITCH, g_currAnimation);
     updateAnimation();
 }
+
+static bool sampleEncoder(Knobs knob, Encoder& encoder, EncoderState* pState, NeoPixel& ledControl)
+{
+    bool isChanged = encoder.sample(pState);
+    if (SCRIPTED_ENCODER_INPUT && !isChanged)
+    {
+        isChanged = playEncoderScript(knob, pState);
+    }
+    if (!isChanged)
+    {
+        return false;
+    }
+
+    // Releasing the shaft doesn't change anything on the LEDs so only time turns and presses.
+    if (pState->count != 0 || pState->isPressed)
+    {
+        g_inputLatency.inputSeen(knob, us_ticker_read(), ledControl.getNextFrameId());
+    }
+    if (pState->count != 0)
+    {
+        TRACE(TRACE_ENCODER_TURN, (knob << 8) | (uint8_t)pState->count);
+    }
+    if (pState->isPressed)
+    {
+        TRACE(TRACE_ENCODER_PRESS, knob);
+    }
+    return true;
+}
+
+static bool playEncoderScript(Knobs knob, EncoderState* pState)
+{
+    const ScriptedEncoderInput* pInput = &g_encoderScript[g_encoderScriptIndex];
+    uint64_t                    currTime = tickMilliseconds();
+    if (pInput->knob != knob || currTime < g_nextScriptedInputTime)
+    {
+        return false;
+    }
+
+    pState->count = pInput->count;
+    pState->isPressed = false;
+    g_nextScriptedInputTime = currTime + pInput->milliseconds;
+    g_encoderScriptIndex = (g_encoderScriptIndex + 1) % ARRAY_SIZE(g_encoderScript);
+    return true;
+}
+
+static void dumpMemoryUsage()
+{
+    // Compare these numbers between builds with and without PIXEL_STORAGE_XRGB defined to pick the pixel layout.
+    printf("pixel storage: %s (%u bytes/pixel) for %u LEDs\n",
+           sizeof(PixelData) == sizeof(XRGBData) ? "XRGB" : "RGB", sizeof(PixelData), LED_COUNT);
+    printf("  KeyFrameScene:          %u bytes\n", sizeof(KeyFrameScene));
+    printf("  RainbowScene:           %u bytes\n", sizeof(RainbowScene));
+    printf("  TwinkleScene:           %u bytes\n", sizeof(TwinkleScene));
+    printf("  FlickerScene:           %u bytes\n", sizeof(FlickerScene));
+    printf("  RunningLightsScene:     %u bytes\n", sizeof(RunningLightsScene));
+    printf("  MeteorScene:            %u bytes\n", sizeof(MeteorScene));
+    printf("  MeteorOverRainbowScene: %u bytes\n", sizeof(MeteorOverRainbowScene));
+    printf("  ZonedLevelsScene:       %u bytes\n", sizeof(ZonedLevelsScene));
+    printf("  Shared scene arena:     %u bytes\n", sizeof(SceneArena));
+}
+
+static void dumpFrameStats(NeoPixel& ledControl)
+{
+    NeoPixelFrameStats stats;
+    ledControl.getFrameStats(&stats, true);
+
+    // One line per histogram with the counts for each bucket. The header gives the smallest time in each bucket.
+    printf("histogram,count,min,max,mean");
+    for (uint32_t i = 0 ; i < Histogram::BUCKET_COUNT ; i++)
+    {
+        printf(",%lu+", Histogram::getBucketStart(i));
+    }
+    printf("\n");
+    dumpHistogram("latency", &stats.latency);
+    dumpHistogram("flipInterval", &stats.flipInterval);
+    printf("droppedFrames,%lu\n", stats.droppedFrames);
+}
+
+static void dumpInputLatency()
+{
+    // Uses the same columns as the histograms printed by dumpFrameStats().
+    static const char* const knobNames[Max_Knob] = { "patternLatency", "speedLatency", "brightnessLatency" };
+
+    for (uint32_t i = 0 ; i < Max_Knob ; i++)
+    {
+        Histogram latency;
+        g_inputLatency.getLatency(i, &latency, true);
+        dumpHistogram(knobNames[i], &latency);
+    }
+}
+
+static void dumpHistogram(const char* pName, const Histogram* pHistogram)
+{
+    printf("%s,%lu,%lu,%lu,%lu",
+           pName, pHistogram->getCount(), pHistogram->getMin(), pHistogram->getMax(), pHistogram->getMean());
+    for (uint32_t i = 0 ; i < Histogram::BUCKET_COUNT ; i++)
+    {
+        printf(",%lu", pHistogram->getBucket(i));
+    }
+    printf("\n");
+}
@@ -0,0 +1,330 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Times each of the animation engines and the Pixel.h colour conversions at a range of strand lengths on the desktop
+   machine. The engines are run against a ManualTickSource so every run renders the same frames no matter how fast
+   the host is. Results are printed as CSV lines so that they can be captured and compared between builds:
+       benchmark,leds,frames,sets,ns/frame,ns/pixel
+   The NeoPixel encoder needs the real hardware so its encode_* lines come from runBenchmarks() in the firmware. Run
+   with "make bench". */
+#include <mbed.h>
+#include <time.h>
+#include "Animation.h"
+#include "FrameInterpolator.h"
+#include "TickSource.h"
+
+
+// Number of simulated milliseconds to run each engine for. The engines are updated once per simulated millisecond.
+#define BENCHMARK_FRAMES    1000
+// Number of times to repeat each of the colour conversion benchmarks.
+#define BENCHMARK_REPEATS   100
+// Rate at which the *_interpolated benchmarks run their engine. The frames in between are blended by FrameInterpolator.
+#define BENCHMARK_INTERPOLATION_MILLISECONDS    20
+
+
+// Stands in for the NeoPixel driver so that only the time spent in the engine itself is measured.
+class NullPixelSink : public IPixelSink
+{
+public:
+    NullPixelSink()
+    {
+        m_setCount = 0;
+    }
+
+    uint32_t getSetCount()
+    {
+        return m_setCount;
+    }
+
+    // IPixelSink methods.
+    virtual void set(const RGBData* pPixels, size_t pixelCount)
+    {
+        m_setCount++;
+    }
+    virtual void set(const XRGBData* pPixels, size_t pixelCount)
+    {
+        m_setCount++;
+    }
+    virtual void set(const RGB16Data* pPixels, size_t pixelCount)
+    {
+        m_setCount++;
+    }
+    virtual void setRange(const XRGBData* pPixels, size_t firstPixel, size_t pixelCount)
+    {
+        m_setCount++;
+    }
+    virtual void setPattern(const PixelData* pPattern, size_t patternLength, size_t patternOffset,
+                            size_t pixelCount)
+    {
+        m_setCount++;
+    }
+    virtual bool setPlaylist(const AnimationKeyFrame* pFrames, size_t frameCount, size_t pixelCount)
+    {
+        // Time the engine sending each frame itself.
+        return false;
+    }
+
+protected:
+    uint32_t m_setCount;
+};
+
+
+static ManualTickSource g_benchmarkClock;
+
+
+template <size_t PIXEL_COUNT> static void benchmarkLedCount();
+template <size_t PIXEL_COUNT> static void benchmarkKeyFrames(const char* pName, const char* pInterpolatedName,
+                                                             bool interpolate, uint8_t space);
+template <size_t PIXEL_COUNT> static void benchmarkTwinkle();
+template <size_t PIXEL_COUNT> static void benchmarkFlicker();
+template <size_t PIXEL_COUNT> static void benchmarkRunningLights();
+template <size_t PIXEL_COUNT> static void benchmarkMeteor();
+template <size_t PIXEL_COUNT> static void timeInterpolatedEngine(const char* pName, IPixelUpdate* pEngine);
+static void     timeEngine(const char* pName, IPixelUpdate* pEngine, size_t ledCount);
+static void     benchmarkConversions(size_t ledCount);
+static void     fillTestPixels(PixelData* pPixels, size_t pixelCount);
+static uint64_t readNanoseconds();
+static void     printResult(const char* pName, size_t ledCount, uint32_t frames, uint32_t sets, uint64_t nanoseconds);
+
+
+int main()
+{
+    setTickSource(&g_benchmarkClock);
+
+    printf("benchmark,leds,frames,sets,ns/frame,ns/pixel\n");
+    benchmarkLedCount<50>();
+    benchmarkLedCount<100>();
+    benchmarkLedCount<200>();
+    benchmarkLedCount<500>();
+    benchmarkLedCount<1000>();
+    benchmarkLedCount<2000>();
+
+    setTickSource(NULL);
+    return 0;
+}
+
+template <size_t PIXEL_COUNT>
+static void benchmarkLedCount()
+{
+    benchmarkKeyFrames<PIXEL_COUNT>("keyframes_static", NULL, false, Interpolate_Hsv);
+    benchmarkKeyFrames<PIXEL_COUNT>("keyframes_hsv", "keyframes_hsv_interpolated", true, Interpolate_Hsv);
+    benchmarkKeyFrames<PIXEL_COUNT>("keyframes_oklab", "keyframes_oklab_interpolated", true, Interpolate_Oklab);
+    benchmarkTwinkle<PIXEL_COUNT>();
+    benchmarkFlicker<PIXEL_COUNT>();
+    benchmarkRunningLights<PIXEL_COUNT>();
+    benchmarkMeteor<PIXEL_COUNT>();
+    benchmarkConversions(PIXEL_COUNT);
+}
+
+template <size_t PIXEL_COUNT>
+static void benchmarkKeyFrames(const char* pName, const char* pInterpolatedName, bool interpolate, uint8_t space)
+{
+    static const RGBData          pattern[] = { RED, DARK_ORANGE, YELLOW, GREEN, BLUE };
+    const size_t                  patternLength = sizeof(pattern) / sizeof(pattern[0]);
+    static PixelData              pixels[2 * PIXEL_COUNT];
+    static Animation<PIXEL_COUNT> animation;
+    AnimationKeyFrame             keyFrames[patternLength];
+    size_t                        frameCount = 0;
+
+    g_benchmarkClock.setMicroseconds(0);
+    if (interpolate)
+    {
+        // Blend between two different full frames so that every pixel has to be interpolated.
+        fillTestPixels(pixels, 2 * PIXEL_COUNT);
+        keyFrames[0] = {pixels, 500, true, NULL, 0, 0, space};
+        keyFrames[1] = {pixels + PIXEL_COUNT, 500, true, NULL, 0, 0, space};
+        frameCount = 2;
+    }
+    else
+    {
+        // A chase like the Chase_* animations.
+        createRepeatingPixelPattern(pixels, patternLength, pattern, patternLength);
+        for (uint16_t i = 0 ; i < patternLength ; i++)
+        {
+            keyFrames[i] = {NULL, 50, false, pixels, patternLength, i};
+        }
+        frameCount = patternLength;
+    }
+    animation.setKeyFrames(keyFrames, frameCount);
+    timeEngine(pName, &animation, PIXEL_COUNT);
+    if (pInterpolatedName)
+    {
+        g_benchmarkClock.setMicroseconds(0);
+        animation.setKeyFrames(keyFrames, frameCount);
+        timeInterpolatedEngine<PIXEL_COUNT>(pInterpolatedName, &animation);
+    }
+}
+
+template <size_t PIXEL_COUNT>
+static void benchmarkTwinkle()
+{
+    static TwinkleAnimation<PIXEL_COUNT> twinkle;
+
+    // Same settings as the Twinkle_AnyColor animation.
+    TwinkleProperties properties;
+    properties.lifetimeMin = 125;
+    properties.lifetimeMax = 250;
+    properties.twinkleRate = 80;
+    properties.hueMin = 0;
+    properties.hueMax = 255;
+    properties.saturationMin = 0;
+    properties.saturationMax = 255;
+    properties.valueMin = 64;
+    properties.valueMax = 128;
+    properties.hsvBackground = HSVData(0, 0, 0);
+
+    g_benchmarkClock.setMicroseconds(0);
+    twinkle.setProperties(&properties);
+    timeEngine("twinkle", &twinkle, PIXEL_COUNT);
+
+    g_benchmarkClock.setMicroseconds(0);
+    twinkle.setProperties(&properties);
+    timeInterpolatedEngine<PIXEL_COUNT>("twinkle_interpolated", &twinkle);
+}
+
+template <size_t PIXEL_COUNT>
+static void benchmarkFlicker()
+{
+    static FlickerAnimation<PIXEL_COUNT> flicker;
+
+    // Same settings as the Candle_Flicker animation.
+    FlickerProperties properties;
+    properties.timeMin = 2;
+    properties.timeMax = 3;
+    properties.stayBrightFactor = 100;
+    properties.brightnessMin = 64;
+    properties.brightnessMax = 128;
+    properties.baseRGBColour = DARK_ORANGE;
+
+    g_benchmarkClock.setMicroseconds(0);
+    flicker.setProperties(&properties);
+    timeEngine("flicker", &flicker, PIXEL_COUNT);
+
+    g_benchmarkClock.setMicroseconds(0);
+    flicker.setProperties(&properties);
+    timeInterpolatedEngine<PIXEL_COUNT>("flicker_interpolated", &flicker);
+}
+
+template <size_t PIXEL_COUNT>
+static void benchmarkRunningLights()
+{
+    static RunningLightsAnimation<PIXEL_COUNT> runningLights;
+
+    HSVData hsv(0, 0, 128);
+    g_benchmarkClock.setMicroseconds(0);
+    runningLights.setProperties(&hsv, 10);
+    timeEngine("running_lights", &runningLights, PIXEL_COUNT);
+}
+
+template <size_t PIXEL_COUNT>
+static void benchmarkMeteor()
+{
+    static MeteorAnimation<PIXEL_COUNT> meteor;
+
+    // Same settings as the Meteor animation but updating every millisecond.
+    MeteorProperties properties;
+    properties.brightColor = RGBData(128, 128, 128);
+    properties.size = 10;
+    properties.trailDecay = 64;
+    properties.isDecayRandom = true;
+    properties.delay = 1;
+
+    g_benchmarkClock.setMicroseconds(0);
+    meteor.setProperties(&properties);
+    timeEngine("meteor", &meteor, PIXEL_COUNT);
+}
+
+template <size_t PIXEL_COUNT>
+static void timeInterpolatedEngine(const char* pName, IPixelUpdate* pEngine)
+{
+    // The time includes blending every frame in between the ones rendered by pEngine.
+    static FrameInterpolator<PIXEL_COUNT> interpolator;
+    interpolator.setSource(pEngine, BENCHMARK_INTERPOLATION_MILLISECONDS);
+    timeEngine(pName, &interpolator, PIXEL_COUNT);
+}
+
+static void timeEngine(const char* pName, IPixelUpdate* pEngine, size_t ledCount)
+{
+    NullPixelSink sink;
+
+    uint64_t startTime = readNanoseconds();
+    for (uint32_t i = 0 ; i < BENCHMARK_FRAMES ; i++)
+    {
+        g_benchmarkClock.advanceMilliseconds(1);
+        pEngine->updatePixels(sink);
+    }
+    uint64_t elapsedTime = readNanoseconds() - startTime;
+
+    printResult(pName, ledCount, BENCHMARK_FRAMES, sink.getSetCount(), elapsedTime);
+}
+
+static void benchmarkConversions(size_t ledCount)
+{
+    RGBData* pRgbPixels = new RGBData[ledCount];
+    HSVData* pHsvPixels = new HSVData[ledCount];
+    for (size_t i = 0 ; i < ledCount ; i++)
+    {
+        pRgbPixels[i] = RGBData(i * 7, i * 13, i * 29);
+    }
+
+    uint64_t startTime = readNanoseconds();
+    for (uint32_t i = 0 ; i < BENCHMARK_REPEATS ; i++)
+    {
+        for (size_t j = 0 ; j < ledCount ; j++)
+        {
+            rgbToHsv(&pHsvPixels[j], &pRgbPixels[j]);
+        }
+    }
+    printResult("rgb_to_hsv", ledCount, BENCHMARK_REPEATS, 0, readNanoseconds() - startTime);
+
+    startTime = readNanoseconds();
+    for (uint32_t i = 0 ; i < BENCHMARK_REPEATS ; i++)
+    {
+        for (size_t j = 0 ; j < ledCount ; j++)
+        {
+            hsvToRgb(&pRgbPixels[j], &pHsvPixels[j]);
+        }
+    }
+    printResult("hsv_to_rgb", ledCount, BENCHMARK_REPEATS, 0, readNanoseconds() - startTime);
+
+    delete[] pHsvPixels;
+    delete[] pRgbPixels;
+}
+
+static void fillTestPixels(PixelData* pPixels, size_t pixelCount)
+{
+    // Spread the pixels around the colour wheel so that the conversions don't all take the same path.
+    for (size_t i = 0 ; i < pixelCount ; i++)
+    {
+        HSVData hsv(i * 37, 128 + (i & 0x7F), 64 + (i & 0xBF));
+        hsvToRgb(&pPixels[i], &hsv);
+    }
+}
+
+static uint64_t readNanoseconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void printResult(const char* pName, size_t ledCount, uint32_t frames, uint32_t sets, uint64_t nanoseconds)
+{
+    // The host is fast enough that a whole nanosecond per pixel would hide most of the differences.
+    double nanosecondsPerFrame = (double)nanoseconds / frames;
+    double nanosecondsPerPixel = nanosecondsPerFrame / ledCount;
+
+    printf("%s,%u,%u,%u,%.0f,%.2f\n", pName, (unsigned)ledCount, frames, sets, nanosecondsPerFrame,
+           nanosecondsPerPixel);
+}
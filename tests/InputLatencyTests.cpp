@@ -0,0 +1,217 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Tests for InputLatency, feeding it scripted sequences of inputs and frames sent by the driver and then checking the
+   latency histograms that it builds from them. */
+#include <mbed.h>
+#include "Histogram.h"
+#include "InputLatency.h"
+#include "TestHarness.h"
+
+
+static void checkSingleLatency(InputLatency* pInputLatency, uint32_t input, uint32_t expectedLatency)
+{
+    Histogram latency;
+
+    pInputLatency->getLatency(input, &latency);
+    CHECK_EQUAL(1, latency.getCount());
+    CHECK_EQUAL(expectedLatency, latency.getMin());
+    CHECK_EQUAL(expectedLatency, latency.getMax());
+    CHECK_EQUAL(expectedLatency, latency.getMean());
+}
+
+static uint32_t getLatencyCount(InputLatency* pInputLatency, uint32_t input)
+{
+    Histogram latency;
+
+    pInputLatency->getLatency(input, &latency);
+    return latency.getCount();
+}
+
+
+static void testLatencyMeasuredToFrameRenderedAfterInput()
+{
+    InputLatency inputLatency;
+
+    inputLatency.inputSeen(0, 1000, 5);
+    // Older frames that were already on their way out don't count.
+    inputLatency.frameSent(4, 1500);
+    CHECK_EQUAL(0, getLatencyCount(&inputLatency, 0));
+    inputLatency.frameSent(5, 2500);
+    checkSingleLatency(&inputLatency, 0, 1500);
+
+    // Once recorded, later frames don't record it again.
+    inputLatency.frameSent(5, 3000);
+    inputLatency.frameSent(6, 3500);
+    checkSingleLatency(&inputLatency, 0, 1500);
+}
+
+static void testDroppedFramesStillEndTheWait()
+{
+    InputLatency inputLatency;
+
+    // The frame rendered after the input, and the two after it, were replaced by newer ones before they could be
+    // sent.
+    inputLatency.inputSeen(1, 100, 10);
+    inputLatency.frameSent(9, 400);
+    inputLatency.frameSent(13, 700);
+    checkSingleLatency(&inputLatency, 1, 600);
+}
+
+static void testPendingInputIgnoresLaterInput()
+{
+    InputLatency inputLatency;
+
+    // Latency is measured from the oldest input still waiting to be shown.
+    inputLatency.inputSeen(0, 1000, 5);
+    inputLatency.inputSeen(0, 1800, 6);
+    inputLatency.frameSent(5, 3000);
+    checkSingleLatency(&inputLatency, 0, 2000);
+
+    // The later input wasn't remembered either, so frame 6 going out records nothing more.
+    inputLatency.frameSent(6, 3500);
+    CHECK_EQUAL(1, getLatencyCount(&inputLatency, 0));
+
+    // Input is accepted again once the pending one has been shown.
+    inputLatency.inputSeen(0, 4000, 7);
+    inputLatency.frameSent(7, 4100);
+    Histogram latency;
+    inputLatency.getLatency(0, &latency);
+    CHECK_EQUAL(2, latency.getCount());
+    CHECK_EQUAL(100, latency.getMin());
+    CHECK_EQUAL(2000, latency.getMax());
+    CHECK_EQUAL(1050, latency.getMean());
+}
+
+static void testInputsTrackedSeparately()
+{
+    InputLatency inputLatency;
+
+    inputLatency.inputSeen(0, 1000, 5);
+    inputLatency.inputSeen(3, 1200, 7);
+    inputLatency.frameSent(6, 2000);
+    checkSingleLatency(&inputLatency, 0, 1000);
+    CHECK_EQUAL(0, getLatencyCount(&inputLatency, 3));
+    CHECK_EQUAL(0, getLatencyCount(&inputLatency, 1));
+    CHECK_EQUAL(0, getLatencyCount(&inputLatency, 2));
+
+    // Input 0 is pending again at the same time as input 3 and both are shown by the same frame.
+    inputLatency.inputSeen(0, 2100, 7);
+    inputLatency.frameSent(7, 2600);
+    checkSingleLatency(&inputLatency, 3, 1400);
+    Histogram latency;
+    inputLatency.getLatency(0, &latency);
+    CHECK_EQUAL(2, latency.getCount());
+    CHECK_EQUAL(500, latency.getMin());
+    CHECK_EQUAL(1000, latency.getMax());
+}
+
+static void testFrameIdAndTickerWrapAround()
+{
+    InputLatency inputLatency;
+
+    // The frame ids and us_ticker both wrap around while the input is pending.
+    inputLatency.inputSeen(2, 0xFFFFFF00, 0xFFFFFFFE);
+    inputLatency.frameSent(0xFFFFFFFD, 0xFFFFFF80);
+    CHECK_EQUAL(0, getLatencyCount(&inputLatency, 2));
+    inputLatency.frameSent(1, 0x100);
+    checkSingleLatency(&inputLatency, 2, 0x200);
+
+    // An id just before the wrap is still older than the one rendered after an input just after it.
+    inputLatency.inputSeen(2, 0x1000, 2);
+    inputLatency.frameSent(0xFFFFFFFF, 0x1800);
+    CHECK_EQUAL(1, getLatencyCount(&inputLatency, 2));
+    inputLatency.frameSent(2, 0x2000);
+    CHECK_EQUAL(2, getLatencyCount(&inputLatency, 2));
+}
+
+static void testHistogramBuckets()
+{
+    static const uint32_t latencies[] = { 0, 1, 3, 2, 1000, 1023, 1024, 70000 };
+    InputLatency          inputLatency;
+    uint32_t              ticker = 0;
+    uint64_t              total = 0;
+
+    for (uint32_t i = 0 ; i < sizeof(latencies) / sizeof(latencies[0]) ; i++)
+    {
+        inputLatency.inputSeen(1, ticker, i + 1);
+        inputLatency.frameSent(i + 1, ticker + latencies[i]);
+        ticker += 100000;
+        total += latencies[i];
+    }
+
+    Histogram latency;
+    inputLatency.getLatency(1, &latency);
+    CHECK_EQUAL(8, latency.getCount());
+    CHECK_EQUAL(0, latency.getMin());
+    CHECK_EQUAL(70000, latency.getMax());
+    CHECK_EQUAL(total / 8, latency.getMean());
+    // Bucket i counts the values from 2^(i-1) to 2^i - 1 and the last one also counts everything larger.
+    CHECK_EQUAL(1, latency.getBucket(0));
+    CHECK_EQUAL(1, latency.getBucket(1));
+    CHECK_EQUAL(2, latency.getBucket(2));
+    CHECK_EQUAL(0, latency.getBucket(3));
+    CHECK_EQUAL(2, latency.getBucket(10));
+    CHECK_EQUAL(1, latency.getBucket(11));
+    CHECK_EQUAL(1, latency.getBucket(Histogram::BUCKET_COUNT - 1));
+    uint32_t bucketTotal = 0;
+    for (uint32_t i = 0 ; i < Histogram::BUCKET_COUNT ; i++)
+    {
+        bucketTotal += latency.getBucket(i);
+    }
+    CHECK_EQUAL(8, bucketTotal);
+    CHECK_EQUAL(0, Histogram::getBucketStart(0));
+    CHECK_EQUAL(1, Histogram::getBucketStart(1));
+    CHECK_EQUAL(512, Histogram::getBucketStart(10));
+    CHECK_EQUAL(1024, Histogram::getBucketStart(11));
+}
+
+static void testGetLatencyCanClear()
+{
+    InputLatency inputLatency;
+    Histogram    latency;
+
+    inputLatency.inputSeen(0, 0, 1);
+    inputLatency.frameSent(1, 300);
+    inputLatency.getLatency(0, &latency, true);
+    CHECK_EQUAL(1, latency.getCount());
+    CHECK_EQUAL(300, latency.getMax());
+
+    inputLatency.getLatency(0, &latency);
+    CHECK_EQUAL(0, latency.getCount());
+    CHECK_EQUAL(0, latency.getMin());
+    CHECK_EQUAL(0, latency.getMax());
+    CHECK_EQUAL(0, latency.getMean());
+    CHECK_EQUAL(0, latency.getBucket(9));
+
+    // An input still pending when the histogram is cleared is recorded in the new interval.
+    inputLatency.inputSeen(0, 1000, 2);
+    inputLatency.getLatency(0, &latency, true);
+    inputLatency.frameSent(2, 1250);
+    checkSingleLatency(&inputLatency, 0, 250);
+}
+
+
+int main()
+{
+    RUN_TEST(testLatencyMeasuredToFrameRenderedAfterInput);
+    RUN_TEST(testDroppedFramesStillEndTheWait);
+    RUN_TEST(testPendingInputIgnoresLaterInput);
+    RUN_TEST(testInputsTrackedSeparately);
+    RUN_TEST(testFrameIdAndTickerWrapAround);
+    RUN_TEST(testHistogramBuckets);
+    RUN_TEST(testGetLatencyCanClear);
+
+    return testResults("InputLatencyTests");
+}
@@ -0,0 +1,319 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Tests for the Interlock.h primitives, as implemented for the host by Interlock_host.c, and for the Atomic<T> and
+   SpscRing classes built on top of them. */
+#include <mbed.h>
+#include <pthread.h>
+#include <sched.h>
+#include "Atomic.h"
+#include "Interlock.h"
+#include "SpscRing.h"
+#include "TestHarness.h"
+
+
+// Number of items passed through the ring by the threaded stress test. Can be overridden from the command line.
+#define STRESS_ITEMS    2000000
+
+
+static void testIncrementDecrementAddSubtract()
+{
+    volatile uint32_t count = 0xFFFFFFFF;
+    volatile int32_t  value = 10;
+
+    CHECK_EQUAL(0, interlockedIncrement(&count));
+    CHECK_EQUAL(1, interlockedIncrement(&count));
+    CHECK_EQUAL(0, interlockedDecrement(&count));
+    CHECK_EQUAL(0xFFFFFFFF, interlockedDecrement(&count));
+
+    CHECK_EQUAL(15, interlockedAdd(&value, 5));
+    CHECK_EQUAL(-5, interlockedSubtract(&value, 20));
+    CHECK_EQUAL(-5, value);
+    CHECK_EQUAL(-5, interlockedExchange(&value, 42));
+    CHECK_EQUAL(42, value);
+}
+
+static void testCompareExchange()
+{
+    volatile uint32_t value = 5;
+
+    // Returns the old value whether or not the exchange took place.
+    CHECK_EQUAL(5, interlockedCompareExchange(&value, 5, 7));
+    CHECK_EQUAL(7, value);
+    CHECK_EQUAL(7, interlockedCompareExchange(&value, 5, 9));
+    CHECK_EQUAL(7, value);
+    CHECK_EQUAL(7, interlockedCompareExchange(&value, 7, 0xFFFFFFFF));
+    CHECK_EQUAL(0xFFFFFFFF, value);
+}
+
+static void testFetchOrAnd()
+{
+    volatile uint32_t value = 0x0F;
+
+    CHECK_EQUAL(0x0F, interlockedFetchOr(&value, 0xF0));
+    CHECK_EQUAL(0xFF, value);
+    CHECK_EQUAL(0xFF, interlockedFetchOr(&value, 0x01));
+    CHECK_EQUAL(0xFF, value);
+    CHECK_EQUAL(0xFF, interlockedFetchAnd(&value, 0x3C));
+    CHECK_EQUAL(0x3C, value);
+    CHECK_EQUAL(0x3C, interlockedFetchAnd(&value, 0));
+    CHECK_EQUAL(0, value);
+}
+
+static void testLoadAcquireStoreRelease()
+{
+    volatile uint32_t value = 0;
+
+    interlockedStoreRelease(&value, 0x12345678);
+    interlockedMemoryBarrier();
+    CHECK_EQUAL(0x12345678, interlockedLoadAcquire(&value));
+}
+
+static void testAtomic()
+{
+    Atomic<uint32_t> value;
+
+    CHECK_EQUAL(0, value.load());
+    value.store(3);
+    CHECK_EQUAL(3, value.exchange(4));
+    CHECK_EQUAL(4, value.load());
+
+    // Each fetch returns the value from before the operation.
+    CHECK_EQUAL(4, value.fetchAdd(6));
+    CHECK_EQUAL(10, value.fetchSubtract(11));
+    CHECK_EQUAL(0xFFFFFFFF, value.load());
+    CHECK_EQUAL(0xFFFFFFFF, value.fetchAnd(0x0F));
+    CHECK_EQUAL(0x0F, value.fetchOr(0x30));
+    CHECK_EQUAL(0x3F, value.load());
+
+    // A failed compareExchange leaves the value alone and hands back the current value for a retry.
+    uint32_t expected = 0x3E;
+    CHECK(!value.compareExchange(&expected, 1));
+    CHECK_EQUAL(0x3F, expected);
+    CHECK_EQUAL(0x3F, value.load());
+    CHECK(value.compareExchange(&expected, 1));
+    CHECK_EQUAL(0x3F, expected);
+    CHECK_EQUAL(1, value.load());
+}
+
+static void testAtomicSigned()
+{
+    Atomic<int32_t> value(-2);
+
+    CHECK_EQUAL(-2, value.fetchAdd(1));
+    CHECK_EQUAL(-1, value.fetchSubtract(-3));
+    CHECK_EQUAL(2, value.load());
+}
+
+static void testSpscRingPushPop()
+{
+    SpscRing<uint32_t, 4> ring;
+    uint32_t              item = 0;
+
+    CHECK_EQUAL(4, ring.getCapacity());
+    CHECK_EQUAL(0, ring.getReadCount());
+    CHECK(!ring.pop(&item));
+
+    for (uint32_t i = 1 ; i <= 4 ; i++)
+    {
+        CHECK(!ring.isFull());
+        CHECK(ring.push(i));
+        CHECK_EQUAL(i, ring.getReadCount());
+    }
+    CHECK(ring.isFull());
+    CHECK(!ring.push(5));
+
+    for (uint32_t i = 1 ; i <= 4 ; i++)
+    {
+        CHECK(ring.pop(&item));
+        CHECK_EQUAL(i, item);
+    }
+    CHECK(!ring.pop(&item));
+    CHECK_EQUAL(0, ring.getReadCount());
+}
+
+static void testSpscRingWrapsAround()
+{
+    // Push and pop unevenly so that the head and tail wrap at every point in the ring, including past twice the
+    // capacity where the positions themselves wrap.
+    SpscRing<uint32_t, 3> ring;
+    uint32_t              nextPush = 0;
+    uint32_t              nextPop = 0;
+    uint32_t              item = 0;
+
+    for (uint32_t round = 0 ; round < 50 ; round++)
+    {
+        uint32_t pushes = 1 + round % 3;
+        for (uint32_t i = 0 ; i < pushes && !ring.isFull() ; i++)
+        {
+            CHECK(ring.push(nextPush++));
+        }
+        CHECK_EQUAL(nextPush - nextPop, ring.getReadCount());
+        CHECK(ring.getReadCount() <= 3);
+        uint32_t pops = 1 + (round * 7) % 3;
+        for (uint32_t i = 0 ; i < pops && ring.pop(&item) ; i++)
+        {
+            CHECK_EQUAL(nextPop, item);
+            nextPop++;
+        }
+    }
+    while (ring.pop(&item))
+    {
+        CHECK_EQUAL(nextPop, item);
+        nextPop++;
+    }
+    CHECK_EQUAL(nextPush, nextPop);
+}
+
+static void testSpscRingBaseHoldsSlotsUntilCommitRead()
+{
+    // The consumer can read ahead with getReadSlot(offset) and keep the slots until it calls commitRead().
+    SpscRingBase ring(4);
+    uint32_t     slots[4];
+
+    for (uint32_t i = 0 ; i < 3 ; i++)
+    {
+        slots[ring.getWriteSlot()] = 100 + i;
+        ring.commitWrite();
+    }
+    CHECK_EQUAL(3, ring.getReadCount());
+    CHECK_EQUAL(100, slots[ring.getReadSlot(0)]);
+    CHECK_EQUAL(101, slots[ring.getReadSlot(1)]);
+    CHECK_EQUAL(102, slots[ring.getReadSlot(2)]);
+
+    // Held slots still count against the producer.
+    slots[ring.getWriteSlot()] = 103;
+    ring.commitWrite();
+    CHECK(ring.isFull());
+
+    ring.commitRead(2);
+    CHECK_EQUAL(2, ring.getReadCount());
+    CHECK(!ring.isFull());
+    CHECK_EQUAL(102, slots[ring.getReadSlot()]);
+    CHECK_EQUAL(103, slots[ring.getReadSlot(1)]);
+
+    ring.clear();
+    CHECK_EQUAL(0, ring.getReadCount());
+    CHECK_EQUAL(0, ring.getWriteSlot());
+}
+
+
+struct StressContext
+{
+    SpscRing<uint32_t, 16> ring;
+    uint32_t               itemCount;
+    uint32_t               popCount;
+    uint32_t               outOfOrderCount;
+};
+
+static void* stressConsumer(void* pContext)
+{
+    StressContext* pStress = (StressContext*)pContext;
+    uint32_t       expected = 0;
+    uint32_t       item = 0;
+
+    while (expected < pStress->itemCount)
+    {
+        if (!pStress->ring.pop(&item))
+        {
+            sched_yield();
+            continue;
+        }
+        if (item != expected)
+        {
+            pStress->outOfOrderCount++;
+        }
+        expected = item + 1;
+        pStress->popCount++;
+    }
+    return NULL;
+}
+
+static uint32_t g_stressItems = STRESS_ITEMS;
+
+static void testSpscRingProducerAndConsumerOnSeparateThreads()
+{
+    // Every item pushed must come out of the other end once and in order.
+    static StressContext stress;
+    pthread_t            consumerThread;
+
+    stress.itemCount = g_stressItems;
+    CHECK_EQUAL(0, pthread_create(&consumerThread, NULL, stressConsumer, &stress));
+    for (uint32_t i = 0 ; i < stress.itemCount ; i++)
+    {
+        while (!stress.ring.push(i))
+        {
+            sched_yield();
+        }
+    }
+    pthread_join(consumerThread, NULL);
+
+    CHECK_EQUAL(stress.itemCount, stress.popCount);
+    CHECK_EQUAL(0, stress.outOfOrderCount);
+    CHECK_EQUAL(0, stress.ring.getReadCount());
+}
+
+static void* stressIncrementer(void* pContext)
+{
+    Atomic<uint32_t>* pCount = (Atomic<uint32_t>*)pContext;
+
+    for (int i = 0 ; i < 1000000 ; i++)
+    {
+        pCount->fetchAdd(1);
+        uint32_t expected = pCount->load();
+        while (!pCount->compareExchange(&expected, expected + 1))
+        {
+        }
+    }
+    return NULL;
+}
+
+static void testAtomicUpdatesFromSeparateThreadsAreNotLost()
+{
+    Atomic<uint32_t> count;
+    pthread_t        threads[2];
+
+    for (int i = 0 ; i < 2 ; i++)
+    {
+        CHECK_EQUAL(0, pthread_create(&threads[i], NULL, stressIncrementer, &count));
+    }
+    for (int i = 0 ; i < 2 ; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    CHECK_EQUAL(4000000, count.load());
+}
+
+
+int main(int argc, char** argv)
+{
+    if (argc > 1)
+    {
+        g_stressItems = strtoul(argv[1], NULL, 0);
+    }
+
+    RUN_TEST(testIncrementDecrementAddSubtract);
+    RUN_TEST(testCompareExchange);
+    RUN_TEST(testFetchOrAnd);
+    RUN_TEST(testLoadAcquireStoreRelease);
+    RUN_TEST(testAtomic);
+    RUN_TEST(testAtomicSigned);
+    RUN_TEST(testSpscRingPushPop);
+    RUN_TEST(testSpscRingWrapsAround);
+    RUN_TEST(testSpscRingBaseHoldsSlotsUntilCommitRead);
+    RUN_TEST(testSpscRingProducerAndConsumerOnSeparateThreads);
+    RUN_TEST(testAtomicUpdatesFromSeparateThreadsAreNotLost);
+
+    return testResults("InterlockTests");
+}
@@ -0,0 +1,517 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Tests for the hand off of frames from NeoPixel::set*() to the DMA interrupt handler and for playlist playback, run
+   against the register, GPDMA and ticker mocks. The preemption tests run the interrupt handler from inside set*() at
+   each point where the driver reads the ticker or touches one of the atomics shared with the interrupt handler, as
+   well as between the calls, and check that every frame to reach a front buffer matches a reference encoding of the
+   frame with that id. Memory to memory DMA copies are left in flight until the next "interrupt" so that anything
+   which touches a buffer still being copied out of shows up as a corrupted front buffer. */
+#include <mbed.h>
+#include <us_ticker_api.h>
+#include "Animation.h"
+#include "dmaMocks.h"
+#include "NeoPixel.h"
+#include "TestHarness.h"
+
+
+#define LED_COUNT           50
+// Number of frames handed to the driver by each of the preemption tests.
+#define PREEMPTION_FRAMES   20000
+// Encodings are kept for this many of the most recent frame ids. The front buffers never fall further behind.
+#define HISTORY_FRAMES      64
+// The interrupt is forced at preemption point (frame % TARGET_POINTS) within each set*() call.
+#define TARGET_POINTS       12
+
+
+// Exposes the driver state that the tests need to check.
+class TestNeoPixel : public NeoPixel
+{
+public:
+    TestNeoPixel(uint32_t maxPlaylistFrames, uint32_t frameQueueDepth, bool temporalDither) :
+        NeoPixel(LED_COUNT, p5, maxPlaylistFrames, frameQueueDepth, temporalDither)
+    {
+    }
+
+    uint32_t       getTxChannelMask()
+    {
+        return 1 << m_channelTx;
+    }
+    uint32_t       getPacketSize()
+    {
+        return m_packetSize;
+    }
+    const uint8_t* getFrontBuffer(uint32_t index)
+    {
+        return m_pFrontBuffers[index];
+    }
+    uint32_t       getFrontBufferId(uint32_t index)
+    {
+        return m_frontBufferIds[index];
+    }
+    uint32_t       getShownBufferId()
+    {
+        return m_shownBufferId;
+    }
+    const uint8_t* getLastFrame()
+    {
+        return m_pLastFrame;
+    }
+    bool           isLastFrameDithered()
+    {
+        return m_isLastFrameDithered;
+    }
+    const uint8_t* getPlaylistBuffer(uint32_t index)
+    {
+        return m_ppPlaylistBuffers[index];
+    }
+    uint32_t       getDmaSource(uint32_t index)
+    {
+        return m_dmaListItems[index].DMACCxSrcAddr;
+    }
+    uint32_t       getQueuedFrameCount()
+    {
+        return m_frameQueue.getReadCount();
+    }
+    bool           isPlaylistActive()
+    {
+        return m_isPlaylistActive;
+    }
+    uint32_t       getPlaylistIndex()
+    {
+        return m_playlistIndex;
+    }
+    Timeout*       getPlaylistTimeout()
+    {
+        return &m_playlistTimeout;
+    }
+    void           runPlaylistTimeout()
+    {
+        playlistTimeoutHandler();
+    }
+};
+
+
+// Both encodings of a frame as the reference driver produced them. The second is the same as the first for frames
+// that aren't temporally dithered.
+struct FrameEncoding
+{
+    uint32_t id;
+    uint8_t  encodings[2][LED_COUNT * 36 + 375];
+};
+
+
+static TestNeoPixel* g_pDriver;
+static FrameEncoding g_history[HISTORY_FRAMES];
+static uint32_t      g_ticker;
+static uint32_t      g_lastShownId;
+static uint32_t      g_lastFlushedId;
+static uint32_t      g_preemptionPoint;
+static uint32_t      g_targetPoint;
+static uint32_t      g_maxPreemptionPoints;
+static uint32_t      g_targetHits[TARGET_POINTS];
+static uint32_t      g_flipCount;
+static bool          g_isPreemptionEnabled;
+static bool          g_isInInterrupt;
+
+
+static void checkFrontBuffers()
+{
+    for (uint32_t i = 0 ; i < 2 ; i++)
+    {
+        // Id 0 is the blank frame that the driver starts out with.
+        uint32_t id = g_pDriver->getFrontBufferId(i);
+        if (id == 0)
+        {
+            continue;
+        }
+        FrameEncoding* pFrame = &g_history[id % HISTORY_FRAMES];
+        const uint8_t* pFront = g_pDriver->getFrontBuffer(i);
+        uint32_t       packetSize = g_pDriver->getPacketSize();
+        CHECK_EQUAL(id, pFrame->id);
+        // Flushing the frame queue gives up on copying the second encoding of a dithered frame taken from it, as
+        // its slot goes back to set(), so both front buffers can end up with the same encoding of those frames.
+        bool isFlushed = (int32_t)(id - g_lastFlushedId) <= 0;
+        CHECK(0 == memcmp(pFrame->encodings[i], pFront, packetSize) ||
+              (isFlushed && 0 == memcmp(pFrame->encodings[!i], pFront, packetSize)));
+    }
+}
+
+// Runs whichever DMA interrupt would come next: the completion of a memory copy if one is in flight, otherwise the
+// transmit channel moving on to the other front buffer.
+static void dmaInterrupt()
+{
+    g_isInInterrupt = true;
+    if (mockIsDmaMemCopyPending())
+    {
+        mockCompleteDmaMemCopy();
+    }
+    else
+    {
+        // Both front buffers have to be complete by the time the DMA channel starts sending one of them out.
+        checkFrontBuffers();
+        g_ticker += g_pDriver->getFrameMicroseconds();
+        mockSetTicker(g_ticker);
+        CHECK_EQUAL(g_pDriver->getTxChannelMask(), mockDmaInterrupt(g_pDriver->getTxChannelMask()));
+        // Frames can be dropped but never go backwards.
+        CHECK((int32_t)(g_pDriver->getShownBufferId() - g_lastShownId) >= 0);
+        g_lastShownId = g_pDriver->getShownBufferId();
+        g_flipCount++;
+    }
+    g_isInInterrupt = false;
+}
+
+static bool canInterrupt()
+{
+    // Interrupts can't fire while they are disabled or from inside the interrupt handler itself.
+    return g_isPreemptionEnabled && !g_isInInterrupt && __get_PRIMASK() == 0;
+}
+
+static void preemptionPoint()
+{
+    if (!canInterrupt())
+    {
+        return;
+    }
+    uint32_t point = g_preemptionPoint++;
+    if (point == g_targetPoint)
+    {
+        g_targetHits[point]++;
+        dmaInterrupt();
+    }
+    else if ((rand() & 3) == 0)
+    {
+        dmaInterrupt();
+    }
+}
+
+static void spinWait()
+{
+    // The driver only spins while waiting for a front buffer copy which the DMA interrupt will complete.
+    if (canInterrupt())
+    {
+        dmaInterrupt();
+    }
+}
+
+
+// Every atomic operation used by TripleBuffer and SpscRingBase is a point at which the interrupt handler can run. The
+// linker redirects the firmware's calls to these with --wrap.
+extern "C" uint32_t __real_interlockedLoadAcquire(const volatile uint32_t* pValue);
+extern "C" void     __real_interlockedStoreRelease(volatile uint32_t* pValue, uint32_t newValue);
+extern "C" int32_t  __real_interlockedExchange(volatile int32_t* pValue, int32_t newValue);
+extern "C" uint32_t __real_interlockedFetchAnd(volatile uint32_t* pValue, uint32_t mask);
+
+extern "C" uint32_t __wrap_interlockedLoadAcquire(const volatile uint32_t* pValue)
+{
+    preemptionPoint();
+    return __real_interlockedLoadAcquire(pValue);
+}
+
+extern "C" void __wrap_interlockedStoreRelease(volatile uint32_t* pValue, uint32_t newValue)
+{
+    preemptionPoint();
+    __real_interlockedStoreRelease(pValue, newValue);
+    preemptionPoint();
+}
+
+extern "C" int32_t __wrap_interlockedExchange(volatile int32_t* pValue, int32_t newValue)
+{
+    preemptionPoint();
+    int32_t result = __real_interlockedExchange(pValue, newValue);
+    preemptionPoint();
+    return result;
+}
+
+extern "C" uint32_t __wrap_interlockedFetchAnd(volatile uint32_t* pValue, uint32_t mask)
+{
+    preemptionPoint();
+    uint32_t result = __real_interlockedFetchAnd(pValue, mask);
+    preemptionPoint();
+    return result;
+}
+
+
+static void fillFrame(XRGBData* pPixels, RGB16Data* pPixels16, uint32_t frame)
+{
+    for (uint32_t i = 0 ; i < LED_COUNT ; i++)
+    {
+        uint32_t hash = (frame + 1) * 2654435761U + i * 40503U;
+        pPixels[i].xrgb = hash & 0xFFFFFF;
+        pPixels16[i].red = hash >> 16;
+        pPixels16[i].green = hash;
+        pPixels16[i].blue = hash >> 8;
+    }
+}
+
+static void recordFrame(TestNeoPixel* pReference)
+{
+    uint32_t       id = pReference->getNextFrameId() - 1;
+    const uint8_t* pFrame = pReference->getLastFrame();
+    uint32_t       packetSize = pReference->getPacketSize();
+    FrameEncoding* pEncoding = &g_history[id % HISTORY_FRAMES];
+
+    pEncoding->id = id;
+    memcpy(pEncoding->encodings[0], pFrame, packetSize);
+    memcpy(pEncoding->encodings[1], pReference->isLastFrameDithered() ? pFrame + packetSize : pFrame, packetSize);
+}
+
+static void runPreemptionTest(bool temporalDither)
+{
+    TestNeoPixel    driver(0, 3, temporalDither);
+    TestNeoPixel    reference(0, 0, temporalDither);
+    static XRGBData pixels[LED_COUNT];
+    static RGB16Data pixels16[LED_COUNT];
+
+    CHECK(sizeof(g_history[0].encodings[0]) >= driver.getPacketSize());
+    g_pDriver = &driver;
+    g_ticker = 0;
+    g_lastShownId = 0;
+    g_lastFlushedId = 0;
+    g_flipCount = 0;
+    memset(g_history, 0, sizeof(g_history));
+    memset(g_targetHits, 0, sizeof(g_targetHits));
+    g_maxPreemptionPoints = 0;
+    mockSetTicker(g_ticker);
+    mockSetTickerHook(preemptionPoint);
+    g_mockNopHook = spinWait;
+    srand(temporalDither ? 2 : 1);
+    driver.start();
+    reference.start();
+
+    for (uint32_t frame = 1 ; frame <= PREEMPTION_FRAMES ; frame++)
+    {
+        fillFrame(pixels, pixels16, frame);
+
+        // Some frames are rendered ahead into the queue to be shown up to a couple of frames from now. The next frame
+        // sent with plain set*() flushes any of them that are still waiting.
+        bool isQueued = (frame % 5 == 1) && !driver.isFrameQueueFull();
+        if (isQueued)
+        {
+            driver.startQueuedFrame(g_ticker + (rand() % 3) * driver.getFrameMicroseconds());
+        }
+        else if (driver.getQueuedFrameCount() > 0)
+        {
+            g_lastFlushedId = driver.getNextFrameId() - 1;
+        }
+
+        g_preemptionPoint = 0;
+        g_targetPoint = frame % TARGET_POINTS;
+        g_isPreemptionEnabled = true;
+        if (frame % 7 == 0)
+        {
+            driver.setRange(pixels + 10, 10, 5);
+        }
+        else if (temporalDither && (frame & 1))
+        {
+            driver.set(pixels16, LED_COUNT);
+        }
+        else
+        {
+            driver.set(pixels, LED_COUNT);
+        }
+        g_isPreemptionEnabled = false;
+        if (g_preemptionPoint > g_maxPreemptionPoints)
+        {
+            g_maxPreemptionPoints = g_preemptionPoint;
+        }
+
+        if (frame % 7 == 0)
+        {
+            reference.setRange(pixels + 10, 10, 5);
+        }
+        else if (temporalDither && (frame & 1))
+        {
+            reference.set(pixels16, LED_COUNT);
+        }
+        else
+        {
+            reference.set(pixels, LED_COUNT);
+        }
+        CHECK_EQUAL(reference.getNextFrameId(), driver.getNextFrameId());
+        recordFrame(&reference);
+
+        // Up to a few more interrupts before the next frame comes along.
+        g_isPreemptionEnabled = true;
+        for (int i = rand() % 4 ; i > 0 ; i--)
+        {
+            dmaInterrupt();
+        }
+        g_isPreemptionEnabled = false;
+    }
+
+    // The last frame goes out on its own once the interrupt handler has caught up.
+    g_isPreemptionEnabled = true;
+    for (int i = 0 ; i < 12 ; i++)
+    {
+        dmaInterrupt();
+    }
+    g_isPreemptionEnabled = false;
+    uint32_t lastId = driver.getNextFrameId() - 1;
+    CHECK_EQUAL(lastId, driver.getShownBufferId());
+    CHECK_EQUAL(lastId, driver.getFrontBufferId(0));
+    CHECK_EQUAL(lastId, driver.getFrontBufferId(1));
+    checkFrontBuffers();
+    CHECK(g_flipCount > PREEMPTION_FRAMES);
+
+    // Make sure that the interrupt really was forced at each of the preemption points.
+    CHECK(g_maxPreemptionPoints > 4);
+    for (uint32_t i = 0 ; i < TARGET_POINTS && i < g_maxPreemptionPoints ; i++)
+    {
+        CHECK(g_targetHits[i] > 0);
+    }
+
+    mockSetTickerHook(NULL);
+    g_mockNopHook = NULL;
+    g_pDriver = NULL;
+}
+
+static void testPreemptedSet()
+{
+    runPreemptionTest(false);
+}
+
+static void testPreemptedSetWithTemporalDither()
+{
+    runPreemptionTest(true);
+}
+
+
+static void testPlaylist()
+{
+    static const RGBData colours[] = { RED, DARK_ORANGE, YELLOW, GREEN, BLUE };
+    TestNeoPixel         driver(5, 0, false);
+    TestNeoPixel         reference(0, 0, false);
+    ManualTickSource     clock;
+    static PixelData     pattern[5];
+    AnimationKeyFrame    keyFrames[5];
+    uint16_t             remap[LED_COUNT];
+    uint32_t             ticker = 0;
+
+    setTickSource(&clock);
+    mockSetTicker(ticker);
+    createRepeatingPixelPattern(pattern, 5, colours, 5);
+    for (uint32_t i = 0 ; i < LED_COUNT ; i++)
+    {
+        remap[i] = (i * 7) % LED_COUNT;
+    }
+    for (uint16_t i = 0 ; i < 5 ; i++)
+    {
+        AnimationKeyFrame keyFrame = { NULL, 37, false, pattern, 5, i, 0 };
+        keyFrames[i] = keyFrame;
+    }
+
+    // The DMA channel has to be running for the playlist to be played back.
+    CHECK(!driver.setPlaylist(keyFrames, 5, LED_COUNT));
+    CHECK(!driver.isPlaylistActive());
+    driver.start();
+
+    for (int useRemap = 0 ; useRemap < 2 ; useRemap++)
+    {
+        driver.setRemapTable(useRemap ? remap : NULL);
+        reference.setRemapTable(useRemap ? remap : NULL);
+
+        // Animations with only static keyframes are handed to the driver as a playlist on their first update.
+        Animation<LED_COUNT> animation;
+        animation.setKeyFrames(keyFrames, 5);
+        animation.updatePixels(driver);
+        CHECK(driver.isPlaylistActive());
+
+        // Each keyframe is encoded once into its own buffer.
+        for (uint32_t i = 0 ; i < 5 ; i++)
+        {
+            reference.setPattern(pattern, 5, i, LED_COUNT);
+            CHECK(0 == memcmp(reference.getLastFrame(), driver.getPlaylistBuffer(i), driver.getPacketSize()));
+        }
+        CHECK_EQUAL(dmaAddress(driver.getPlaylistBuffer(0)), driver.getDmaSource(0));
+        CHECK_EQUAL(dmaAddress(driver.getPlaylistBuffer(0)), driver.getDmaSource(1));
+        CHECK(driver.getPlaylistTimeout()->isMockAttached());
+        CHECK_EQUAL(37000, driver.getPlaylistTimeout()->getMockMicroseconds());
+
+        // A timeout that comes early just waits out the rest of the frame.
+        ticker += 36000;
+        mockSetTicker(ticker);
+        driver.runPlaylistTimeout();
+        CHECK_EQUAL(0, driver.getPlaylistIndex());
+        CHECK_EQUAL(1000, driver.getPlaylistTimeout()->getMockMicroseconds());
+
+        // Lateness is taken out of the next frame.
+        ticker += 2000;
+        mockSetTicker(ticker);
+        driver.runPlaylistTimeout();
+        CHECK_EQUAL(1, driver.getPlaylistIndex());
+        CHECK_EQUAL(dmaAddress(driver.getPlaylistBuffer(1)), driver.getDmaSource(0));
+        CHECK_EQUAL(dmaAddress(driver.getPlaylistBuffer(1)), driver.getDmaSource(1));
+        CHECK_EQUAL(36000, driver.getPlaylistTimeout()->getMockMicroseconds());
+
+        // Frames missed during a long stall are skipped and the playlist wraps back around to the start.
+        ticker += 37000 * 3;
+        mockSetTicker(ticker);
+        driver.runPlaylistTimeout();
+        CHECK_EQUAL(4, driver.getPlaylistIndex());
+        ticker += 37000;
+        mockSetTicker(ticker);
+        driver.runPlaylistTimeout();
+        CHECK_EQUAL(0, driver.getPlaylistIndex());
+        ticker += 37000;
+        mockSetTicker(ticker);
+        driver.runPlaylistTimeout();
+        CHECK_EQUAL(1, driver.getPlaylistIndex());
+
+        // The transmit interrupt leaves the playlist running.
+        CHECK_EQUAL(driver.getTxChannelMask(), mockDmaInterrupt(driver.getTxChannelMask()));
+        CHECK(driver.isPlaylistActive());
+        CHECK_EQUAL(driver.getNextFrameId() - 1, driver.getShownBufferId());
+
+        // Later updates of the animation don't send any more frames.
+        uint32_t setCount = driver.getSetCount();
+        clock.advanceMilliseconds(100);
+        animation.updatePixels(driver);
+        CHECK_EQUAL(setCount, driver.getSetCount());
+
+        // Updating a range stops the playlist, leaving the frame it was showing along with the range in the buffers.
+        XRGBData white[2];
+        white[0] = XRGBData(255, 255, 255);
+        white[1] = white[0];
+        driver.setRange(white, 3, 2);
+        CHECK(!driver.isPlaylistActive());
+        CHECK(!driver.getPlaylistTimeout()->isMockAttached());
+        reference.setPattern(pattern, 5, 1, LED_COUNT);
+        reference.setRange(white, 3, 2);
+        CHECK(0 == memcmp(reference.getLastFrame(), driver.getLastFrame(), driver.getPacketSize()));
+        CHECK(0 == memcmp(driver.getPlaylistBuffer(1), driver.getFrontBuffer(0), driver.getPacketSize()));
+        CHECK(0 == memcmp(driver.getPlaylistBuffer(1), driver.getFrontBuffer(1), driver.getPacketSize()));
+        CHECK_EQUAL(dmaAddress(driver.getFrontBuffer(0)), driver.getDmaSource(0));
+        CHECK_EQUAL(dmaAddress(driver.getFrontBuffer(1)), driver.getDmaSource(1));
+
+        // The range then goes out through the front buffers as usual.
+        uint32_t frontBuffer = driver.getFlipCount() & 1;
+        CHECK_EQUAL(driver.getTxChannelMask(), mockDmaInterrupt(driver.getTxChannelMask()));
+        CHECK(mockIsDmaMemCopyPending());
+        mockCompleteDmaMemCopy();
+        CHECK(0 == memcmp(reference.getLastFrame(), driver.getFrontBuffer(frontBuffer), driver.getPacketSize()));
+    }
+
+    setTickSource(NULL);
+}
+
+
+int main()
+{
+    RUN_TEST(testPreemptedSet);
+    RUN_TEST(testPreemptedSetWithTemporalDither);
+    RUN_TEST(testPlaylist);
+
+    return testResults("NeoPixelTests");
+}
@@ -0,0 +1,64 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Minimal checks shared by the host unit tests. Each test program runs its tests from main() and returns
+   testResults() so that make stops on the first program with a failure. */
+#ifndef TEST_HARNESS_H_
+#define TEST_HARNESS_H_
+
+#include <stdio.h>
+
+
+extern int g_testFailures;
+extern int g_testChecks;
+
+#define CHECK(EXPR) \
+    do \
+    { \
+        g_testChecks++; \
+        if (!(EXPR)) \
+        { \
+            g_testFailures++; \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #EXPR); \
+        } \
+    } while (0)
+
+#define CHECK_EQUAL(EXPECTED, ACTUAL) \
+    do \
+    { \
+        g_testChecks++; \
+        long long expected_ = (long long)(EXPECTED); \
+        long long actual_ = (long long)(ACTUAL); \
+        if (expected_ != actual_) \
+        { \
+            g_testFailures++; \
+            printf("%s:%d: expected %s = %lld but got %lld\n", __FILE__, __LINE__, #ACTUAL, expected_, actual_); \
+        } \
+    } while (0)
+
+#define RUN_TEST(TEST) \
+    do \
+    { \
+        int failures_ = g_testFailures; \
+        TEST(); \
+        printf("%s %s\n", failures_ == g_testFailures ? "PASS" : "FAIL", #TEST); \
+    } while (0)
+
+static inline int testResults(const char* pName)
+{
+    printf("%s: %d checks, %d failures\n", pName, g_testChecks, g_testFailures);
+    return g_testFailures ? 1 : 0;
+}
+
+#endif // TEST_HARNESS_H_
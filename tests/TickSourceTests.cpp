@@ -0,0 +1,314 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Runs the animations and encoders against ManualTickSource to check their timing, including across stalls of the
+   main loop, without any hardware. */
+#include <mbed.h>
+#include <us_ticker_api.h>
+#include "Animation.h"
+#include "Encoders.h"
+#include "TestHarness.h"
+#include "TickSource.h"
+#include "ZoneMap.h"
+
+
+#define LED_COUNT 10
+
+
+// Records which of the keyframe colours was last sent and when.
+class RecordingSink : public IPixelSink
+{
+public:
+    RecordingSink()
+    {
+        setCount = 0;
+        lastRed = -1;
+        lastSetTime = 0;
+    }
+
+    // IPixelSink methods.
+    virtual void set(const RGBData* pPixels, size_t pixelCount)
+    {
+        record(pPixels[0].red);
+    }
+    virtual void set(const XRGBData* pPixels, size_t pixelCount)
+    {
+        record(pPixels[0].red);
+    }
+    virtual void set(const RGB16Data* pPixels, size_t pixelCount)
+    {
+        record(pPixels[0].red >> 8);
+    }
+    virtual void setRange(const XRGBData* pPixels, size_t firstPixel, size_t pixelCount)
+    {
+        record(pPixels[0].red);
+    }
+    virtual void setPattern(const PixelData* pPattern, size_t patternLength, size_t patternOffset,
+                            size_t pixelCount)
+    {
+        record(pPattern[patternOffset % patternLength].red);
+    }
+    virtual bool setPlaylist(const AnimationKeyFrame* pFrames, size_t frameCount, size_t pixelCount)
+    {
+        // Make the animations send every frame.
+        return false;
+    }
+
+    uint32_t setCount;
+    int      lastRed;
+    uint64_t lastSetTime;
+
+protected:
+    void record(int red)
+    {
+        setCount++;
+        lastRed = red;
+        lastSetTime = tickMilliseconds();
+    }
+};
+
+
+// Stands in for the animation run by a zone and counts how often it is run.
+class CountingUpdate : public IPixelUpdate
+{
+public:
+    CountingUpdate()
+    {
+        updateCount = 0;
+        lastUpdateTime = 0;
+    }
+
+    // IPixelUpdate methods.
+    virtual void updatePixels(IPixelSink& ledControl)
+    {
+        updateCount++;
+        lastUpdateTime = tickMilliseconds();
+    }
+
+    uint32_t updateCount;
+    uint64_t lastUpdateTime;
+};
+
+
+static ManualTickSource g_clock;
+
+
+static void testHardwareTickSourceExtendsTickerPastWrap()
+{
+    mockSetTicker(0xFFFFF000);
+    HardwareTickSource tickSource;
+
+    mockSetTicker(0x00001000);
+    CHECK_EQUAL(0x2000, tickSource.readMicroseconds());
+    CHECK_EQUAL(8, tickSource.readMilliseconds());
+
+    // The sub-millisecond remainder is carried over between reads.
+    for (uint32_t i = 1 ; i <= 1000 ; i++)
+    {
+        mockSetTicker(0x00001000 + i * 999);
+    }
+    CHECK_EQUAL(0x2000 + 999000, tickSource.readMicroseconds());
+    CHECK_EQUAL((0x2000 + 999000) / 1000, tickSource.readMilliseconds());
+}
+
+static void testSetTickSourceSwitchesTimeBase()
+{
+    ITickSource* pHardware = getTickSource();
+
+    setTickSource(&g_clock);
+    g_clock.setMicroseconds(5000123);
+    CHECK(getTickSource() == &g_clock);
+    CHECK_EQUAL(5000123, tickMicroseconds());
+    CHECK_EQUAL(5000, tickMilliseconds());
+
+    setTickSource(NULL);
+    CHECK(getTickSource() == pHardware);
+}
+
+static void testKeyFramesStayOnPeriodAfterStall()
+{
+    static const RGBData pattern[] = { RGBData(1, 0, 0), RGBData(2, 0, 0), RGBData(3, 0, 0) };
+    PixelData            pixels[3];
+    AnimationKeyFrame    keyFrames[3];
+    for (uint16_t i = 0 ; i < 3 ; i++)
+    {
+        pixels[i] = pattern[i];
+        keyFrames[i] = {NULL, 100, false, &pixels[i], 1, 0};
+    }
+
+    setTickSource(&g_clock);
+    g_clock.setMicroseconds(0);
+    static Animation<LED_COUNT> animation;
+    RecordingSink               sink;
+    animation.setKeyFrames(keyFrames, 3);
+
+    // Keyframes change exactly every 100ms while the main loop keeps up.
+    for (uint32_t time = 0 ; time <= 230 ; time++)
+    {
+        g_clock.setMicroseconds(time * 1000);
+        animation.updatePixels(sink);
+        CHECK_EQUAL(1 + (time / 100) % 3, sink.lastRed);
+    }
+    CHECK_EQUAL(200, sink.lastSetTime);
+
+    // Stall for 250ms. Each update catches up by one keyframe until the animation is back on the original 100ms
+    // boundaries rather than restarting the keyframe from when the loop came back.
+    uint32_t time = 480;
+    g_clock.setMicroseconds(time * 1000);
+    animation.updatePixels(sink);
+    CHECK_EQUAL(1, sink.lastRed);
+    g_clock.setMicroseconds(++time * 1000);
+    animation.updatePixels(sink);
+    CHECK_EQUAL(2, sink.lastRed);
+    uint32_t setCount = sink.setCount;
+    for (time++ ; time <= 1000 ; time++)
+    {
+        g_clock.setMicroseconds(time * 1000);
+        animation.updatePixels(sink);
+        CHECK_EQUAL(1 + (time / 100) % 3, sink.lastRed);
+    }
+    CHECK_EQUAL(setCount + 6, sink.setCount);
+    CHECK_EQUAL(1000, sink.lastSetTime);
+
+    setTickSource(NULL);
+}
+
+static void testMeteorResynchronizesAfterStall()
+{
+    MeteorProperties properties;
+    properties.brightColor = RGBData(255, 255, 255);
+    properties.size = 2;
+    properties.trailDecay = 64;
+    properties.isDecayRandom = false;
+    properties.delay = 10;
+
+    setTickSource(&g_clock);
+    g_clock.setMicroseconds(0);
+    static MeteorAnimation<LED_COUNT> meteor;
+    RecordingSink                     sink;
+    meteor.setProperties(&properties);
+
+    // Deadlines are kept relative to the last one so a late update doesn't push the later ones back.
+    for (uint32_t time = 1 ; time <= 55 ; time++)
+    {
+        g_clock.setMicroseconds(time * 1000 + (time == 20 ? 3000 : 0));
+        meteor.updatePixels(sink);
+    }
+    CHECK_EQUAL(5, sink.setCount);
+    CHECK_EQUAL(50, sink.lastSetTime);
+
+    // After a stall of more than a whole period, only one frame is sent and the deadlines start over from there
+    // rather than bursting out all of the missed frames.
+    for (uint32_t time = 200 ; time <= 229 ; time++)
+    {
+        g_clock.setMicroseconds(time * 1000);
+        meteor.updatePixels(sink);
+        if (time < 210)
+        {
+            CHECK_EQUAL(6, sink.setCount);
+            CHECK_EQUAL(200, sink.lastSetTime);
+        }
+    }
+    CHECK_EQUAL(8, sink.setCount);
+    CHECK_EQUAL(220, sink.lastSetTime);
+
+    setTickSource(NULL);
+}
+
+static void testZoneUpdatesStayOnPeriod()
+{
+    setTickSource(&g_clock);
+    g_clock.setMicroseconds(0);
+    static ZoneMap<LED_COUNT> zoneMap;
+    CountingUpdate            zoneUpdate;
+    RecordingSink             sink;
+    CHECK(zoneMap.addZone(&zoneUpdate, 0, LED_COUNT, 10));
+
+    // A main loop running every 3ms is late for most 10ms deadlines but that lateness mustn't accumulate.
+    for (uint32_t time = 0 ; time < 1000 ; time += 3)
+    {
+        g_clock.setMicroseconds(time * 1000);
+        zoneMap.updatePixels(sink);
+    }
+    CHECK_EQUAL(100, zoneUpdate.updateCount);
+
+    // After a stall of more than a whole interval, the zone is run once and then every 10ms from there.
+    for (uint32_t time = 2005 ; time <= 2035 ; time++)
+    {
+        g_clock.setMicroseconds(time * 1000);
+        zoneMap.updatePixels(sink);
+        if (time < 2015)
+        {
+            CHECK_EQUAL(101, zoneUpdate.updateCount);
+            CHECK_EQUAL(2005, zoneUpdate.lastUpdateTime);
+        }
+    }
+    CHECK_EQUAL(104, zoneUpdate.updateCount);
+    CHECK_EQUAL(2035, zoneUpdate.lastUpdateTime);
+
+    setTickSource(NULL);
+}
+
+static void testEncoderPressIsDebouncedAcrossTickerWrap()
+{
+    EncoderState state;
+
+    // Start just before the point where the old 32-bit microsecond timer would have wrapped.
+    setTickSource(&g_clock);
+    g_clock.setMicroseconds(0xFFFFFE00);
+    mockResetPinLevels();
+    Encoder encoder(p11, p12, p17);
+
+    mockSetPinLevel(p17, 0);
+    CHECK(encoder.sample(&state));
+    CHECK(state.isPressed);
+
+    // Bounces within the debounce time are ignored, even though the 32-bit time would have wrapped in between.
+    for (uint32_t i = 0 ; i < 9 ; i++)
+    {
+        g_clock.advanceMicroseconds(100);
+        mockSetPinLevel(p17, i & 1);
+        CHECK(!encoder.sample(&state));
+        CHECK(state.isPressed);
+    }
+
+    mockSetPinLevel(p17, 1);
+    g_clock.advanceMicroseconds(100);
+    CHECK(encoder.sample(&state));
+    CHECK(!state.isPressed);
+
+    // A press held through a long stall is released on the first sample after it.
+    mockSetPinLevel(p17, 0);
+    CHECK(encoder.sample(&state));
+    g_clock.advanceMilliseconds(10000);
+    mockSetPinLevel(p17, 1);
+    CHECK(encoder.sample(&state));
+    CHECK(!state.isPressed);
+    CHECK_EQUAL(0, state.count);
+
+    setTickSource(NULL);
+}
+
+
+int main()
+{
+    RUN_TEST(testHardwareTickSourceExtendsTickerPastWrap);
+    RUN_TEST(testSetTickSourceSwitchesTimeBase);
+    RUN_TEST(testKeyFramesStayOnPeriodAfterStall);
+    RUN_TEST(testMeteorResynchronizesAfterStall);
+    RUN_TEST(testZoneUpdatesStayOnPeriod);
+    RUN_TEST(testEncoderPressIsDebouncedAcrossTickerWrap);
+
+    return testResults("TickSourceTests");
+}
@@ -0,0 +1,255 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Stress tests for the TripleBuffer used to hand frames from the main loop to the DMA interrupt handler. The writer
+   fills every word of a buffer with the id of its frame before publishing it so that the reader can tell if it was
+   ever handed a buffer that the writer was still filling in. */
+#include <mbed.h>
+#include <pthread.h>
+#include <sched.h>
+#include "Atomic.h"
+#include "TestHarness.h"
+#include "TripleBuffer.h"
+
+
+#define FRAME_WORDS         16
+// Number of frames published by the threaded stress test. Can be overridden from the command line.
+#define STRESS_FRAMES       3000000
+
+
+static volatile uint32_t g_buffers[TripleBuffer::BUFFER_COUNT][FRAME_WORDS];
+
+
+// Checks each frame handed to the reader.
+class FrameChecker
+{
+public:
+    FrameChecker()
+    {
+        lastId = 0;
+        fetchCount = 0;
+        tornCount = 0;
+        staleCount = 0;
+    }
+
+    bool fetch(TripleBuffer* pTripleBuffer)
+    {
+        if (!pTripleBuffer->fetch())
+        {
+            return false;
+        }
+
+        // Read the frame twice so that a writer still filling it in on another thread is caught too.
+        uint32_t readIndex = pTripleBuffer->getReadIndex();
+        uint32_t id = g_buffers[readIndex][0];
+        for (int pass = 0 ; pass < 2 ; pass++)
+        {
+            for (int i = 0 ; i < FRAME_WORDS ; i++)
+            {
+                if (g_buffers[readIndex][i] != id)
+                {
+                    tornCount++;
+                    pass = 2;
+                    break;
+                }
+            }
+        }
+        // Frames can be dropped but never go backwards or repeat.
+        if (id <= lastId)
+        {
+            staleCount++;
+        }
+        lastId = id;
+        fetchCount++;
+        return true;
+    }
+
+    uint32_t lastId;
+    uint32_t fetchCount;
+    uint32_t tornCount;
+    uint32_t staleCount;
+};
+
+static void writeFrame(TripleBuffer* pTripleBuffer, uint32_t id, uint32_t firstWords)
+{
+    uint32_t writeIndex = pTripleBuffer->getWriteIndex();
+    for (uint32_t i = firstWords ; i < FRAME_WORDS ; i++)
+    {
+        g_buffers[writeIndex][i] = id;
+    }
+}
+
+
+static void testIndicesAlwaysDistinct()
+{
+    TripleBuffer tripleBuffer;
+    FrameChecker checker;
+
+    for (uint32_t id = 1 ; id <= 1000 ; id++)
+    {
+        writeFrame(&tripleBuffer, id, 0);
+        tripleBuffer.publish();
+        if (id % 3)
+        {
+            checker.fetch(&tripleBuffer);
+        }
+        if (id % 7 == 0)
+        {
+            tripleBuffer.discard();
+        }
+
+        uint32_t writeIndex = tripleBuffer.getWriteIndex();
+        uint32_t readIndex = tripleBuffer.getReadIndex();
+        CHECK(writeIndex < TripleBuffer::BUFFER_COUNT);
+        CHECK(readIndex < TripleBuffer::BUFFER_COUNT);
+        CHECK(writeIndex != readIndex);
+    }
+    CHECK_EQUAL(0, checker.tornCount);
+    CHECK_EQUAL(0, checker.staleCount);
+}
+
+static void testFetchReturnsNewestFrameOnly()
+{
+    TripleBuffer tripleBuffer;
+    FrameChecker checker;
+
+    CHECK(!tripleBuffer.fetch());
+    for (uint32_t id = 1 ; id <= 5 ; id++)
+    {
+        writeFrame(&tripleBuffer, id, 0);
+        tripleBuffer.publish();
+    }
+    checker.fetch(&tripleBuffer);
+    CHECK_EQUAL(5, checker.lastId);
+    CHECK(!tripleBuffer.fetch());
+
+    // Discarded frames are never seen by the reader.
+    writeFrame(&tripleBuffer, 6, 0);
+    tripleBuffer.publish();
+    tripleBuffer.discard();
+    CHECK(!tripleBuffer.fetch());
+    CHECK_EQUAL(5, g_buffers[tripleBuffer.getReadIndex()][0]);
+}
+
+static void testReaderInterruptingEveryWriterStep()
+{
+    // Simulates the DMA interrupt firing at every point in the writer's frame: before each word is written, just
+    // before publish() and just after it. Every combination is tried for the first frames and random ones after.
+    TripleBuffer tripleBuffer;
+    FrameChecker checker;
+
+    srand(1);
+    for (uint32_t id = 1 ; id <= 200000 ; id++)
+    {
+        uint32_t mask = id < (1 << (FRAME_WORDS + 2)) ? id : (uint32_t)rand();
+        uint32_t writeIndex = tripleBuffer.getWriteIndex();
+        for (uint32_t i = 0 ; i < FRAME_WORDS ; i++)
+        {
+            if (mask & (1 << i))
+            {
+                checker.fetch(&tripleBuffer);
+                CHECK(tripleBuffer.getReadIndex() != writeIndex);
+            }
+            g_buffers[writeIndex][i] = id;
+        }
+        if (mask & (1 << FRAME_WORDS))
+        {
+            checker.fetch(&tripleBuffer);
+        }
+        tripleBuffer.publish();
+        if (mask & (1 << (FRAME_WORDS + 1)))
+        {
+            checker.fetch(&tripleBuffer);
+            CHECK_EQUAL(id, checker.lastId);
+        }
+    }
+    CHECK_EQUAL(0, checker.tornCount);
+    CHECK_EQUAL(0, checker.staleCount);
+}
+
+
+struct StressContext
+{
+    TripleBuffer     tripleBuffer;
+    FrameChecker     checker;
+    Atomic<uint32_t> isReaderRunning;
+    Atomic<uint32_t> isWriterDone;
+    uint32_t         frameCount;
+};
+
+static void* stressReader(void* pContext)
+{
+    StressContext* pStress = (StressContext*)pContext;
+
+    pStress->isReaderRunning.store(1);
+    while (!pStress->isWriterDone.load())
+    {
+        if (!pStress->checker.fetch(&pStress->tripleBuffer))
+        {
+            sched_yield();
+        }
+    }
+    // Whatever was published last must still be waiting.
+    pStress->checker.fetch(&pStress->tripleBuffer);
+    return NULL;
+}
+
+static uint32_t g_stressFrames = STRESS_FRAMES;
+
+static void testPublisherAndConsumerOnSeparateThreads()
+{
+    // Runs the writer and reader flat out on two threads so that they really do race each other on a multi-core
+    // machine. The writer yields now and then so that the reader still gets plenty of turns on a single core.
+    static StressContext stress;
+    pthread_t            readerThread;
+
+    stress.frameCount = g_stressFrames;
+    CHECK_EQUAL(0, pthread_create(&readerThread, NULL, stressReader, &stress));
+    while (!stress.isReaderRunning.load())
+    {
+    }
+    for (uint32_t id = 1 ; id <= stress.frameCount ; id++)
+    {
+        writeFrame(&stress.tripleBuffer, id, 0);
+        stress.tripleBuffer.publish();
+        if ((id & 0xFF) == 0)
+        {
+            sched_yield();
+        }
+    }
+    stress.isWriterDone.store(1);
+    pthread_join(readerThread, NULL);
+
+    printf("    %u frames published, %u fetched\n", stress.frameCount, stress.checker.fetchCount);
+    CHECK(stress.checker.fetchCount > 0);
+    CHECK_EQUAL(stress.frameCount, stress.checker.lastId);
+    CHECK_EQUAL(0, stress.checker.tornCount);
+    CHECK_EQUAL(0, stress.checker.staleCount);
+}
+
+
+int main(int argc, char** argv)
+{
+    if (argc > 1)
+    {
+        g_stressFrames = strtoul(argv[1], NULL, 0);
+    }
+
+    RUN_TEST(testIndicesAlwaysDistinct);
+    RUN_TEST(testFetchReturnsNewestFrameOnly);
+    RUN_TEST(testReaderInterruptingEveryWriterStep);
+    RUN_TEST(testPublisherAndConsumerOnSeparateThreads);
+
+    return testResults("TripleBufferTests");
+}
@@ -0,0 +1,144 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Just enough of CMSIS to build the hardware independent parts of the firmware on a desktop machine for the unit
+   tests. There are no interrupts on the host so the interrupt masking is just tracked rather than enforced. The
+   peripheral registers used by the NeoPixel driver are plain structures in RAM for the tests to inspect. */
+#ifndef CMSIS_H_
+#define CMSIS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+#define __INLINE inline
+// Read only registers are left writable so that the tests can set them up.
+#define __I      volatile
+#define __O      volatile
+#define __IO     volatile
+
+
+typedef struct
+{
+    __IO uint32_t DMACCSrcAddr;
+    __IO uint32_t DMACCDestAddr;
+    __IO uint32_t DMACCLLI;
+    __IO uint32_t DMACCControl;
+    __IO uint32_t DMACCConfig;
+} LPC_GPDMACH_TypeDef;
+
+typedef struct
+{
+    __I  uint32_t DMACIntStat;
+    __I  uint32_t DMACIntTCStat;
+    __O  uint32_t DMACIntTCClear;
+    __I  uint32_t DMACIntErrStat;
+    __O  uint32_t DMACIntErrClr;
+    __I  uint32_t DMACRawIntTCStat;
+    __I  uint32_t DMACRawIntErrStat;
+    __I  uint32_t DMACEnbldChns;
+    __IO uint32_t DMACSoftBReq;
+    __IO uint32_t DMACSoftSReq;
+    __IO uint32_t DMACSoftLBReq;
+    __IO uint32_t DMACSoftLSReq;
+    __IO uint32_t DMACConfig;
+    __IO uint32_t DMACSync;
+} LPC_GPDMA_TypeDef;
+
+typedef struct
+{
+    __IO uint32_t PCONP;
+} LPC_SC_TypeDef;
+
+typedef struct
+{
+    __IO uint32_t CR0;
+    __IO uint32_t CR1;
+    __IO uint32_t DR;
+    __I  uint32_t SR;
+    __IO uint32_t CPSR;
+    __IO uint32_t IMSC;
+    __IO uint32_t RIS;
+    __IO uint32_t MIS;
+    __O  uint32_t ICR;
+    __IO uint32_t DMACR;
+} LPC_SSP_TypeDef;
+
+#define LPC_GPDMA   (&g_mockGpdma)
+#define LPC_SC      (&g_mockSc)
+#define LPC_SSP0    (&g_mockSsp[0])
+#define LPC_SSP1    (&g_mockSsp[1])
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+extern uint32_t          g_mockPrimask;
+// Called from __NOP() when set so that a test can let a DMA transfer complete while the firmware spins waiting on it.
+extern void              (*g_mockNopHook)(void);
+extern LPC_GPDMA_TypeDef g_mockGpdma;
+extern LPC_SC_TypeDef    g_mockSc;
+extern LPC_SSP_TypeDef   g_mockSsp[2];
+
+static __INLINE void __disable_irq(void)
+{
+    g_mockPrimask = 1;
+}
+
+static __INLINE void __enable_irq(void)
+{
+    g_mockPrimask = 0;
+}
+
+static __INLINE uint32_t __get_PRIMASK(void)
+{
+    return g_mockPrimask;
+}
+
+static __INLINE void __set_PRIMASK(uint32_t primask)
+{
+    g_mockPrimask = primask;
+}
+
+static __INLINE void __NOP(void)
+{
+    if (g_mockNopHook)
+    {
+        g_mockNopHook();
+    }
+}
+
+static __INLINE uint32_t __CLZ(uint32_t value)
+{
+    return value ? __builtin_clz(value) : 32;
+}
+
+static __INLINE uint32_t __RBIT(uint32_t value)
+{
+    uint32_t result = 0;
+    for (int i = 0 ; i < 32 ; i++)
+    {
+        result = (result << 1) | (value & 1);
+        value >>= 1;
+    }
+    return result;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CMSIS_H_
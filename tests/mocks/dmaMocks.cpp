@@ -0,0 +1,161 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <assert.h>
+#include <mbed.h>
+#include <GPDMA.h>
+#include "dmaMocks.h"
+
+
+static LPC_GPDMACH_TypeDef g_channels[8];
+static uint32_t            g_allocatedChannels;
+static DmaInterruptHandler g_handlerListHead;
+static int                 g_isCopyPending;
+static void*               g_pCopyDest;
+static const void*         g_pCopySrc;
+static size_t              g_copySize;
+static DmaMemCopyCallback  g_copyCallback;
+
+
+extern "C" int allocateDmaChannel(DmaDesiredChannel desiredChannel)
+{
+    int channel;
+
+    if (desiredChannel == GPDMA_CHANNEL_HIGH)
+    {
+        for (channel = GPDMA_CHANNEL_HIGHEST ; channel < GPDMA_CHANNEL_LOWEST ; channel++)
+        {
+            if ((g_allocatedChannels & (1 << channel)) == 0)
+                break;
+        }
+    }
+    else if (desiredChannel == GPDMA_CHANNEL_LOW)
+    {
+        // Like the firmware, leave the lowest priority channel for dmaMemCopy().
+        for (channel = GPDMA_CHANNEL_LOWEST - 1 ; channel >= GPDMA_CHANNEL_HIGHEST ; channel--)
+        {
+            if ((g_allocatedChannels & (1 << channel)) == 0)
+                break;
+        }
+    }
+    else
+    {
+        channel = desiredChannel;
+    }
+    assert ( (g_allocatedChannels & (1 << channel)) == 0 );
+
+    g_allocatedChannels |= 1 << channel;
+    return channel;
+}
+
+extern "C" void freeDmaChannel(int channel)
+{
+    g_allocatedChannels &= ~(1 << channel);
+}
+
+extern "C" LPC_GPDMACH_TypeDef* dmaChannelFromIndex(int index)
+{
+    return &g_channels[index];
+}
+
+
+extern "C" int addDmaInterruptHandler(DmaInterruptHandler* pHandler)
+{
+    pHandler->pNext = g_handlerListHead.pNext;
+    g_handlerListHead.pNext = pHandler;
+    return 1;
+}
+
+extern "C" int removeDmaInterruptHandler(DmaInterruptHandler* pHandler)
+{
+    for (DmaInterruptHandler* pPrev = &g_handlerListHead ; pPrev->pNext ; pPrev = pPrev->pNext)
+    {
+        if (pPrev->pNext == pHandler)
+        {
+            pPrev->pNext = pHandler->pNext;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+extern "C" uint32_t mockDmaInterrupt(uint32_t dmaInterruptStatus)
+{
+    uint32_t handled = 0;
+
+    for (DmaInterruptHandler* pCurr = g_handlerListHead.pNext ; pCurr ; pCurr = pCurr->pNext)
+    {
+        handled |= pCurr->handler(pCurr->pContext, dmaInterruptStatus);
+    }
+    return handled;
+}
+
+
+extern "C" int dmaMemCopy(void* pDest, const void* pSrc, size_t size, const DmaMemCopyCallback *pCallback)
+{
+    // Just like the firmware, fall back to a memcpy() when the channel is still busy with the last copy.
+    if (g_isCopyPending)
+    {
+        memcpy(pDest, pSrc, size);
+        if (pCallback)
+        {
+            pCallback->handler(pCallback->pContext);
+        }
+        return 0;
+    }
+
+    g_isCopyPending = 1;
+    g_pCopyDest = pDest;
+    g_pCopySrc = pSrc;
+    g_copySize = size;
+    g_copyCallback.handler = pCallback ? pCallback->handler : NULL;
+    g_copyCallback.pContext = pCallback ? pCallback->pContext : NULL;
+    return 1;
+}
+
+extern "C" void uninitDmaMemCopy(void)
+{
+    g_isCopyPending = 0;
+}
+
+extern "C" int mockIsDmaMemCopyPending(void)
+{
+    return g_isCopyPending;
+}
+
+extern "C" void mockCompleteDmaMemCopy(void)
+{
+    if (!g_isCopyPending)
+    {
+        return;
+    }
+    // The source is only read now, so any change made to it while the copy was in flight ends up in the destination.
+    memcpy(g_pCopyDest, g_pCopySrc, g_copySize);
+    g_isCopyPending = 0;
+    if (g_copyCallback.handler)
+    {
+        g_copyCallback.handler(g_copyCallback.pContext);
+    }
+}
+
+
+extern "C" void* dmaHeap0Alloc(uint32_t size)
+{
+    return malloc(size);
+}
+
+extern "C" void* dmaHeap1Alloc(uint32_t size)
+{
+    return malloc(size);
+}
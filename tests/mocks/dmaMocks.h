@@ -0,0 +1,38 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Test controls for the GPDMA mock in dmaMocks.cpp. The memory to memory copies started by dmaMemCopy() don't happen
+   until the test calls mockCompleteDmaMemCopy() so that it can check what the firmware does while one is in flight.
+   The registered DMA interrupt handlers are run by mockDmaInterrupt(). */
+#ifndef DMA_MOCKS_H_
+#define DMA_MOCKS_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+int      mockIsDmaMemCopyPending(void);
+// Copies the data for the pending dmaMemCopy() and then calls its completion handler.
+void     mockCompleteDmaMemCopy(void);
+// Calls each registered interrupt handler with the given channel status bits. Returns the bits that were handled.
+uint32_t mockDmaInterrupt(uint32_t dmaInterruptStatus);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DMA_MOCKS_H_
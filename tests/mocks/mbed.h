@@ -0,0 +1,134 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Just enough of the mbed SDK to build the hardware independent parts of the firmware on a desktop machine for the
+   unit tests. The level read from each DigitalIn is set by the test with mockSetPinLevel(). SPI only records which
+   SSP peripheral it would use and Timeout only records what it was last attached for, leaving the test to call the
+   handler itself. */
+#ifndef MBED_H_
+#define MBED_H_
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cmsis.h"
+
+
+enum PinName
+{
+    p5 = 5, p6, p7, p8, p9, p10, p11, p12, p13, p14, p15, p16, p17, p18, p19, p20,
+    NC = -1
+};
+
+#define SPI_0   LPC_SSP0
+#define SPI_1   LPC_SSP1
+
+enum PinMode
+{
+    PullUp,
+    PullDown,
+    PullNone
+};
+
+// Pins read as high until set otherwise, as though they were all pulled up.
+void mockSetPinLevel(PinName pin, int level);
+int  mockGetPinLevel(PinName pin);
+void mockResetPinLevels();
+
+
+class DigitalIn
+{
+public:
+    DigitalIn(PinName pin, PinMode mode = PullNone) : m_pin(pin)
+    {
+    }
+
+    int read()
+    {
+        return mockGetPinLevel(m_pin);
+    }
+    operator int()
+    {
+        return read();
+    }
+
+protected:
+    PinName m_pin;
+};
+
+
+
+struct spi_s
+{
+    LPC_SSP_TypeDef* spi;
+};
+
+class SPI
+{
+public:
+    SPI(PinName mosi, PinName miso, PinName sclk)
+    {
+        // p5 is the MOSI pin of SSP1 and p11 the one for SSP0.
+        _spi.spi = (mosi == p5) ? SPI_1 : SPI_0;
+    }
+
+    void format(int bits, int mode = 0)
+    {
+    }
+    void frequency(int hz = 1000000)
+    {
+    }
+
+protected:
+    spi_s _spi;
+};
+
+
+class Timeout
+{
+public:
+    Timeout()
+    {
+        m_microseconds = 0;
+        m_isAttached = false;
+    }
+
+    template <class T>
+    void attach_us(T* pObject, void (T::*pMethod)(), uint32_t microseconds)
+    {
+        m_microseconds = microseconds;
+        m_isAttached = true;
+    }
+    void detach()
+    {
+        m_isAttached = false;
+    }
+
+    bool isMockAttached()
+    {
+        return m_isAttached;
+    }
+    uint32_t getMockMicroseconds()
+    {
+        return m_microseconds;
+    }
+
+protected:
+    uint32_t m_microseconds;
+    bool     m_isAttached;
+};
+
+#endif // MBED_H_
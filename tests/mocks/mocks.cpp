@@ -0,0 +1,72 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <mbed.h>
+#include <us_ticker_api.h>
+
+
+uint32_t          g_mockPrimask;
+void              (*g_mockNopHook)(void);
+LPC_GPDMA_TypeDef g_mockGpdma;
+LPC_SC_TypeDef    g_mockSc;
+LPC_SSP_TypeDef   g_mockSsp[2];
+static uint32_t   g_ticker;
+static void       (*g_tickerHook)(void);
+static int        g_pinLevels[p20 + 1];
+static bool       g_arePinLevelsSet;
+
+
+void mockSetPinLevel(PinName pin, int level)
+{
+    mockGetPinLevel(pin);
+    g_pinLevels[pin] = level;
+}
+
+int mockGetPinLevel(PinName pin)
+{
+    if (!g_arePinLevelsSet)
+    {
+        mockResetPinLevels();
+    }
+    return g_pinLevels[pin];
+}
+
+void mockResetPinLevels()
+{
+    for (size_t i = 0 ; i < sizeof(g_pinLevels) / sizeof(g_pinLevels[0]) ; i++)
+    {
+        g_pinLevels[i] = 1;
+    }
+    g_arePinLevelsSet = true;
+}
+
+
+extern "C" uint32_t us_ticker_read(void)
+{
+    if (g_tickerHook)
+    {
+        g_tickerHook();
+    }
+    return g_ticker;
+}
+
+extern "C" void mockSetTicker(uint32_t ticker)
+{
+    g_ticker = ticker;
+}
+
+extern "C" void mockSetTickerHook(void (*pHook)(void))
+{
+    g_tickerHook = pHook;
+}
@@ -0,0 +1,35 @@
+/* Copyright (C) 2018  Adam Green (https://github.com/adamgreen)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Microsecond ticker for the unit tests. It only moves when the test sets it with mockSetTicker(). A test
+   can also hook each read to run code at the points where the firmware samples the time. */
+#ifndef US_TICKER_API_H_
+#define US_TICKER_API_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+uint32_t us_ticker_read(void);
+void     mockSetTicker(uint32_t ticker);
+void     mockSetTickerHook(void (*pHook)(void));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // US_TICKER_API_H_
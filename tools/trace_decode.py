@@ -0,0 +1,128 @@
+#!/usr/bin/env python
+# Copyright 2018 Adam Green (http://mbed.org/users/AdamGreen/)
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+"""Decodes the binary event trace sent out by traceDump() in firmware/Trace.c into a timeline.
+
+Capture the serial output to a file (text from printf() before and after the dump is skipped) and then run:
+    trace_decode.py capture.bin
+Each line of the timeline gives the time since the first event, the time since the previous event, the event name
+and its decoded argument. Pass --encoding to check that the table below still matches TraceEventId in Trace.h.
+"""
+import struct
+import sys
+
+SIGNATURE = b"NPTR"
+VERSION = 1
+HEADER_FORMAT = "<IHHII"
+EVENT_FORMAT = "<IHBB"
+
+ENCODER_NAMES = ["pattern", "speed", "brightness"]
+
+
+def encoderName(index):
+    return ENCODER_NAMES[index] if index < len(ENCODER_NAMES) else "encoder%d" % index
+
+
+def decodeTurn(arg):
+    count = arg & 0xFF
+    if count >= 0x80:
+        count -= 0x100
+    return "%s %+d" % (encoderName(arg >> 8), count)
+
+
+# Must be kept in the same order as the TraceEventId enumeration in firmware/Trace.h.
+EVENTS = [
+    ("set_start",       lambda arg: "first pixel %u" % arg),
+    ("set_end",         lambda arg: "frame %u" % arg),
+    ("flip",            lambda arg: "flip %u" % arg),
+    ("back_buffer_free", lambda arg: ""),
+    ("memcopy_start",   lambda arg: "%u bytes" % arg),
+    ("memcopy_done",    lambda arg: ""),
+    ("memcopy_fallback", lambda arg: "%u bytes" % arg),
+    ("encoder_turn",    decodeTurn),
+    ("encoder_press",   lambda arg: encoderName(arg)),
+    ("animation_switch", lambda arg: "animation %u" % arg),
+    ("playlist_frame",  lambda arg: "frame %u" % arg),
+]
+
+
+def decodeDump(data, offset):
+    headerSize = struct.calcsize(HEADER_FORMAT)
+    signature, version, eventSize, eventCount, lostCount = struct.unpack_from(HEADER_FORMAT, data, offset)
+    if version != VERSION:
+        raise ValueError("unsupported trace version %d" % version)
+    offset += headerSize
+    if offset + eventSize * eventCount > len(data):
+        raise ValueError("trace dump is truncated")
+
+    events = []
+    for i in range(eventCount):
+        timestamp, arg, eventId, reserved = struct.unpack_from(EVENT_FORMAT, data, offset + i * eventSize)
+        events.append((timestamp, i, eventId, arg))
+    return events, lostCount, offset + eventSize * eventCount
+
+
+def signedElapsed(startTime, endTime):
+    elapsed = (endTime - startTime) & 0xFFFFFFFF
+    return elapsed - 0x100000000 if elapsed >= 0x80000000 else elapsed
+
+
+def printTimeline(events, lostCount):
+    print("# %d events, %d older events were overwritten" % (len(events), lostCount))
+    if not events:
+        return
+
+    # Make the timestamps relative to the first event so that the 32-bit microsecond ticker wrapping around (every
+    # 71 minutes) doesn't matter. An interrupt can record an event between another event claiming its slot and
+    # reading the timer so sort on the times, falling back to slot order for ties.
+    firstTime = events[0][0]
+    events = sorted(events, key=lambda event: (signedElapsed(firstTime, event[0]), event[1]))
+    startTime = events[0][0]
+    lastTime = startTime
+    print("%12s %10s  %-18s %s" % ("time(us)", "delta(us)", "event", "arg"))
+    for timestamp, index, eventId, arg in events:
+        if eventId < len(EVENTS):
+            name, decodeArg = EVENTS[eventId]
+            description = decodeArg(arg)
+        else:
+            name, description = "event%d" % eventId, "0x%04X" % arg
+        print("%12d %10d  %-18s %s" % ((timestamp - startTime) & 0xFFFFFFFF, (timestamp - lastTime) & 0xFFFFFFFF,
+                                        name, description))
+        lastTime = timestamp
+
+
+def main(args):
+    if len(args) != 1:
+        sys.stderr.write("Usage: trace_decode.py captureFilename\n")
+        return 1
+    with open(args[0], "rb") as f:
+        data = f.read()
+
+    dumpCount = 0
+    offset = data.find(SIGNATURE)
+    while offset >= 0:
+        events, lostCount, offset = decodeDump(data, offset)
+        if dumpCount > 0:
+            print("")
+        printTimeline(events, lostCount)
+        dumpCount += 1
+        offset = data.find(SIGNATURE, offset)
+    if dumpCount == 0:
+        sys.stderr.write("No trace dump found in %s\n" % args[0])
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
@@ -0,0 +1,96 @@
+#!/usr/bin/env python
+# Copyright 2018 Adam Green (http://mbed.org/users/AdamGreen/)
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+"""Regenerates the sorted LED tables in firmware/TreeGeometry.cpp from its g_treeLedPositions table.
+
+Run after editing the positions:
+    tree_sort.py [path/to/TreeGeometry.cpp]
+The g_treeLedsByHeight, g_treeLedsByAngle and g_treeLedsByRadius tables are rewritten in place. Pass --check to
+only report whether they are up to date, with a non-zero exit code if they aren't.
+"""
+import os
+import re
+import sys
+
+DEFAULT_FILENAME = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "firmware", "TreeGeometry.cpp")
+POSITION_PATTERN = re.compile(r"^\s*\{\s*(\d+),\s*(\d+),\s*(\d+),\s*(\d+)\s*\},?\s*//\s*(\d+)\s*$", re.MULTILINE)
+VALUES_PER_LINE = 10
+
+# Ties along each axis are broken by a second axis and then by strand index so that the order is well defined.
+TABLES = [
+    ("g_treeLedsByHeight", lambda pos: (pos["height"], pos["angle"], pos["index"])),
+    ("g_treeLedsByAngle",  lambda pos: (pos["angle"], pos["height"], pos["index"])),
+    ("g_treeLedsByRadius", lambda pos: (pos["radius"], pos["height"], pos["index"])),
+]
+
+
+def parsePositions(source):
+    positions = []
+    for match in POSITION_PATTERN.finditer(source):
+        level, angle, height, radius, index = [int(value) for value in match.groups()]
+        if index != len(positions):
+            raise ValueError("LED %d is out of order in g_treeLedPositions" % index)
+        positions.append({"index": index, "level": level, "angle": angle, "height": height, "radius": radius})
+    if not positions:
+        raise ValueError("g_treeLedPositions table not found")
+    return positions
+
+
+def formatTable(indices):
+    lines = []
+    for start in range(0, len(indices), VALUES_PER_LINE):
+        lines.append("    " + ", ".join("%2d" % index for index in indices[start:start + VALUES_PER_LINE]))
+    return ",\n".join(lines)
+
+
+def updateTables(source, positions):
+    for name, key in TABLES:
+        indices = [pos["index"] for pos in sorted(positions, key=key)]
+        pattern = re.compile(r"(const uint16_t %s\[TREE_LED_COUNT\] =\s*\{\n)(.*?)(\n\};)" % name, re.DOTALL)
+        if not pattern.search(source):
+            raise ValueError("%s table not found" % name)
+        source = pattern.sub(lambda match: match.group(1) + formatTable(indices) + match.group(3), source, 1)
+    return source
+
+
+def main(args):
+    isCheckOnly = "--check" in args
+    args = [arg for arg in args if arg != "--check"]
+    if len(args) > 1:
+        sys.stderr.write("Usage: tree_sort.py [--check] [TreeGeometry.cpp]\n")
+        return 1
+    filename = args[0] if args else DEFAULT_FILENAME
+
+    with open(filename, "r") as f:
+        source = f.read()
+    try:
+        updated = updateTables(source, parsePositions(source))
+    except ValueError as error:
+        sys.stderr.write("%s: %s\n" % (filename, error))
+        return 1
+
+    if updated == source:
+        print("%s is up to date" % filename)
+        return 0
+    if isCheckOnly:
+        sys.stderr.write("%s needs its sorted tables regenerated\n" % filename)
+        return 1
+    with open(filename, "w") as f:
+        f.write(updated)
+    print("Updated %s" % filename)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))